@@ -136,6 +136,8 @@ public:
     GeoBounds convert(CoordRefSystem to) const;
     GeoCoordinate& getWestSouth();
     GeoCoordinate& getEastNorth();
+    const GeoCoordinate& getWestSouth() const;
+    const GeoCoordinate& getEastNorth() const;
 
 private:
     GeoCoordinate m_westSouth;
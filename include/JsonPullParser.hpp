@@ -0,0 +1,83 @@
+/* -*- Mode: c++; c-basic-offset: 4; tab-width: 4; coding: utf-8; -*-  */
+/*
+ * Copyright (C) 2023 RPf
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glibmm.h>
+#include <string>
+#include <string_view>
+
+/**
+ * reads json token by token from memory, no document is built
+ *   so values can be used (or skipped) as they come.
+ *   Strings are passed as view, only valid until the next call.
+ *   The structure is checked as far as needed to tell
+ *   keys from values, on any error Token::Error is returned from then on.
+ */
+class JsonPullParser
+{
+public:
+    enum class Token {
+        BeginObject,
+        EndObject,
+        BeginArray,
+        EndArray,
+        Key,
+        String,
+        Number,
+        True,
+        False,
+        Null,
+        End,
+        Error
+    };
+    JsonPullParser(const char* data, gsize len);
+    explicit JsonPullParser(const JsonPullParser& orig) = delete;
+    virtual ~JsonPullParser() = default;
+
+    Token next();
+    // for Key, String
+    std::string_view get_string() {
+        return m_string;
+    }
+    // for Number
+    double get_number();
+    // skip the value that starts with token (e.g. a complete object after BeginObject)
+    Token skip(Token token);
+    Glib::ustring get_error() {
+        return m_error;
+    }
+    gsize get_offset() {
+        return m_pos;
+    }
+private:
+    Token fail(const char* msg);
+    bool parse_string();
+    bool parse_literal(const char* literal);
+    void skip_space();
+    static void append_utf8(std::string& buf, gunichar c);
+
+    const char* m_data;
+    gsize m_len;
+    gsize m_pos{0};
+    std::string_view m_string;
+    std::string m_buffer;           // used only if a string contains escapes
+    std::string m_containers;       // '{' or '[' for each level
+    bool m_expectKey{false};
+    Glib::ustring m_error;
+};
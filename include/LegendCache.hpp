@@ -0,0 +1,75 @@
+/* -*- Mode: c++; c-basic-offset: 4; tab-width: 4; coding: utf-8; -*-  */
+/*
+ * Copyright (C) 2023 RPf
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <gtkmm.h>
+#include <map>
+#include <deque>
+#include <memory>
+
+/**
+ * keeps legends on disk and in memory.
+ *   As many layers share a legend behind different urls,
+ *   the layout is content addressed (like TileStore):
+ *     objects/<sha256 of image>.img  the image as received
+ *     keys/<sha256 of url>           contains the content hash
+ *   and a decoded legend is shared by all urls with the same content.
+ */
+class LegendCache
+{
+public:
+    LegendCache(const std::string& dir, gint64 maxAgeSec = DEFAULT_MAX_AGE_SEC);
+    explicit LegendCache(const LegendCache& orig) = delete;
+    virtual ~LegendCache() = default;
+
+    // uses the user cache dir
+    static std::shared_ptr<LegendCache> create_default();
+
+    // the legend for url, empty if unknown (or older than max age)
+    Glib::RefPtr<Gdk::Pixbuf> lookup(const Glib::ustring& url);
+    // decode (if the content is not known yet) and keep, empty if not decodable
+    Glib::RefPtr<Gdk::Pixbuf> store(const Glib::ustring& url, const guint8* data, gsize size);
+    // count of distinct legends in memory
+    size_t get_size() {
+        return m_pixbufs.size();
+    }
+    // limit the decoded legends kept in memory, the oldest are dropped (and read again from disk when needed)
+    void set_max_bytes(gsize maxBytes);
+    gsize get_bytes() {
+        return m_bytes;
+    }
+
+    static constexpr auto DEFAULT_MAX_AGE_SEC{7 * 24 * 60 * 60};
+    static constexpr auto DEFAULT_MAX_BYTES{16u * 1024u * 1024u};
+protected:
+    std::string object_path(const std::string& contentHash);
+    std::string key_path(const Glib::ustring& url);
+    Glib::RefPtr<Gdk::Pixbuf> decode(const guint8* data, gsize size);
+    void keep(const std::string& contentHash, const Glib::RefPtr<Gdk::Pixbuf>& pixbuf);
+    void limit();
+private:
+    std::string m_dir;
+    gint64 m_maxAgeSec;
+    std::map<Glib::ustring, std::string> m_urlHashes;                  // content hash by url
+    std::map<std::string, Glib::RefPtr<Gdk::Pixbuf>> m_pixbufs;        // decoded by content hash
+    std::deque<std::string> m_order;    // content hashes as decoded, oldest first
+    gsize m_bytes{0};
+    gsize m_maxBytes{DEFAULT_MAX_BYTES};
+};
@@ -0,0 +1,102 @@
+/* -*- Mode: c++; c-basic-offset: 4; tab-width: 4; coding: utf-8; -*-  */
+/*
+ * Copyright (C) 2023 RPf
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glibmm.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+// appends values in a compact binary form (host byte order, the catalog is local)
+class CatalogWriter
+{
+public:
+    CatalogWriter() = default;
+    explicit CatalogWriter(const CatalogWriter& orig) = delete;
+    virtual ~CatalogWriter() = default;
+
+    void put_u32(guint32 value);
+    void put_i64(gint64 value);
+    void put_double(double value);
+    void put_string(const Glib::ustring& value);
+    void put_strings(const std::vector<Glib::ustring>& values);
+    const std::string& get_data() const {
+        return m_data;
+    }
+private:
+    void put(const void* data, gsize len);
+
+    std::string m_data;
+};
+
+// reads the values in the order written,
+//   on any shortage the reader becomes invalid and returns defaults
+class CatalogReader
+{
+public:
+    CatalogReader(std::string&& data);
+    explicit CatalogReader(const CatalogReader& orig) = delete;
+    virtual ~CatalogReader() = default;
+
+    guint32 get_u32();
+    gint64 get_i64();
+    double get_double();
+    Glib::ustring get_string();
+    std::vector<Glib::ustring> get_strings();
+    bool is_valid() const {
+        return m_valid;
+    }
+private:
+    bool get(void* data, gsize len);
+
+    std::string m_data;
+    gsize m_offset{0};
+    bool m_valid{true};
+};
+
+/**
+ * keeps the product lists of services on disk,
+ *   so on start products are available without waiting for capabilities.
+ *   Layout: <dir>/<sha256 of service>.cat
+ *     the content is defined by Weather (header) and the products.
+ */
+class ProductCatalog
+{
+public:
+    ProductCatalog(const std::string& dir);
+    explicit ProductCatalog(const ProductCatalog& orig) = delete;
+    virtual ~ProductCatalog() = default;
+
+    // uses the user cache dir
+    static std::shared_ptr<ProductCatalog> create_default();
+
+    // nullptr if there is no catalog for service
+    std::shared_ptr<CatalogReader> load(const Glib::ustring& serviceId);
+    void save(const Glib::ustring& serviceId, const CatalogWriter& writer);
+    // the catalog was confirmed by service, the saved time is updated
+    void touch(const Glib::ustring& serviceId, gint64 savedSec);
+
+    static constexpr auto MAGIC{0x43504447u};   // "GDPC"
+    static constexpr auto VERSION{4u};      // 2 realearth times as epoch, 3 wms layers as text, 4 wms search fields
+    static constexpr auto SAVED_OFFSET{2 * sizeof(guint32)};   // saved time follows magic, version
+protected:
+    std::string catalog_path(const Glib::ustring& serviceId);
+private:
+    std::string m_dir;
+};
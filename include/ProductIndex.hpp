@@ -0,0 +1,98 @@
+/* -*- Mode: c++; c-basic-offset: 4; tab-width: 4; coding: utf-8; -*-  */
+/*
+ * Copyright (C) 2023 RPf
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glibmm.h>
+#include <memory>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "GeoCoordinate.hpp"
+
+class Weather;
+class WeatherProduct;
+
+// what to look for, empty text matches all (that pass the filters)
+struct ProductQuery
+{
+    Glib::ustring text;         // words, the last one may be incomplete
+    CoordRefSystem crs;         // None for any
+    bool timeEnabled{false};    // only products with time dimension
+    bool useBounds{false};      // only products intersecting bounds
+    GeoBounds bounds;           // in CRS:84
+    size_t limit{50};
+};
+
+struct ProductMatch
+{
+    std::shared_ptr<WeatherProduct> product;
+    Glib::ustring serviceId;
+    double score;
+};
+
+/**
+ * inverted index over the products of some services,
+ *   the words of id, name, keywords and description are kept with
+ *   a weight for the field they were found in.
+ *   Update a service when its products were completed.
+ */
+class ProductIndex
+{
+public:
+    ProductIndex() = default;
+    explicit ProductIndex(const ProductIndex& orig) = delete;
+    virtual ~ProductIndex() = default;
+
+    // (re-)index the products of weather
+    void update(Weather& weather);
+    void remove(const Glib::ustring& serviceId);
+    // ranked by score, best first
+    std::vector<ProductMatch> search(const ProductQuery& query);
+    size_t get_size() {
+        return m_docs.size();
+    }
+    // lowercase words
+    static std::vector<std::string> tokenize(const Glib::ustring& text);
+
+    static constexpr auto WEIGHT_ID{3.0f};
+    static constexpr auto WEIGHT_NAME{4.0f};
+    static constexpr auto WEIGHT_KEYWORD{2.0f};
+    static constexpr auto WEIGHT_DESCRIPTION{1.0f};
+protected:
+    struct Doc {
+        std::shared_ptr<WeatherProduct> product;
+        Glib::ustring serviceId;
+        CoordRefSystem crs;
+        bool timeEnabled;
+        bool hasBounds;
+        double west, south, east, north;    // CRS:84
+    };
+    struct Posting {
+        guint32 doc;
+        float weight;
+    };
+    void add(Doc&& doc);
+    void add_field(guint32 docId, const Glib::ustring& text, float weight);
+    void rebuild();
+    bool is_accepted(const Doc& doc, const ProductQuery& query);
+private:
+    std::vector<Doc> m_docs;
+    std::map<std::string, std::vector<Posting>> m_postings;    // ordered for prefix lookup
+};
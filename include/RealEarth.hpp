@@ -21,8 +21,10 @@
 #include <memory>
 #include <json-glib/json-glib.h>
 #include <vector>
+#include <deque>
 
 #include "Weather.hpp"
+#include "JsonPullParser.hpp"
 
 class RealEarth;
 class RealEarthProduct;
@@ -38,9 +40,11 @@ public:
     RealEarth* get_weather() {
         return m_realEarth;
     }
-    int get_pixX();
-    int get_pixY();
+    int get_pixX() override;
+    int get_pixY() override;
     void mapping(Glib::RefPtr<Gdk::Pixbuf> pix, Glib::RefPtr<Gdk::Pixbuf>& weather) override;
+    // the pixels the extent offers for span degrees
+    static int native_pixels(double span, double extentSpan, int extentPixels);
 protected:
     void build_url(std::shared_ptr<RealEarthProduct>& product);
 private:
@@ -55,12 +59,44 @@ private:
     int m_pixHeight;
 };
 
+// a web mercator tile z/x/y, the url only depends on the grid
+//   so responses can be cached by any party
+class RealEarthTileRequest
+: public WeatherImageRequest
+{
+public:
+    // target the area in CRS:84 covered by the pixels
+    RealEarthTileRequest(RealEarth* weather, int zoom, int tileX, int tileY
+            , const GeoBounds& target, int pixX, int pixY, int pixWidth, int pixHeight
+            , std::shared_ptr<RealEarthProduct>& product);
+    virtual ~RealEarthTileRequest() = default;
+    int get_pixX() override {
+        return m_pixX;
+    }
+    int get_pixY() override {
+        return m_pixY;
+    }
+    void mapping(Glib::RefPtr<Gdk::Pixbuf> pix, Glib::RefPtr<Gdk::Pixbuf>& weather) override;
+    // the bounds of the tile in EPSG:3857
+    static GeoBounds tile_bounds(int zoom, int tileX, int tileY);
+private:
+    GeoBounds m_source;
+    GeoBounds m_target;
+    int m_pixX;
+    int m_pixY;
+    int m_pixWidth;
+    int m_pixHeight;
+};
 
 class RealEarthProduct
 : public WeatherProduct
 {
 public:
     RealEarthProduct(JsonObject* obj);
+    // read the members of a object from parser (after BeginObject)
+    RealEarthProduct(JsonPullParser& parser);
+    // used to read from catalog
+    RealEarthProduct() = default;
     virtual ~RealEarthProduct() = default;
 
     Glib::ustring get_dataid() {
@@ -69,10 +105,15 @@ public:
     Glib::ustring get_description() override {
         return m_description;
     }
-    std::vector<Glib::ustring> get_times()
+    // the known times (utc epoch seconds) sorted, oldest first, e.g. for prefetching steps
+    const std::deque<gint64>& get_times()
     {
         return m_times;
     }
+    bool get_latest_time(gint64& time);
+    // the time before/after the given, false if there is none
+    bool get_previous_time(gint64 time, gint64& previous);
+    bool get_next_time(gint64 time, gint64& next);
     double get_extend_north() {
         return std::min(m_bounds.getEastNorth().getLatitude(), m_seedlatbound);  // some images report 90 and can't handle it afterwards as it seems
     }
@@ -82,19 +123,44 @@ public:
     double get_seedlatbound() {
         return m_seedlatbound;
     }
+    // set_extent was called
+    bool has_extent() {
+        return m_extent_width > 0;
+    }
     bool is_displayable() override;
     bool is_latest(const Glib::ustring& latest);
     bool latest(Glib::DateTime& datetime) override;
+    // the seconds between the last times, 0 if unknown
+    gint64 get_update_interval();
+    // true if by the observed interval a new time is expected
+    bool is_update_due(const Glib::DateTime& nowUtc);
+    // seconds until the next time is expected, 0 if due or unknown
+    gint64 get_update_due_sec(const Glib::DateTime& nowUtc);
     void set_extent(JsonObject* entry);
     Glib::ustring get_dimension() override;
 
     Glib::RefPtr<Gdk::Pixbuf> get_legend() override;
     void set_legend(Glib::RefPtr<Gdk::Pixbuf>& legend) override;
+    void write(CatalogWriter& writer) override;
+    bool read(CatalogReader& reader) override;
+    bool is_valid() {
+        return m_valid;
+    }
+    // times are given as yyyymmdd.hhmmss
+    static bool parse_time(const Glib::ustring& time, gint64& value);
+    static Glib::ustring format_time(gint64 value);
 
 private:
+    static Glib::ustring to_ustring(std::string_view value);
+    // keeps times sorted, dropping the oldest beyond MAX_TIMES, false if known or not kept
+    bool add_time(gint64 time);
+    void add_time(const Glib::ustring& time);
+
+    static constexpr auto MAX_TIMES{256u};
+    bool m_valid{true};
     Glib::ustring m_dataid; // this is the base e.g. globalir for all ir based images
     Glib::ustring m_description;
-    std::vector<Glib::ustring> m_times;
+    std::deque<gint64> m_times;
     Glib::ustring m_type;       // this is the representation e.g. "raster" for images, "shape" for symbols
     Glib::ustring m_outputtype; // png24 for íamges
     Glib::RefPtr<Gdk::Pixbuf> m_legend;
@@ -106,25 +172,59 @@ class RealEarth
 {
 public:
     RealEarth(WeatherConsumer* consumer, const Glib::ustring& base_url);
-    virtual ~RealEarth() = default;
+    virtual ~RealEarth();
 
     void capabilities() override;
     void request(const Glib::ustring& productId) override;
     Glib::ustring get_base_url() {
         return m_base_url;
     }
+    Glib::ustring get_service_id() override {
+        return m_base_url;
+    }
+    // the product is watched, all watched products are checked with one request
     void check_product(const Glib::ustring& weatherProductId) override;
+    void unwatch_product(const Glib::ustring& weatherProductId) override;
+    gint64 get_next_check_sec(const Glib::ustring& weatherProductId) override;
+    // requests waiting for extents and images in transfer
+    size_t get_pipeline_depth();
+    static constexpr auto MAX_UPDATE_INTERVALS{4};  // the times used to estimate the update interval
     void send(WeatherImageRequest& request, std::shared_ptr<WeatherProduct>& product);
     void inst_on_capabilities_callback(const Glib::ustring& error, int status, SpoonMessageDirect* message);
     Glib::RefPtr<Gdk::Pixbuf> get_legend(std::shared_ptr<WeatherProduct>& product);
+    // fetch z/x/y tiles instead of images for the quadrants
+    void set_tiled(bool tiled) {
+        m_tiled = tiled;
+    }
+    bool is_tiled() {
+        return m_tiled;
+    }
+    // the zoom giving at least the resolution of imageSize for the world
+    static int tile_zoom(int imageSize);
+    static constexpr auto TILE_SIZE{256};
+    static constexpr auto MAX_TILE_ZOOM{8};
 
 protected:
     void inst_on_latest_callback(const Glib::ustring& error, int status, SpoonMessageDirect* message);
-    void inst_on_extend_callback(const Glib::ustring& error, int status, SpoonMessageDirect* message);
+    void poll_latest();
+    void inst_on_extend_callback(const Glib::ustring& error, int status, SpoonMessageDirect* message, std::vector<Glib::ustring> productIds);
     void get_extend(std::shared_ptr<RealEarthProduct>& product);
+    void send_extents(const std::vector<Glib::ustring>& productIds);
+    // the extents for productIds were answered (or failed), continue waiting requests
+    void extents_done(const std::vector<Glib::ustring>& productIds);
+    // query the extents for all displayable products, so requests need not wait
+    void prefetch_extents();
+    void request_tiles(std::shared_ptr<RealEarthProduct>& product);
+    static constexpr auto EXTENTS_PER_REQUEST{50};   // keep url in reasonable limits
+    std::shared_ptr<WeatherProduct> create_product() override;
 
 private:
     Glib::ustring m_base_url;
-    Glib::ustring queued_product_request;
+    std::set<Glib::ustring> m_pendingRequests;  // products waiting for extent
+    std::set<Glib::ustring> m_extentRequested;  // products with extent query in transfer
+    std::set<Glib::ustring> m_watched;
+    std::set<Glib::ustring> m_checkRequested;   // checked explicitly since last poll
+    sigc::connection m_pollConnection;
+    bool m_tiled{false};
 };
 
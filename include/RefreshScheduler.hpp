@@ -0,0 +1,82 @@
+/* -*- Mode: c++; c-basic-offset: 4; tab-width: 4; coding: utf-8; -*-  */
+/*
+ * Copyright (C) 2023 RPf
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glibmm.h>
+#include <list>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+class Weather;
+
+/**
+ * checks watched products when the service is expected to
+ *   have an update (as told by Weather::get_next_check_sec).
+ *   The products are kept in a timer wheel, so a tick only
+ *   looks at the products of one slot, and a product is checked once when due.
+ *   Products not displayed back off, doubling the delay up to MAX_BACKOFF.
+ *   The services must outlive the scheduler or be unwatched.
+ */
+class RefreshScheduler
+{
+public:
+    RefreshScheduler(guint tickSec = TICK_SEC);
+    explicit RefreshScheduler(const RefreshScheduler& orig) = delete;
+    virtual ~RefreshScheduler();
+
+    void watch(Weather* service, const Glib::ustring& productId, bool displayed = true);
+    void unwatch(Weather* service, const Glib::ustring& productId);
+    // a displayed product is checked when due, others back off
+    void set_displayed(Weather* service, const Glib::ustring& productId, bool displayed);
+    size_t get_size() {
+        return m_entries.size();
+    }
+    // count of checks done, for monitoring
+    guint64 get_checks() {
+        return m_checks;
+    }
+
+    static constexpr auto TICK_SEC{10u};
+    static constexpr auto WHEEL_SLOTS{360u};    // one hour with default tick, longer delays use rounds
+    static constexpr auto MAX_BACKOFF{3u};      // up to 8 times the delay
+protected:
+    struct Entry {
+        Weather* service;
+        Glib::ustring productId;
+        bool displayed;
+        guint backoff;
+        guint rounds;
+        size_t slot;
+    };
+    using type_slot_list = std::list<Entry>;
+    static std::string key(Weather* service, const Glib::ustring& productId);
+    void schedule(Entry&& entry, gint64 delaySec);
+    void remove(const std::string& key);
+    bool on_tick();
+private:
+    guint m_tickSec;
+    std::vector<type_slot_list> m_wheel;
+    size_t m_cursor{0};
+    std::unordered_map<std::string, type_slot_list::iterator> m_entries;
+    sigc::connection m_timer;
+    guint64 m_checks{0};
+    std::set<std::string> m_checking;   // keys due in the current tick
+    std::set<std::string> m_unwatched;  // of these, unwatched while checking
+};
@@ -0,0 +1,75 @@
+/* -*- Mode: c++; c-basic-offset: 4; tab-width: 4; coding: utf-8; -*-  */
+/*
+ * Copyright (C) 2023 RPf
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gtkmm.h>
+#include <memory>
+#include <vector>
+
+#include "GeoCoordinate.hpp"
+
+/**
+ * maps a image in any of the supported coordinate systems
+ *   into the linear (equirectangular) target we use.
+ *   For each target row/column the source index is computed once,
+ *   so the actual mapping is just copying.
+ *   As the geometry of requests repeats (same quadrants on each refresh)
+ *   use create to reuse the tables.
+ */
+class Reprojection
+{
+public:
+    // source bounds in source crs, target bounds in CRS:84 (the target is always linear)
+    Reprojection(const GeoBounds& source, int srcWidth, int srcHeight
+               , const GeoBounds& target, int tgtWidth, int tgtHeight);
+    explicit Reprojection(const Reprojection& orig) = delete;
+    virtual ~Reprojection() = default;
+
+    static std::shared_ptr<Reprojection> create(const GeoBounds& source, int srcWidth, int srcHeight
+               , const GeoBounds& target, int tgtWidth, int tgtHeight);
+    // map src into target at pixX, pixY, the src is expected to match srcWidth, srcHeight
+    void map(const Glib::RefPtr<Gdk::Pixbuf>& src, Glib::RefPtr<Gdk::Pixbuf>& target, int pixX, int pixY);
+    // the index into source for each target row/column, -1 for no data
+    const std::vector<int>& get_rows() {
+        return m_rows;
+    }
+    const std::vector<int>& get_columns() {
+        return m_columns;
+    }
+    static constexpr auto MIN_STRIP_ROWS{64};
+    static constexpr auto MAX_CACHED{64};
+protected:
+    struct PixelArea {
+        guint8* pixels;     // first pixel of area
+        int rowstride;
+        int channels;
+        int width;
+    };
+    void build_tables(const GeoBounds& source, const GeoBounds& target);
+    void map_rows(const PixelArea& src, const PixelArea& target, int startRow, int endRow);
+    static int index(double value, double start, double end, int size);
+private:
+    int m_srcWidth;
+    int m_srcHeight;
+    int m_tgtWidth;
+    int m_tgtHeight;
+    std::vector<int> m_rows;
+    std::vector<int> m_columns;
+    bool m_identityColumns{false};
+};
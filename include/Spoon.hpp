@@ -40,7 +40,8 @@ class SpoonMessage;
 class SpoonSession
 {
 public:
-    SpoonSession(const Glib::ustring& user_agent);
+    // maxConnsPerHost, maxConns 0 keeps the soup default
+    SpoonSession(const Glib::ustring& user_agent, int maxConnsPerHost = 0, int maxConns = 0);
     virtual ~SpoonSession();
 
     void send(std::shared_ptr<SpoonMessage> msg);
@@ -48,6 +49,12 @@ public:
     SoupSession *get_session() {
         return m_session;
     }
+    // messages in transfer
+    size_t get_pending() {
+        return m_requests.size();
+    }
+    static constexpr auto SOUP_MAX_CONNS_PER_HOST{2};    // the soup defaults
+    static constexpr auto SOUP_MAX_CONNS{10};
 private:
     SoupSession *m_session;
     std::list<std::shared_ptr<SpoonMessage>> m_requests;
@@ -60,6 +67,10 @@ public:
     SpoonMessage(const SpoonMessage& msg) = default;
     virtual ~SpoonMessage() = default;
     void addQuery(const Glib::ustring& name, const Glib::ustring& value);
+    // added to request
+    void addHeader(const Glib::ustring& name, const Glib::ustring& value);
+    // available with response, empty if not sent
+    Glib::ustring get_response_header(const Glib::ustring& name);
     Glib::ustring get_url();
     void set_spoon_session(SpoonSession* spoonSession) {
         m_spoonSession = spoonSession;
@@ -72,17 +83,22 @@ public:
     }
 
     static constexpr const int OK{SOUP_STATUS_OK};
+    static constexpr const int NOT_MODIFIED{SOUP_STATUS_NOT_MODIFIED};
     // Override this if you need a cancelable message (and use the return of SpoonMessage::send)
     GCancellable* get_cancelable();
     virtual void send() = 0;
     static const char* decodeStatus(int status);
 
 protected:
+    SoupMessage* create_message();
+    void set_response_headers(SoupMessage* msg);
     Glib::ustring m_host;
     Glib::ustring m_path;
     SpoonSession* m_spoonSession{nullptr};
 private:
     std::map<Glib::ustring, Glib::ustring> m_query;
+    std::map<Glib::ustring, Glib::ustring> m_headers;
+    std::map<Glib::ustring, Glib::ustring> m_responseHeaders;  // keys lowercase
 };
 
 // a message for which the content is passed in memory
@@ -0,0 +1,125 @@
+/* -*- Mode: c++; c-basic-offset: 4; tab-width: 4; coding: utf-8; -*-  */
+/*
+ * Copyright (C) 2023 RPf
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gtkmm.h>
+#include <memory>
+#include <vector>
+#include <set>
+
+#include "GeoCoordinate.hpp"
+
+// identifies a tile as requested from a service
+//   (the time is essential, without we can't tell if the content is still valid)
+class TileKey
+{
+public:
+    TileKey() = default;
+    TileKey(const Glib::ustring& service, const Glib::ustring& productId, const Glib::ustring& time
+            , const GeoBounds& bounds, int width, int height);
+    TileKey(const TileKey& orig) = default;
+    virtual ~TileKey() = default;
+
+    Glib::ustring get_service() const {
+        return m_service;
+    }
+    Glib::ustring get_product_id() const {
+        return m_productId;
+    }
+    Glib::ustring get_time() const {
+        return m_time;
+    }
+    // if false the tile may only be used as placeholder
+    bool is_cacheable() const {
+        return !m_time.empty();
+    }
+    // the canonical form, all parts contribute
+    Glib::ustring to_string() const;
+    // identifies the place of the tile, independent of time
+    Glib::ustring slot() const;
+    std::string hash() const;
+private:
+    Glib::ustring m_service;
+    Glib::ustring m_productId;
+    Glib::ustring m_time;
+    GeoBounds m_bounds;
+    int m_width{0};
+    int m_height{0};
+};
+
+// a tile as placed in the last composite of a product
+struct TilePlacement
+{
+    std::string keyHash;
+    int pixX;
+    int pixY;
+};
+
+/**
+ * keeps remapped tiles on disk, so we don't need to fetch&map a tile twice.
+ *   The layout is content addressed:
+ *     objects/<sha256 of pixels>.raw  the rows as used by pixbuf prefixed by a fixed header,
+ *                                      so we can map the file and use it directly
+ *     keys/<sha256 of key>            contains the content hash, so identical
+ *                                      tiles (e.g. static layers) share one object
+ *     last/<sha256 of product>.ini    the tiles that made the last composite
+ */
+class TileStore
+{
+public:
+    TileStore(const std::string& dir);
+    explicit TileStore(const TileStore& orig) = delete;
+    virtual ~TileStore() = default;
+
+    // uses the user cache dir
+    static std::shared_ptr<TileStore> create_default();
+
+    Glib::RefPtr<Gdk::Pixbuf> lookup(const TileKey& key);
+    Glib::RefPtr<Gdk::Pixbuf> lookup_hash(const std::string& keyHash);
+    // store the area x,y,width,height of the mapped pix (with size as overall size of the composite)
+    void store(const TileKey& key, int size, const Glib::RefPtr<Gdk::Pixbuf>& pix, int x, int y, int width, int height);
+    // the tiles for the last composite of the given product and size, empty if unknown
+    std::vector<TilePlacement> get_last(const Glib::ustring& service, const Glib::ustring& productId, int size);
+    // remove entries stored before now - maxAgeSec, and objects no longer referenced
+    void prune(gint64 maxAgeSec);
+    // remove the least recently stored entries until the objects use at most maxBytes
+    void prune_size(gint64 maxBytes);
+    static std::string sha256(const void* data, gsize len);
+
+    static constexpr auto MAGIC{0x4c544447u};   // "GDTL"
+    static constexpr auto VERSION{1u};
+    // fixed size header, keeps the rows aligned for mapping
+    struct Header {
+        guint32 magic;
+        guint32 version;
+        gint32 width;
+        gint32 height;
+        gint32 n_channels;
+        gint32 rowstride;
+        guint32 reserved[2];
+    };
+protected:
+    std::string object_path(const std::string& contentHash);
+    std::string key_path(const std::string& keyHash);
+    std::string last_path(const Glib::ustring& service, const Glib::ustring& productId);
+    void set_last(const TileKey& key, const std::string& keyHash, int x, int y, int size);
+    void remove_unreferenced(const std::set<std::string>& referenced);
+private:
+    std::string m_dir;
+};
@@ -0,0 +1,83 @@
+/* -*- Mode: c++; c-basic-offset: 4; tab-width: 4; coding: utf-8; -*-  */
+/*
+ * Copyright (C) 2023 RPf
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <glibmm.h>
+#include <vector>
+
+/**
+ * the times announced by a wms dimension, parsed once into epoch seconds.
+ *   Intervals (start/end/period) are kept as such, discrete values are sorted,
+ *   and runs of evenly spaced values are joined into intervals.
+ *   So a lookup is a binary search over the segments
+ *   and a computation within the segment.
+ */
+class TimeDimension
+{
+public:
+    TimeDimension() = default;
+    explicit TimeDimension(const TimeDimension& orig) = default;
+    virtual ~TimeDimension() = default;
+
+    // accepts "start/end/period", "t1,t2,..." or a mix of both
+    bool parse(const Glib::ustring& dimension);
+    void clear();
+    bool empty() const {
+        return m_segments.empty();
+    }
+    gint64 get_start() const;
+    gint64 get_end() const;
+    // number of discrete times
+    gint64 get_count() const;
+    // the spacing of the last times, 0 if unknown
+    gint64 get_last_period() const;
+    // the latest time <= limit
+    bool find_latest(gint64 limit, gint64& value) const;
+    // the time closest to time
+    bool find_nearest(gint64 time, gint64& value) const;
+    // the times within from..to (inclusive) e.g. for animation, at most max values
+    std::vector<gint64> get_values(gint64 from, gint64 to, size_t max = MAX_VALUES) const;
+    // assume the service has a time past the end (when not reported yet)
+    void extend(gint64 time);
+
+    static bool parse_time(const Glib::ustring& iso8601, gint64& value);
+    static Glib::DateTime to_date_time(gint64 value);
+    // seconds of a ISO 8601 period, month and year are estimated, 0 if not parsed
+    static int parse_period(const Glib::ustring& period);
+
+    static constexpr auto MAX_VALUES{1024u};
+    static constexpr auto SECS_PER_MINUTE{60};
+    static constexpr auto SECS_PER_HOUR{60 * SECS_PER_MINUTE};
+    static constexpr auto SECS_PER_DAY{24 * SECS_PER_HOUR};
+    static constexpr auto SECS_PER_MONTH{30 * SECS_PER_DAY};
+    static constexpr auto SECS_PRE_YEAR{364 * SECS_PER_DAY};
+protected:
+    struct Segment {
+        gint64 start;
+        gint64 end;
+        gint64 period;  // 0 for a single value
+    };
+    void add_values(std::vector<gint64>& values);
+    // the segment containing or preceding time, end() if time is before start
+    std::vector<Segment>::const_iterator find_segment(gint64 time) const;
+    static gint64 floor_value(const Segment& segment, gint64 time);
+private:
+    std::vector<Segment> m_segments;
+};
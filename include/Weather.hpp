@@ -23,10 +23,16 @@
 #include <memory>
 #include <json-glib/json-glib.h>
 #include <vector>
+#include <set>
+#include <unordered_map>
+#include <deque>
 #include <Log.hpp>
 
 #include "Spoon.hpp"
 #include "GeoCoordinate.hpp"
+#include "TileStore.hpp"
+#include "ProductCatalog.hpp"
+#include "LegendCache.hpp"
 
 #undef WEATHER_DEBUG
 
@@ -91,12 +97,35 @@ public:
     {
         m_viewCurrentTime = viewCurrentTime;
     }
+    // limit the size of a single image request,
+    //   smaller tiles give earlier results but need more requests,
+    //   0 splits the image into quadrants (the server limits apply anyway)
+    int getTileSize() const
+    {
+        return m_tileSize;
+    }
+    void setTileSize(int tileSize)
+    {
+        m_tileSize = tileSize;
+    }
+    // request tiles of a fixed global grid (cells of 360/2^n degree),
+    //   so the urls don't depend on the product extent and caches may hit
+    bool isGridAligned() const
+    {
+        return m_gridAligned;
+    }
+    void setGridAligned(bool gridAligned)
+    {
+        m_gridAligned = gridAligned;
+    }
 private:
     Glib::ustring m_name;
     Glib::ustring m_address;
     int m_delay_sec;
     Glib::ustring m_type;
     bool m_viewCurrentTime;
+    int m_tileSize{0};
+    bool m_gridAligned{false};
 };
 
 class WeatherImageRequest;
@@ -119,10 +148,82 @@ class WeatherImageRequest
 public:
     WeatherImageRequest(const Glib::ustring& host, const Glib::ustring& path);
     virtual ~WeatherImageRequest() = default;
-    Glib::RefPtr<Gdk::Pixbuf> get_pixbuf();
+    // decodes the response, may be used once
+    virtual Glib::RefPtr<Gdk::Pixbuf> get_pixbuf();
+    // read the response into memory (as long as the stream is available)
+    bool read_body();
+    Glib::ustring get_body_hash();
     virtual void mapping(Glib::RefPtr<Gdk::Pixbuf> pix, Glib::RefPtr<Gdk::Pixbuf>& weather) = 0;
+    // position within the composite
+    virtual int get_pixX() = 0;
+    virtual int get_pixY() = 0;
+    const TileKey& get_tile_key() {
+        return m_tileKey;
+    }
+    void set_tile_key(const TileKey& tileKey) {
+        m_tileKey = tileKey;
+    }
+    // if set the mapped result will be kept (size is the overall size of the composite)
+    void set_tile_store(const std::shared_ptr<TileStore>& tileStore, int size);
+    // a refresh may be skipped if the content didn't change
+    bool is_refresh() {
+        return m_refresh;
+    }
+    void set_refresh(bool refresh) {
+        m_refresh = refresh;
+    }
 protected:
+    // call after mapping to keep the result
+    void store_mapped(Glib::RefPtr<Gdk::Pixbuf>& weather_pix, int x, int y, int width, int height);
+private:
+    TileKey m_tileKey;
+    std::shared_ptr<TileStore> m_tileStore;
+    int m_compositeSize{0};
+    std::vector<guint8> m_body;
+    bool m_bodyRead{false};
+    bool m_refresh{false};
+};
+
+// a request that is served from the tile store, the pixbuf is already mapped
+class TileStoreImageRequest
+: public WeatherImageRequest
+{
+public:
+    TileStoreImageRequest(const Glib::RefPtr<Gdk::Pixbuf>& pix, int pixX, int pixY);
+    virtual ~TileStoreImageRequest() = default;
+    Glib::RefPtr<Gdk::Pixbuf> get_pixbuf() override;
+    void mapping(Glib::RefPtr<Gdk::Pixbuf> pix, Glib::RefPtr<Gdk::Pixbuf>& weather) override;
+    int get_pixX() override {
+        return m_pixX;
+    }
+    int get_pixY() override {
+        return m_pixY;
+    }
+private:
+    Glib::RefPtr<Gdk::Pixbuf> m_pix;
+    int m_pixX;
+    int m_pixY;
+};
+
+// interned product ids, the handle for an id stays the same for the lifetime of the table
+class ProductIds
+{
+public:
+    ProductIds() = default;
+    explicit ProductIds(const ProductIds& orig) = delete;
+    virtual ~ProductIds() = default;
+
+    guint32 intern(const Glib::ustring& id);
+    bool find(const Glib::ustring& id, guint32& handle) const;
+    const Glib::ustring& get_id(guint32 handle) const {
+        return m_ids[handle];
+    }
+    size_t get_size() const {
+        return m_ids.size();
+    }
 private:
+    std::unordered_map<std::string, guint32> m_handles;    // compared by bytes, no need for utf-8
+    std::vector<Glib::ustring> m_ids;
 };
 
 class WeatherProduct
@@ -133,6 +234,14 @@ public:
 
     Glib::ustring get_id();
     Glib::ustring get_name();
+    // set when added to a service, allows lookup without the id
+    guint32 get_handle() {
+        return m_handle;
+    }
+    void set_handle(guint32 handle) {
+        m_handle = handle;
+    }
+    static constexpr auto NO_HANDLE{G_MAXUINT32};
 
     virtual Glib::RefPtr<Gdk::Pixbuf> get_legend() = 0;
     virtual Glib::ustring get_description() = 0;
@@ -140,6 +249,10 @@ public:
     virtual bool is_displayable() = 0;
     virtual void set_legend(Glib::RefPtr<Gdk::Pixbuf>& pixbuf) = 0;
     virtual Glib::ustring get_dimension() = 0;
+    // words describing the product, space separated
+    virtual Glib::ustring get_keywords() {
+        return Glib::ustring();
+    }
 
     int get_extent_width() {
         return m_extent_width;
@@ -156,6 +269,16 @@ public:
     GeoBounds getBounds() {
         return m_bounds;
     }
+    // keep the product in catalog, overrides shoud call these first
+    virtual void write(CatalogWriter& writer);
+    virtual bool read(CatalogReader& reader);
+    // take the values of other (as parsed on refresh), the object stays valid
+    //   and keeps legend&extent, true if something changed
+    bool update(WeatherProduct& other);
+    // true if other has the same values, by default compared as kept in catalog
+    virtual bool is_same(WeatherProduct& other);
+    // copy the values of other (of the same type)
+    virtual void take(WeatherProduct& other);
 
     static constexpr auto MAX_MERCATOR_LAT{85.0};   // beyond this simple/web-mercator mapping isn't useful
     using type_signal_legend = sigc::signal<void(Glib::RefPtr<Gdk::Pixbuf>)>;
@@ -171,41 +294,149 @@ protected:
     double m_seedlatbound = MAX_MERCATOR_LAT; // e.g. 85 for images limited to latitude north/south
 
 private:
+    guint32 m_handle{NO_HANDLE};
 };
 
 
+// the product ids affected by a refresh of capabilities
+struct WeatherProductChanges
+{
+    std::vector<Glib::ustring> added;
+    std::vector<Glib::ustring> removed;
+    std::vector<Glib::ustring> changed;
+    bool empty() const {
+        return added.empty() && removed.empty() && changed.empty();
+    }
+};
+
 // used to implement a single weather service
 class Weather
 : public WeatherLog
 {
 public:
     Weather(WeatherConsumer* consumer);
-    virtual ~Weather() = default;
+    virtual ~Weather();
     WeatherConsumer* get_consumer();
 
     virtual void check_product(const Glib::ustring& weatherProductId) = 0;
+    // seconds until an update for product is expected (used for scheduling)
+    virtual gint64 get_next_check_sec(const Glib::ustring& weatherProductId) {
+        return DEFAULT_CHECK_SEC;
+    }
+    static constexpr auto DEFAULT_CHECK_SEC{15 * 60};
+    static constexpr auto MIN_CHECK_SEC{60};    // if the update is overdue
+    // the product is no longer checked (not displayed or removed)
+    virtual void unwatch_product(const Glib::ustring& weatherProductId) {
+    }
     virtual void capabilities() = 0;
     virtual void request(const Glib::ustring& productId) = 0;
     virtual Glib::RefPtr<Gdk::Pixbuf> get_legend(std::shared_ptr<WeatherProduct>& product) = 0;
+    // identifies the service e.g. for keeping tiles
+    virtual Glib::ustring get_service_id() = 0;
     void inst_on_image_callback(const Glib::ustring& error, int status, SpoonMessageStream* message);
-    void inst_on_legend_callback(const Glib::ustring& error, int status, SpoonMessageDirect* message, std::shared_ptr<WeatherProduct> product);
-    std::vector<std::shared_ptr<WeatherProduct>> get_products();
+    void inst_on_legend_callback(const Glib::ustring& error, int status, SpoonMessageDirect* message);
+    // sorted by id, without copy, only valid until the products change
+    const std::vector<std::shared_ptr<WeatherProduct>>& get_products() {
+        return m_products;
+    }
     std::shared_ptr<WeatherProduct> find_product(const Glib::ustring& productId);
+    std::shared_ptr<WeatherProduct> find_product(guint32 handle);
     void add_product(std::shared_ptr<WeatherProduct> product);
+    void remove_product(const Glib::ustring& productId);
     static std::string dump(const guint8 *data, gsize size);
 
     using type_signal_products_completed = sigc::signal<void()>;
     type_signal_products_completed signal_products_completed();
+    // products may become available while capabilities are loading
+    using type_signal_product_added = sigc::signal<void(std::shared_ptr<WeatherProduct>)>;
+    type_signal_product_added signal_product_added();
+    // after capabilities were merged with the known products
+    using type_signal_products_changed = sigc::signal<void(const WeatherProductChanges&)>;
+    type_signal_products_changed signal_products_changed();
     void setLog(const std::shared_ptr<psc::log::Log>& log);
     void logMsg(psc::log::Level level, const Glib::ustring& msg, std::source_location source = std::source_location::current()) override;
+    // enable keeping mapped tiles (on restart the last image is shown while refreshing)
+    void setTileStore(const std::shared_ptr<TileStore>& tileStore);
+    // use a session shared with other services (set before any request)
+    void setSpoonSession(const std::shared_ptr<SpoonSession>& session);
+    static constexpr auto MAX_CONNS_PER_HOST{6};    // allow tiles to be fetched in parallel
+    static constexpr auto MAX_SLOT_HASHES{4096u};   // limits the memory used to detect unchanged images
+    // count of refreshed images that were skipped as unchanged
+    guint64 get_skipped_images();
+    // images requested but not yet received
+    size_t get_pending_images() {
+        return m_pendingImages;
+    }
+    // keep the products on disk for a faster start,
+    //   within ttl the capabilities are not requested
+    void setCatalog(const std::shared_ptr<ProductCatalog>& catalog, gint64 ttlSec = DEFAULT_CATALOG_TTL_SEC);
+    static constexpr auto DEFAULT_CATALOG_TTL_SEC{6 * 60 * 60};
+    // keep legends, with this legends are prefetched after capabilities
+    void setLegendCache(const std::shared_ptr<LegendCache>& legendCache);
+    static constexpr auto LEGEND_PREFETCH_MS{250u};
+    static constexpr auto MAX_LEGEND_PREFETCH{2u};  // legend requests in transfer while prefetching
 protected:
     type_signal_products_completed m_signal_products_completed;
+    type_signal_product_added m_signal_product_added;
+    type_signal_products_changed m_signal_products_changed;
     WeatherConsumer* m_consumer;
-    std::map<Glib::ustring, std::shared_ptr<WeatherProduct>> m_products;
+    std::vector<std::shared_ptr<WeatherProduct>> m_products;
     std::shared_ptr<SpoonSession> getSpoonSession();
+    // serve the request from store if possible, otherwise send it
+    void send_image(const std::shared_ptr<WeatherImageRequest>& request);
+    // show the last known composite for product, only done once
+    void serve_last(const Glib::ustring& productId);
+    // request for an update, unchanged images will not be passed to consumer
+    void refresh(const Glib::ustring& productId);
+    void set_refreshing(const Glib::ustring& productId, bool refreshing);
+    // for a compound id (members separated by ',') true if any member is refreshed
+    bool is_refreshing(const Glib::ustring& productId);
+    // products from catalog (only read on first call), true if recent enough to skip capabilities
+    bool load_catalog();
+    void save_catalog();
+    // ask for changes only if we know a catalog
+    void add_validators(SpoonMessage& message);
+    // check response to capabilities, true if the catalog is still valid
+    bool is_catalog_confirmed(int status, SpoonMessage* message);
+    // a refresh of products starts, products are passed by merge_product,
+    //   with end_products(true) products not seen are removed
+    void begin_products();
+    void merge_product(const std::shared_ptr<WeatherProduct>& product);
+    void end_products(bool complete);
+    // request legend by message for product, identical urls are requested once
+    void send_legend(const std::shared_ptr<SpoonMessageDirect>& message, const std::shared_ptr<WeatherProduct>& product);
+    void prefetch_legends();
+    bool on_prefetch_legends();
+    // an empty product to read from catalog
+    virtual std::shared_ptr<WeatherProduct> create_product() = 0;
+    // service values to keep with catalog
+    virtual void write_catalog_extra(CatalogWriter& writer) {
+    }
+    virtual void read_catalog_extra(CatalogReader& reader) {
+    }
     std::shared_ptr<psc::log::Log> m_log;
+    std::shared_ptr<TileStore> m_tileStore;
 private:
     std::shared_ptr<SpoonSession> spoonSession;
+    std::set<Glib::ustring> m_servedLast;
+    std::set<Glib::ustring> m_refreshing;
+    std::map<Glib::ustring, Glib::ustring> m_slotHashes;   // response hash by tile slot
+    guint64 m_skippedImages{0};
+    size_t m_pendingImages{0};
+    std::shared_ptr<ProductCatalog> m_catalog;
+    gint64 m_catalogTtlSec{DEFAULT_CATALOG_TTL_SEC};
+    gint64 m_catalogSavedSec{0};
+    bool m_catalogLoaded{false};
+    Glib::ustring m_catalogEtag;
+    Glib::ustring m_catalogLastModified;
+    std::shared_ptr<LegendCache> m_legendCache;
+    std::set<Glib::ustring> m_unseenProducts;
+    ProductIds m_productIds;
+    std::vector<std::shared_ptr<WeatherProduct>> m_productsByHandle;   // empty for removed
+    WeatherProductChanges m_productChanges;
+    std::map<Glib::ustring, std::vector<std::shared_ptr<WeatherProduct>>> m_legendRequests;  // waiting products by url
+    std::deque<Glib::ustring> m_legendPrefetch;
+    sigc::connection m_legendPrefetchConnection;
 
 };
 
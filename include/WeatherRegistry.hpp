@@ -0,0 +1,104 @@
+/* -*- Mode: c++; c-basic-offset: 4; tab-width: 4; coding: utf-8; -*-  */
+/*
+ * Copyright (C) 2023 RPf
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <set>
+
+#include "Weather.hpp"
+#include "ProductIndex.hpp"
+#include "RefreshScheduler.hpp"
+
+class WebMapService;
+class RealEarth;
+class WebMapTileService;
+
+// limits that apply to all services together
+struct WeatherBudget
+{
+    int maxConns{16};               // connections for all services (bandwidth)
+    int maxConnsPerHost{Weather::MAX_CONNS_PER_HOST};
+    gint64 tileMaxAgeSec{7 * 24 * 60 * 60};  // stored tiles older than this are removed on start
+    gint64 tileMaxBytes{256 * 1024 * 1024};  // disk used by stored tiles, the oldest are removed on start, 0 unlimited
+    gsize legendMaxBytes{LegendCache::DEFAULT_MAX_BYTES};   // decoded legends kept in memory
+};
+
+/**
+ * owns the configured services, they share one session,
+ *   tile store and catalog, and the products are searchable by
+ *   one index.
+ */
+class WeatherRegistry
+{
+public:
+    WeatherRegistry(WeatherConsumer* consumer, int minPeriodSec, const WeatherBudget& budget = WeatherBudget());
+    explicit WeatherRegistry(const WeatherRegistry& orig) = delete;
+    virtual ~WeatherRegistry();
+
+    std::shared_ptr<WebMapService> add_web_map_service(const std::shared_ptr<WebMapServiceConf>& conf);
+    std::shared_ptr<RealEarth> add_real_earth(const Glib::ustring& baseUrl);
+    std::shared_ptr<WebMapTileService> add_web_map_tile_service(const std::shared_ptr<WebMapServiceConf>& conf);
+    // add a service created otherwise
+    void add(const std::shared_ptr<Weather>& service);
+    // enable tile store, catalog&legends for all services (before adding)
+    void enable_caches(const std::shared_ptr<TileStore>& tileStore, const std::shared_ptr<ProductCatalog>& catalog
+                     , const std::shared_ptr<LegendCache>& legendCache = std::shared_ptr<LegendCache>());
+    // request all capabilities, they are loaded concurrently
+    void capabilities();
+    std::vector<std::shared_ptr<Weather>> get_services() {
+        return m_services;
+    }
+    std::shared_ptr<Weather> find_service(const Glib::ustring& serviceId);
+    std::vector<ProductMatch> search(const ProductQuery& query);
+    ProductIndex& get_index() {
+        return m_index;
+    }
+    std::shared_ptr<SpoonSession> get_session() {
+        return m_session;
+    }
+    // checks the watched products of all services
+    RefreshScheduler& get_scheduler() {
+        return m_scheduler;
+    }
+
+    using type_signal_service_completed = sigc::signal<void(std::shared_ptr<Weather>)>;
+    // the products of service are (again) complete
+    type_signal_service_completed signal_service_completed();
+    using type_signal_completed = sigc::signal<void()>;
+    // all services have products
+    type_signal_completed signal_completed();
+protected:
+    void on_service_completed(std::shared_ptr<Weather> service);
+private:
+    WeatherConsumer* m_consumer;
+    int m_minPeriodSec;
+    WeatherBudget m_budget;
+    std::shared_ptr<SpoonSession> m_session;
+    std::shared_ptr<TileStore> m_tileStore;
+    std::shared_ptr<ProductCatalog> m_catalog;
+    std::shared_ptr<LegendCache> m_legendCache;
+    std::vector<std::shared_ptr<Weather>> m_services;
+    std::vector<sigc::connection> m_completedConnections;
+    std::set<Glib::ustring> m_completed;
+    ProductIndex m_index;
+    RefreshScheduler m_scheduler;   // after services, so it is gone first
+    type_signal_service_completed m_signal_service_completed;
+    type_signal_completed m_signal_completed;
+};
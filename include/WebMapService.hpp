@@ -19,33 +19,104 @@
 #pragma once
 #include <memory>
 #include <stack>
+#include <string_view>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <glibmm.h>
 
 #include "Weather.hpp"
 #include "GeoCoordinate.hpp"
+#include "TimeDimension.hpp"
 
 class WebMapService;
 class WebMapProduct;
+class WebMapCapabilitiesLoader;
+
+/**
+ * the capabilities text as received, kept so product details
+ *   can be parsed when they are needed.
+ *   Appending is done by the loader, while products may already read.
+ */
+class CapabilitiesDocument
+{
+public:
+    CapabilitiesDocument() = default;
+    explicit CapabilitiesDocument(const CapabilitiesDocument& orig) = delete;
+    virtual ~CapabilitiesDocument() = default;
+
+    void append(const char* data, gsize len);
+    // copy of range [start, end)
+    std::string get_range(gsize start, gsize end);
+    // identifies the text of range [start, end)
+    std::string checksum(gsize start, gsize end);
+    // position of the next start tag of element name (e.g. "Layer") starting at from,
+    //   comments, cdata and instructions are skipped, npos if not found
+    gsize find_start_tag(const char* name, gsize from);
+    // position after the end tag matching the start tag at start,
+    //   nested elements of the same name are included, npos if not yet complete
+    gsize find_element_end(const char* name, gsize start);
+private:
+    enum class TagKind {
+        Start,
+        End,
+        Empty,
+        Other
+    };
+    // the markup at the next '<' from, false if none or incomplete, expects lock
+    bool next_markup(gsize from, gsize& start, gsize& end);
+    TagKind tag_kind(const char* name, gsize start, gsize end);
+
+    std::mutex m_mutex;
+    std::string m_text;
+};
+
+// a part of the image to request, with the place it covers in the target
+struct WebMapTile
+{
+    GeoBounds bounds;   // in crs of product
+    int width;          // size to request
+    int height;
+    GeoBounds target;   // in CRS:84 (linear) matching the pixel area
+    int pixX;
+    int pixY;
+    int pixWidth;
+    int pixHeight;
+    // with grid aligned tiles the area outside the product is cleared
+    bool crop{false};
+    int cropX{0};
+    int cropY{0};
+    int cropWidth{0};
+    int cropHeight{0};
+};
 
 class WebMapImageRequest
 : public WeatherImageRequest
 {
 public:
     WebMapImageRequest(WebMapService* webMapService
-        , const GeoBounds& bounds
-        , int pixX, int pixY, int pixWidth, int pixHeight
+        , const WebMapTile& tile
         , std::shared_ptr<WebMapProduct>& product);
+    // the layers are composed by the service in order (the first is at bottom),
+    //   they are expected to share crs&time
+    WebMapImageRequest(WebMapService* webMapService
+        , const WebMapTile& tile
+        , const std::vector<std::shared_ptr<WebMapProduct>>& products);
     virtual ~WebMapImageRequest() = default;
     void mapping(Glib::RefPtr<Gdk::Pixbuf> pix, Glib::RefPtr<Gdk::Pixbuf>& weather_pix);
+    int get_pixX() override {
+        return m_tile.pixX;
+    }
+    int get_pixY() override {
+        return m_tile.pixY;
+    }
+protected:
+    void crop(Glib::RefPtr<Gdk::Pixbuf>& weather_pix);
 
 private:
     WebMapService *m_webMapService;
-    GeoBounds m_bounds;
-    int m_pixX;
-    int m_pixY;
-    int m_pixWidth;
-    int m_pixHeight;
-
+    WebMapTile m_tile;
 };
 
 enum class ParseContext {
@@ -117,7 +188,8 @@ class WebMapProduct
 : public WeatherProduct
 {
 public:
-    WebMapProduct(WebMapService* webMapService);
+    // with indexOnly just the values to identify&display are parsed
+    WebMapProduct(WebMapService* webMapService, bool indexOnly = false);
     virtual ~WebMapProduct() = default;
 
     void start_element(Glib::Markup::ParseContext& context,
@@ -126,7 +198,9 @@ public:
     void end_element(Glib::Markup::ParseContext& context,
         const Glib::ustring& element_name);
     void text(Glib::Markup::ParseContext& context,
-        const Glib::ustring& text);
+        std::string_view text);
+    // false if the text for the current element would be discarded
+    bool is_text_used();
 
     Glib::DateTime getLatestTime();
     Glib::RefPtr<Gdk::Pixbuf> get_legend() override;
@@ -135,28 +209,43 @@ public:
     bool latest(Glib::DateTime& datetime) override;
     bool is_displayable() override;
     Glib::ustring get_dimension() override;
+    Glib::ustring get_keywords() override;
+    int get_period_sec();
     Glib::ustring get_legend_url();
     CoordRefSystem getCoordRefSystem();
     bool is_latest();
+    void write(CatalogWriter& writer) override;
+    bool read(CatalogReader& reader) override;
+    // as kept in catalog
+    static constexpr auto LAYER_DETAILS{0u};
+    static constexpr auto LAYER_TEXT{1u};
+    // compares the layer text if known, so neither needs to be materialized
+    bool is_same(WeatherProduct& other) override;
+    void take(WeatherProduct& other) override;
+    // the layer element within document, used to parse the details on first use
+    void set_layer(const std::shared_ptr<CapabilitiesDocument>& document, gsize start, gsize end);
+    void materialize();
+    bool is_materialized() {
+        return !m_document;
+    }
+    // all announced times e.g. for animation
+    const TimeDimension& get_time_dimension();
 
-
-    static constexpr auto SECS_PER_MINUTE{60};
-    static constexpr auto SECS_PER_HOUR{60 * SECS_PER_MINUTE};
-    static constexpr auto SECS_PER_DAY{24 * SECS_PER_HOUR};
-    static constexpr auto SECS_PER_MONTH{30 * SECS_PER_DAY};
-    static constexpr auto SECS_PRE_YEAR{364 * SECS_PER_DAY};
 protected:
 private:
+    static ParseContext element_context(const Glib::ustring& element_name);
+    static Glib::ustring to_ustring(std::string_view text);
+    void start_bounding_box(const Glib::Markup::Parser::AttributeMap& attributes);
+    void start_online_resource(const Glib::Markup::Parser::AttributeMap& attributes);
     void parseDimension(const Glib::ustring& text);
+    double fromGeographic(const Glib::ustring& text, bool latitude);
     int periodSeconds(const Glib::ustring& timeDimPeriod);
 
     Glib::ustring m_abstract;
     Glib::ustring m_keywords;
     CoordRefSystem m_crs{CoordRefSystem::None};
     Glib::ustring m_attribution;
-    Glib::ustring m_timeDimStart;
-    Glib::ustring m_timeDimEnd;
-    Glib::ustring m_timeDimPeriod;
+    TimeDimension m_timeDimension;
     int m_timePeriodSec;
     ParseContext m_context{ParseContext::None};
     std::stack<ParseContext>  m_parseLevel;
@@ -165,6 +254,11 @@ private:
     Glib::ustring m_LastLegendWidth;
     WebMapService* m_webMapService;
     Glib::ustring m_dimension;
+    bool m_indexOnly;
+    std::shared_ptr<CapabilitiesDocument> m_document;
+    gsize m_layerStart{0};
+    gsize m_layerEnd{0};
+    std::string m_layerChecksum;   // kept after materialize to detect changes
 };
 
 class WebMapService
@@ -172,7 +266,7 @@ class WebMapService
 {
 public:
     WebMapService(WeatherConsumer* consumer, const std::shared_ptr<WebMapServiceConf>& mapServiceConf, int minPeriodSec);
-    virtual ~WebMapService() = default;
+    virtual ~WebMapService();
 
     std::shared_ptr<WebMapServiceConf> getServiceConf()
     {
@@ -182,21 +276,83 @@ public:
     {
         return m_minPeriodSec;
     }
+    Glib::ustring get_service_id() override
+    {
+        return m_mapServiceConf->getAddress();
+    }
+    // limits as announced by capabilities, 0 if not limited
+    void set_max_size(int maxWidth, int maxHeight);
+    int get_max_width()
+    {
+        return m_maxWidth;
+    }
+    int get_max_height()
+    {
+        return m_maxHeight;
+    }
+    // split the image for product, into tiles we may request
+    std::vector<WebMapTile> plan_tiles(const std::shared_ptr<WebMapProduct>& product, int image_size);
+    std::vector<WebMapTile> plan_tiles(const GeoBounds& bounds, int image_size);
+    // request layers that share crs&time with one image per tile,
+    //   the others are requested on their own
+    void request_layers(const std::vector<Glib::ustring>& productIds);
+    // as request_layers, unchanged images will not be passed to consumer
+    void refresh_layers(const std::vector<Glib::ustring>& productIds);
+    // the id used for layers requested as one image
+    static Glib::ustring compound_id(const std::vector<std::shared_ptr<WebMapProduct>>& products);
+    static constexpr auto MAX_GRID_CELLS{64};     // per axis for grid aligned tiles
+    // used by loader to pass results
+    void add_parsed_product(const std::shared_ptr<WebMapProduct>& product);
+    void capabilities_loaded(const Glib::ustring& error);
 protected:
     void capabilities();
-    void inst_on_capabilities_callback(const Glib::ustring& error, int status, SpoonMessageDirect* message);
+    void inst_on_capabilities_callback(const Glib::ustring& error, int status, SpoonMessageStream* message);
     void request(const Glib::ustring& productId) override;
     void check_product(const Glib::ustring& weatherProductId) override;
+    gint64 get_next_check_sec(const Glib::ustring& weatherProductId) override;
     Glib::RefPtr<Gdk::Pixbuf> get_legend(std::shared_ptr<WeatherProduct>& product);
+    std::shared_ptr<WeatherProduct> create_product() override;
+    void write_catalog_extra(CatalogWriter& writer) override;
+    void read_catalog_extra(CatalogReader& reader) override;
     std::shared_ptr<WebMapServiceConf> m_mapServiceConf;
 private:
+    void plan_hemisphere(const GeoBounds& bounds, int image_size, bool north, std::vector<WebMapTile>& tiles);
+    void plan_grid(const GeoBounds& bounds, int image_size, std::vector<WebMapTile>& tiles);
+    void request_compound(const std::vector<std::shared_ptr<WebMapProduct>>& products);
 
     int m_minPeriodSec;
+    int m_maxWidth{0};
+    int m_maxHeight{0};
+    std::shared_ptr<WebMapCapabilitiesLoader> m_capabilitiesLoader;
+};
+
+// parses the details of a single layer for WebMapProduct::materialize
+class WebMapLayerParser : public Glib::Markup::Parser {
+public:
+    WebMapLayerParser(WebMapProduct* webMapProduct);
+    virtual ~WebMapLayerParser() = default;
+protected:
+    void on_start_element(Glib::Markup::ParseContext& context,
+		const Glib::ustring& element_name,
+		const Glib::Markup::Parser::AttributeMap& attributes) override;
+    void on_end_element(Glib::Markup::ParseContext& context,
+		const Glib::ustring& element_name ) override;
+    void on_text(Glib::Markup::ParseContext& context,
+		const Glib::ustring& text) override;
+private:
+    WebMapProduct* m_webMapProduct;
+    int m_layerDepth{0};     // the details of nested layers are not ours
 };
 
+// with a document given only a index of products is parsed,
+//   the document has to be appended before each chunk is parsed.
+//   Products that are not displayable are dropped.
 class NXMLParser : public Glib::Markup::Parser {
 public:
-    NXMLParser(WebMapService* webMapService);
+    using type_slot_product = sigc::slot<void(const std::shared_ptr<WebMapProduct>&)>;
+    using type_slot_limits = sigc::slot<void(int maxWidth, int maxHeight)>;
+    NXMLParser(WebMapService* webMapService, const type_slot_product& productSlot, const type_slot_limits& limitsSlot
+            , const std::shared_ptr<CapabilitiesDocument>& document = std::shared_ptr<CapabilitiesDocument>());
     virtual ~NXMLParser() = default;
 protected:
     void on_start_element(Glib::Markup::ParseContext& context,
@@ -213,5 +369,70 @@ protected:
 private:
     WebMapService *m_webMapService;
     std::shared_ptr<WebMapProduct> m_webMapProduct;
+    Glib::ustring m_serviceElement;     // used outside of layers
+    int m_maxWidth{0};
+    int m_maxHeight{0};
+    type_slot_product m_productSlot;
+    type_slot_limits m_limitsSlot;
+    std::shared_ptr<CapabilitiesDocument> m_document;
+    struct OpenLayer {
+        std::shared_ptr<WebMapProduct> product;     // empty if not used
+        gsize start;                                // position in document
+    };
+    std::vector<OpenLayer> m_layers;    // layers nest, the innermost is last
+    guint m_layerCount{0};      // layer elements seen by parser
+    guint m_scanCount{0};       // layer elements found in document
+    gsize m_scanOffset{0};
+    gsize m_layerStart{0};
+};
+
+/**
+ * the capabilities documents can get some MB so:
+ *   the response is read in chunks on the main loop (as soup wants it),
+ *   and the chunks are parsed in a worker.
+ *   The results are passed back by dispatcher,
+ *   so products become available while loading.
+ */
+class WebMapCapabilitiesLoader
+: public std::enable_shared_from_this<WebMapCapabilitiesLoader>
+{
+public:
+    WebMapCapabilitiesLoader(WebMapService* webMapService);
+    explicit WebMapCapabilitiesLoader(const WebMapCapabilitiesLoader& orig) = delete;
+    virtual ~WebMapCapabilitiesLoader();
+
+    void start(GInputStream* stream);
+    // stop any work and don't use service any more
+    void detach();
+    static constexpr auto CHUNK_SIZE{64u * 1024u};
+protected:
+    static void on_read(GObject* source, GAsyncResult* result, gpointer user_data);
+    void read_next();
+    void push_chunk(std::string&& chunk);
+    void push_end(const Glib::ustring& error);
+    void parse();
+    void on_parsed_product(const std::shared_ptr<WebMapProduct>& product);
+    void on_parsed_limits(int maxWidth, int maxHeight);
+    void on_dispatch();
+    void stop();
+private:
+    WebMapService* m_webMapService;
+    GInputStream* m_stream{nullptr};
+    GCancellable* m_cancellable;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<std::string> m_chunks;
+    bool m_end{false};
+    bool m_stop{false};
+    // results guarded by mutex
+    std::deque<std::shared_ptr<WebMapProduct>> m_products;
+    bool m_limits{false};
+    int m_maxWidth{0};
+    int m_maxHeight{0};
+    bool m_finished{false};
+    bool m_completed{false};
+    Glib::ustring m_error;
+    Glib::Dispatcher m_dispatcher;
 };
 
@@ -0,0 +1,251 @@
+/* -*- Mode: c++; c-basic-offset: 4; tab-width: 4; coding: utf-8; -*-  */
+/*
+ * Copyright (C) 2023 RPf
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <glibmm.h>
+
+#include "Weather.hpp"
+#include "GeoCoordinate.hpp"
+#include "TimeDimension.hpp"
+
+class WebMapTileService;
+class WebMapTileProduct;
+
+// a level of a tile matrix set, values as given by capabilities
+struct WebMapTileMatrix
+{
+    Glib::ustring id;
+    double scaleDenominator{0.0};
+    double topLeftX{0.0};       // in crs units, x is always lon/easting
+    double topLeftY{0.0};
+    int tileWidth{256};
+    int tileHeight{256};
+    int matrixWidth{0};
+    int matrixHeight{0};
+};
+
+struct WebMapTileMatrixSet
+{
+    Glib::ustring id;
+    CoordRefSystem crs{CoordRefSystem::None};
+    std::vector<WebMapTileMatrix> matrices;
+    // the size of a tile in crs units
+    double get_tile_span_x(const WebMapTileMatrix& matrix) const;
+    double get_tile_span_y(const WebMapTileMatrix& matrix) const;
+    // the coarsest matrix that gives at least the resolution of linear units per pixel
+    const WebMapTileMatrix* find_matrix(double linearPerPixel) const;
+    static double meters_per_unit(CoordRefSystem crs);
+    // accepts e.g. "urn:ogc:def:crs:EPSG::4326"
+    static CoordRefSystem parse_crs(const Glib::ustring& supportedCrs);
+    static constexpr auto PIXEL_SIZE_M{0.28e-3};    // the standardized rendering pixel
+};
+
+// a single tile, mapped into the area it covers in the (linear) target
+class WebMapTileRequest
+: public WeatherImageRequest
+{
+public:
+    WebMapTileRequest(WebMapTileService* webMapTileService, const Glib::ustring& url
+        , const GeoBounds& source, int tileWidth, int tileHeight
+        , const GeoBounds& target, int pixX, int pixY, int pixWidth, int pixHeight);
+    virtual ~WebMapTileRequest() = default;
+    void mapping(Glib::RefPtr<Gdk::Pixbuf> pix, Glib::RefPtr<Gdk::Pixbuf>& weather_pix) override;
+    int get_pixX() override {
+        return m_pixX;
+    }
+    int get_pixY() override {
+        return m_pixY;
+    }
+private:
+    GeoBounds m_source;
+    GeoBounds m_target;
+    int m_pixX;
+    int m_pixY;
+    int m_pixWidth;
+    int m_pixHeight;
+};
+
+class WebMapTileProduct
+: public WeatherProduct
+{
+public:
+    WebMapTileProduct(WebMapTileService* webMapTileService);
+    virtual ~WebMapTileProduct() = default;
+
+    Glib::RefPtr<Gdk::Pixbuf> get_legend() override;
+    void set_legend(Glib::RefPtr<Gdk::Pixbuf>& legend) override;
+    Glib::ustring get_description() override {
+        return m_abstract;
+    }
+    bool latest(Glib::DateTime& datetime) override;
+    bool is_displayable() override;
+    Glib::ustring get_dimension() override {
+        return m_dimension;
+    }
+    void write(CatalogWriter& writer) override;
+    bool read(CatalogReader& reader) override;
+
+    // the time to request, false if the layer has no time
+    bool get_latest_time(gint64& time);
+    // false if a newer time is expected
+    bool is_latest();
+    Glib::ustring get_legend_url() {
+        return m_legendUrl;
+    }
+    Glib::ustring get_style() {
+        return m_style;
+    }
+    Glib::ustring get_format() {
+        return m_format;
+    }
+    Glib::ustring get_template() {
+        return m_template;
+    }
+    const std::vector<Glib::ustring>& get_matrix_sets() {
+        return m_matrixSets;
+    }
+    const TimeDimension& get_time_dimension() {
+        return m_timeDimension;
+    }
+
+    // used by parser
+    void set_id(const Glib::ustring& id) {
+        m_id = id;
+    }
+    void set_name(const Glib::ustring& name) {
+        m_name = name;
+    }
+    void set_abstract(const Glib::ustring& abstract) {
+        m_abstract = abstract;
+    }
+    void set_bounds(const GeoBounds& bounds) {
+        m_bounds = bounds;
+    }
+    void set_style(const Glib::ustring& style, const Glib::ustring& legendUrl);
+    void set_format(const Glib::ustring& format);
+    void set_template(const Glib::ustring& format, const Glib::ustring& tmpl);
+    void add_matrix_set(const Glib::ustring& matrixSet) {
+        m_matrixSets.push_back(matrixSet);
+    }
+    void set_dimension(const Glib::ustring& dimension);
+private:
+    WebMapTileService* m_webMapTileService;
+    Glib::ustring m_abstract;
+    Glib::ustring m_style;
+    Glib::ustring m_legendUrl;
+    Glib::ustring m_format;
+    Glib::ustring m_template;
+    std::vector<Glib::ustring> m_matrixSets;
+    Glib::ustring m_dimension;   // the time values comma separated
+    TimeDimension m_timeDimension;
+    Glib::RefPtr<Gdk::Pixbuf> m_legend;
+};
+
+/**
+ * client for a WMTS (the pre-rendered tiles of a WMS),
+ *   the configuration is shared with WebMapService (address is the capabilities url).
+ *   For a request the matrix matching the image size is chosen,
+ *   and the tiles covering the product are fetched in parallel,
+ *   each tile is mapped on its own into the composite.
+ */
+class WebMapTileService
+: public Weather
+{
+public:
+    WebMapTileService(WeatherConsumer* consumer, const std::shared_ptr<WebMapServiceConf>& mapServiceConf);
+    virtual ~WebMapTileService() = default;
+
+    std::shared_ptr<WebMapServiceConf> getServiceConf()
+    {
+        return m_mapServiceConf;
+    }
+    Glib::ustring get_service_id() override
+    {
+        return m_mapServiceConf->getAddress();
+    }
+    void capabilities() override;
+    void request(const Glib::ustring& productId) override;
+    void check_product(const Glib::ustring& weatherProductId) override;
+    Glib::RefPtr<Gdk::Pixbuf> get_legend(std::shared_ptr<WeatherProduct>& product) override;
+    void inst_on_capabilities_callback(const Glib::ustring& error, int status, SpoonMessageDirect* message);
+    const WebMapTileMatrixSet* find_matrix_set(const Glib::ustring& id);
+    // the url of a tile, by template if given otherwise KVP
+    Glib::ustring tile_url(const std::shared_ptr<WebMapTileProduct>& product, const WebMapTileMatrixSet& matrixSet
+                        , const WebMapTileMatrix& matrix, int row, int col, const Glib::ustring& time);
+
+    // used by parser
+    void add_matrix_set(const WebMapTileMatrixSet& matrixSet);
+    void set_get_tile_url(const Glib::ustring& getTileUrl) {
+        m_getTileUrl = getTileUrl;
+    }
+    void add_parsed_product(const std::shared_ptr<WebMapTileProduct>& product);
+
+    static constexpr auto MAX_TILES{256};   // per request, as a safety for misfitting matrices
+protected:
+    std::shared_ptr<WeatherProduct> create_product() override;
+    void write_catalog_extra(CatalogWriter& writer) override;
+    void read_catalog_extra(CatalogReader& reader) override;
+private:
+    std::shared_ptr<WebMapServiceConf> m_mapServiceConf;
+    std::vector<WebMapTileMatrixSet> m_matrixSets;
+    Glib::ustring m_getTileUrl;
+};
+
+// reads WMTS 1.0.0 capabilities, namespace prefixes are ignored
+class WebMapTileCapabilitiesParser
+: public Glib::Markup::Parser
+{
+public:
+    WebMapTileCapabilitiesParser(WebMapTileService* webMapTileService);
+    virtual ~WebMapTileCapabilitiesParser() = default;
+protected:
+    void on_start_element(Glib::Markup::ParseContext& context,
+		const Glib::ustring& element_name,
+		const Glib::Markup::Parser::AttributeMap& attributes) override;
+    void on_end_element(Glib::Markup::ParseContext& context,
+		const Glib::ustring& element_name) override;
+    void on_text(Glib::Markup::ParseContext& context,
+		const Glib::ustring& text) override;
+private:
+    static Glib::ustring local_name(const Glib::ustring& element_name);
+    static Glib::ustring attribute(const Glib::Markup::Parser::AttributeMap& attributes, const char* name);
+    // the element enclosing the current, empty at top
+    Glib::ustring parent();
+    static bool parse_pair(const Glib::ustring& text, double& first, double& second);
+
+    WebMapTileService* m_webMapTileService;
+    std::vector<Glib::ustring> m_path;
+    Glib::ustring m_text;
+    std::shared_ptr<WebMapTileProduct> m_product;
+    WebMapTileMatrixSet m_matrixSet;
+    WebMapTileMatrix m_matrix;
+    double m_lowerX{0.0};
+    double m_lowerY{0.0};
+    double m_upperX{0.0};
+    double m_upperY{0.0};
+    bool m_defaultStyle{false};
+    Glib::ustring m_styleId;
+    Glib::ustring m_styleLegend;
+    Glib::ustring m_dimensionId;
+    std::vector<Glib::ustring> m_dimensionValues;
+    Glib::ustring m_operation;
+};
@@ -0,0 +1,57 @@
+/* -*- Mode: c++; c-basic-offset: 4; tab-width: 4; coding: utf-8; -*-  */
+/*
+ * Copyright (C) 2023 RPf
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+
+/**
+ * a simple fixed size pool,
+ *   intended for splitting cpu bound work (e.g. pixel mapping)
+ *   the work items shoud not touch any gtk/glib objects that are not thread-safe.
+ */
+class WorkerPool
+{
+public:
+    WorkerPool(unsigned threads);
+    explicit WorkerPool(const WorkerPool& orig) = delete;
+    virtual ~WorkerPool();
+
+    // run fn for each index 0..count-1, returns when all are finished
+    void run_parallel(unsigned count, const std::function<void(unsigned)>& fn);
+    // queue a single item, that will run in background
+    void submit(const std::function<void()>& fn);
+    unsigned get_size() {
+        return static_cast<unsigned>(m_threads.size());
+    }
+    // shared instance sized by hardware
+    static WorkerPool& get_default();
+private:
+    void work();
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<std::function<void()>> m_tasks;
+    bool m_stop{false};
+};
@@ -45,9 +45,9 @@ CoordRefSystem::parse(const Glib::ustring& ref)
     else if (refUp == EPSG_4326_ID) {
         coordRefSystem = EPSG_4326;
     }
-    //else if (refUp == EPSG_3857_ID) { // this is not yet well supported
-    //    coordRefSystem = EPSG_3857;
-    //}
+    else if (refUp == EPSG_3857_ID) {
+        coordRefSystem = EPSG_3857;
+    }
     return coordRefSystem;
 }
 
@@ -273,6 +273,18 @@ GeoBounds::getEastNorth()
     return m_eastNorth;
 }
 
+const GeoCoordinate&
+GeoBounds::getWestSouth() const
+{
+    return m_westSouth;
+}
+
+const GeoCoordinate&
+GeoBounds::getEastNorth() const
+{
+    return m_eastNorth;
+}
+
 Glib::ustring
 GeoBounds::printValue(char separator) const
 {
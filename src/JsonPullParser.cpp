@@ -0,0 +1,254 @@
+/* -*- Mode: c++; c-basic-offset: 4; tab-width: 4; coding: utf-8; -*-  */
+/*
+ * Copyright (C) 2023 RPf
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstring>
+#include <charconv>
+
+#include "JsonPullParser.hpp"
+
+JsonPullParser::JsonPullParser(const char* data, gsize len)
+: m_data{data}
+, m_len{len}
+{
+}
+
+JsonPullParser::Token
+JsonPullParser::fail(const char* msg)
+{
+    if (m_error.empty()) {
+        m_error = Glib::ustring::sprintf("%s at %lu", msg, static_cast<unsigned long>(m_pos));
+    }
+    m_pos = m_len;
+    return Token::Error;
+}
+
+void
+JsonPullParser::skip_space()
+{
+    while (m_pos < m_len
+        && (m_data[m_pos] == ' ' || m_data[m_pos] == '\t' || m_data[m_pos] == '\n' || m_data[m_pos] == '\r')) {
+        ++m_pos;
+    }
+}
+
+void
+JsonPullParser::append_utf8(std::string& buf, gunichar c)
+{
+    gchar utf8[6];
+    gint len = g_unichar_to_utf8(c, utf8);
+    buf.append(utf8, len);
+}
+
+// m_pos at opening quote
+bool
+JsonPullParser::parse_string()
+{
+    gsize start = ++m_pos;
+    while (m_pos < m_len
+        && m_data[m_pos] != '"'
+        && m_data[m_pos] != '\\') {
+        ++m_pos;
+    }
+    if (m_pos >= m_len) {
+        return false;
+    }
+    if (m_data[m_pos] == '"') {     // the usual case, just refer to data
+        m_string = std::string_view(m_data + start, m_pos - start);
+        ++m_pos;
+        return true;
+    }
+    m_buffer.assign(m_data + start, m_pos - start);
+    while (m_pos < m_len) {
+        char c = m_data[m_pos++];
+        if (c == '"') {
+            m_string = m_buffer;
+            return true;
+        }
+        if (c != '\\') {
+            m_buffer.push_back(c);
+            continue;
+        }
+        if (m_pos >= m_len) {
+            return false;
+        }
+        c = m_data[m_pos++];
+        switch (c) {
+        case 'b': m_buffer.push_back('\b'); break;
+        case 'f': m_buffer.push_back('\f'); break;
+        case 'n': m_buffer.push_back('\n'); break;
+        case 'r': m_buffer.push_back('\r'); break;
+        case 't': m_buffer.push_back('\t'); break;
+        case 'u': {
+                if (m_pos + 4 > m_len) {
+                    return false;
+                }
+                unsigned code{0};
+                auto res = std::from_chars(m_data + m_pos, m_data + m_pos + 4, code, 16);
+                if (res.ptr != m_data + m_pos + 4) {
+                    return false;
+                }
+                m_pos += 4;
+                if (code >= 0xd800 && code < 0xdc00     // surrogate pair
+                 && m_pos + 6 <= m_len
+                 && m_data[m_pos] == '\\'
+                 && m_data[m_pos + 1] == 'u') {
+                    unsigned low{0};
+                    res = std::from_chars(m_data + m_pos + 2, m_data + m_pos + 6, low, 16);
+                    if (res.ptr == m_data + m_pos + 6
+                     && low >= 0xdc00 && low < 0xe000) {
+                        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                        m_pos += 6;
+                    }
+                }
+                append_utf8(m_buffer, code);
+            }
+            break;
+        default:    // " \ /
+            m_buffer.push_back(c);
+            break;
+        }
+    }
+    return false;
+}
+
+bool
+JsonPullParser::parse_literal(const char* literal)
+{
+    auto len = std::strlen(literal);
+    if (m_pos + len > m_len
+     || std::memcmp(m_data + m_pos, literal, len) != 0) {
+        return false;
+    }
+    m_pos += len;
+    return true;
+}
+
+double
+JsonPullParser::get_number()
+{
+    double value{0.0};
+    std::from_chars(m_string.data(), m_string.data() + m_string.size(), value);
+    return value;
+}
+
+JsonPullParser::Token
+JsonPullParser::next()
+{
+    skip_space();
+    if (m_pos >= m_len) {
+        if (!m_error.empty()) {
+            return Token::Error;
+        }
+        return m_containers.empty() ? Token::End : fail("Unexpected end");
+    }
+    char c = m_data[m_pos];
+    if (c == ',') {
+        if (m_containers.empty()) {
+            return fail("Unexpected ,");
+        }
+        ++m_pos;
+        m_expectKey = m_containers.back() == '{';
+        skip_space();
+        if (m_pos >= m_len) {
+            return fail("Unexpected end");
+        }
+        c = m_data[m_pos];
+    }
+    if (c == '}' || c == ']') {
+        if (m_containers.empty()
+         || m_containers.back() != (c == '}' ? '{' : '[')) {
+            return fail("Unmatched close");
+        }
+        ++m_pos;
+        m_containers.pop_back();
+        m_expectKey = false;
+        return c == '}' ? Token::EndObject : Token::EndArray;
+    }
+    if (m_expectKey) {
+        if (c != '"'
+         || !parse_string()) {
+            return fail("Expected key");
+        }
+        skip_space();
+        if (m_pos >= m_len
+         || m_data[m_pos] != ':') {
+            return fail("Expected :");
+        }
+        ++m_pos;
+        m_expectKey = false;
+        return Token::Key;
+    }
+    switch (c) {
+    case '{':
+        ++m_pos;
+        m_containers.push_back('{');
+        m_expectKey = true;
+        return Token::BeginObject;
+    case '[':
+        ++m_pos;
+        m_containers.push_back('[');
+        return Token::BeginArray;
+    case '"':
+        if (!parse_string()) {
+            return fail("Unterminated string");
+        }
+        return Token::String;
+    case 't':
+        return parse_literal("true") ? Token::True : fail("Invalid literal");
+    case 'f':
+        return parse_literal("false") ? Token::False : fail("Invalid literal");
+    case 'n':
+        return parse_literal("null") ? Token::Null : fail("Invalid literal");
+    default:
+        break;
+    }
+    gsize start = m_pos;
+    while (m_pos < m_len
+        && (g_ascii_isdigit(m_data[m_pos])
+         || m_data[m_pos] == '-' || m_data[m_pos] == '+'
+         || m_data[m_pos] == '.' || m_data[m_pos] == 'e' || m_data[m_pos] == 'E')) {
+        ++m_pos;
+    }
+    if (m_pos == start) {
+        return fail("Unexpected character");
+    }
+    m_string = std::string_view(m_data + start, m_pos - start);
+    return Token::Number;
+}
+
+JsonPullParser::Token
+JsonPullParser::skip(Token token)
+{
+    if (token != Token::BeginObject
+     && token != Token::BeginArray) {
+        return token;
+    }
+    auto depth = m_containers.size() - 1;
+    while (true) {
+        token = next();
+        if (token == Token::Error
+         || token == Token::End) {
+            return token;
+        }
+        if ((token == Token::EndObject || token == Token::EndArray)
+         && m_containers.size() == depth) {
+            return token;
+        }
+    }
+}
@@ -0,0 +1,182 @@
+/* -*- Mode: c++; c-basic-offset: 4; tab-width: 4; coding: utf-8; -*-  */
+/*
+ * Copyright (C) 2023 RPf
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <glib/gstdio.h>
+#include <Log.hpp>
+#include <psc_format.hpp>
+
+#include "LegendCache.hpp"
+#include "TileStore.hpp"
+
+LegendCache::LegendCache(const std::string& dir, gint64 maxAgeSec)
+: m_dir{dir}
+, m_maxAgeSec{maxAgeSec}
+{
+    for (auto sub : {"objects", "keys"}) {
+        auto path = Glib::build_filename(m_dir, sub);
+        if (g_mkdir_with_parents(path.c_str(), 0700) != 0) {
+            psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
+                return psc::fmt::format("LegendCache unable to create {}", path);
+            });
+        }
+    }
+}
+
+std::shared_ptr<LegendCache>
+LegendCache::create_default()
+{
+    auto dir = Glib::build_filename(Glib::get_user_cache_dir(), "geodata", "legends");
+    return std::make_shared<LegendCache>(dir);
+}
+
+std::string
+LegendCache::object_path(const std::string& contentHash)
+{
+    return Glib::build_filename(m_dir, "objects", contentHash + ".img");
+}
+
+std::string
+LegendCache::key_path(const Glib::ustring& url)
+{
+    return Glib::build_filename(m_dir, "keys", TileStore::sha256(url.data(), url.bytes()));
+}
+
+Glib::RefPtr<Gdk::Pixbuf>
+LegendCache::decode(const guint8* data, gsize size)
+{
+    Glib::RefPtr<Gdk::Pixbuf> pixbuf;
+    try {
+        auto loader = Gdk::PixbufLoader::create();
+        loader->write(data, size);
+        loader->close();
+        pixbuf = loader->get_pixbuf();
+    }
+    catch (const Glib::Error& ex) {
+        psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
+            return psc::fmt::format("LegendCache unable to decode {}", ex.what());
+        });
+    }
+    return pixbuf;
+}
+
+Glib::RefPtr<Gdk::Pixbuf>
+LegendCache::lookup(const Glib::ustring& url)
+{
+    auto urlEntry = m_urlHashes.find(url);
+    if (urlEntry != m_urlHashes.end()) {
+        return m_pixbufs[urlEntry->second];
+    }
+    Glib::RefPtr<Gdk::Pixbuf> pixbuf;
+    auto keyPath = key_path(url);
+    GStatBuf stat;
+    if (g_stat(keyPath.c_str(), &stat) != 0
+     || stat.st_mtime < g_get_real_time() / G_USEC_PER_SEC - m_maxAgeSec) {  // fetch again, legends may change with a service update
+        return pixbuf;
+    }
+    try {
+        auto contentHash = Glib::file_get_contents(keyPath);
+        auto pixEntry = m_pixbufs.find(contentHash);
+        if (pixEntry != m_pixbufs.end()) {
+            pixbuf = pixEntry->second;
+        }
+        else {
+            auto content = Glib::file_get_contents(object_path(contentHash));
+            pixbuf = decode(reinterpret_cast<const guint8*>(content.data()), content.size());
+            if (!pixbuf) {
+                return pixbuf;
+            }
+            keep(contentHash, pixbuf);
+        }
+        m_urlHashes.insert(std::make_pair(url, contentHash));
+        limit();
+    }
+    catch (const Glib::Error& ex) {
+        psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
+            return psc::fmt::format("LegendCache unable to read {} {}", url, ex.what());
+        });
+    }
+    return pixbuf;
+}
+
+Glib::RefPtr<Gdk::Pixbuf>
+LegendCache::store(const Glib::ustring& url, const guint8* data, gsize size)
+{
+    auto contentHash = TileStore::sha256(data, size);
+    Glib::RefPtr<Gdk::Pixbuf> pixbuf;
+    auto pixEntry = m_pixbufs.find(contentHash);
+    if (pixEntry != m_pixbufs.end()) {     // same legend as for other url
+        pixbuf = pixEntry->second;
+    }
+    else {
+        pixbuf = decode(data, size);
+        if (!pixbuf) {
+            return pixbuf;
+        }
+        keep(contentHash, pixbuf);
+    }
+    m_urlHashes[url] = contentHash;
+    limit();
+    try {
+        auto objPath = object_path(contentHash);
+        if (!Glib::file_test(objPath, Glib::FileTest::EXISTS)) {
+            Glib::file_set_contents(objPath, reinterpret_cast<const gchar*>(data), size);
+        }
+        Glib::file_set_contents(key_path(url), contentHash.data(), contentHash.size());
+    }
+    catch (const Glib::Error& ex) {
+        psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
+            return psc::fmt::format("LegendCache unable to store {} {}", url, ex.what());
+        });
+    }
+    return pixbuf;
+}
+
+void
+LegendCache::set_max_bytes(gsize maxBytes)
+{
+    m_maxBytes = maxBytes;
+    limit();
+}
+
+void
+LegendCache::keep(const std::string& contentHash, const Glib::RefPtr<Gdk::Pixbuf>& pixbuf)
+{
+    m_pixbufs.insert(std::make_pair(contentHash, pixbuf));
+    m_order.push_back(contentHash);
+    m_bytes += pixbuf->get_byte_length();
+}
+
+// the newest is kept in any case, as it was just requested
+void
+LegendCache::limit()
+{
+    while (m_bytes > m_maxBytes
+        && m_order.size() > 1) {
+        auto contentHash = m_order.front();
+        m_order.pop_front();
+        auto entry = m_pixbufs.find(contentHash);
+        if (entry != m_pixbufs.end()) {
+            m_bytes -= entry->second->get_byte_length();
+            m_pixbufs.erase(entry);
+        }
+        std::erase_if(m_urlHashes, [&] (const auto& urlHash) {
+            return urlHash.second == contentHash;
+        });
+    }
+}
@@ -0,0 +1,211 @@
+/* -*- Mode: c++; c-basic-offset: 4; tab-width: 4; coding: utf-8; -*-  */
+/*
+ * Copyright (C) 2023 RPf
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstring>
+#include <fstream>
+#include <glib/gstdio.h>
+#include <Log.hpp>
+#include <psc_format.hpp>
+
+#include "ProductCatalog.hpp"
+#include "TileStore.hpp"
+
+void
+CatalogWriter::put(const void* data, gsize len)
+{
+    m_data.append(static_cast<const char*>(data), len);
+}
+
+void
+CatalogWriter::put_u32(guint32 value)
+{
+    put(&value, sizeof(value));
+}
+
+void
+CatalogWriter::put_i64(gint64 value)
+{
+    put(&value, sizeof(value));
+}
+
+void
+CatalogWriter::put_double(double value)
+{
+    put(&value, sizeof(value));
+}
+
+void
+CatalogWriter::put_string(const Glib::ustring& value)
+{
+    put_u32(static_cast<guint32>(value.bytes()));
+    put(value.data(), value.bytes());
+}
+
+void
+CatalogWriter::put_strings(const std::vector<Glib::ustring>& values)
+{
+    put_u32(static_cast<guint32>(values.size()));
+    for (auto& value : values) {
+        put_string(value);
+    }
+}
+
+CatalogReader::CatalogReader(std::string&& data)
+: m_data{std::move(data)}
+{
+}
+
+bool
+CatalogReader::get(void* data, gsize len)
+{
+    if (!m_valid
+     || m_offset + len > m_data.size()) {
+        m_valid = false;
+        return false;
+    }
+    std::memcpy(data, m_data.data() + m_offset, len);
+    m_offset += len;
+    return true;
+}
+
+guint32
+CatalogReader::get_u32()
+{
+    guint32 value{0};
+    get(&value, sizeof(value));
+    return value;
+}
+
+gint64
+CatalogReader::get_i64()
+{
+    gint64 value{0};
+    get(&value, sizeof(value));
+    return value;
+}
+
+double
+CatalogReader::get_double()
+{
+    double value{0.0};
+    get(&value, sizeof(value));
+    return value;
+}
+
+Glib::ustring
+CatalogReader::get_string()
+{
+    guint32 len = get_u32();
+    if (!m_valid
+     || m_offset + len > m_data.size()) {
+        m_valid = false;
+        return Glib::ustring();
+    }
+    Glib::ustring value(m_data.data() + m_offset, m_data.data() + m_offset + len);
+    m_offset += len;
+    return value;
+}
+
+std::vector<Glib::ustring>
+CatalogReader::get_strings()
+{
+    std::vector<Glib::ustring> values;
+    guint32 count = get_u32();
+    if (count > m_data.size() - m_offset) {    // each value needs at least one byte
+        m_valid = false;
+        return values;
+    }
+    values.reserve(count);
+    for (guint32 i = 0; i < count && m_valid; ++i) {
+        values.push_back(get_string());
+    }
+    return values;
+}
+
+ProductCatalog::ProductCatalog(const std::string& dir)
+: m_dir{dir}
+{
+    if (g_mkdir_with_parents(m_dir.c_str(), 0700) != 0) {
+        psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
+            return psc::fmt::format("ProductCatalog unable to create {}", m_dir);
+        });
+    }
+}
+
+std::shared_ptr<ProductCatalog>
+ProductCatalog::create_default()
+{
+    auto dir = Glib::build_filename(Glib::get_user_cache_dir(), "geodata", "catalog");
+    return std::make_shared<ProductCatalog>(dir);
+}
+
+std::string
+ProductCatalog::catalog_path(const Glib::ustring& serviceId)
+{
+    return Glib::build_filename(m_dir, TileStore::sha256(serviceId.data(), serviceId.bytes()) + ".cat");
+}
+
+std::shared_ptr<CatalogReader>
+ProductCatalog::load(const Glib::ustring& serviceId)
+{
+    auto path = catalog_path(serviceId);
+    if (!Glib::file_test(path, Glib::FileTest::EXISTS)) {
+        return std::shared_ptr<CatalogReader>();
+    }
+    try {
+        return std::make_shared<CatalogReader>(Glib::file_get_contents(path));
+    }
+    catch (const Glib::Error& ex) {
+        psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
+            return psc::fmt::format("ProductCatalog unable to read {} {}", path, ex.what());
+        });
+    }
+    return std::shared_ptr<CatalogReader>();
+}
+
+void
+ProductCatalog::save(const Glib::ustring& serviceId, const CatalogWriter& writer)
+{
+    auto path = catalog_path(serviceId);
+    try {
+        auto& data = writer.get_data();
+        Glib::file_set_contents(path, data.data(), data.size());
+    }
+    catch (const Glib::Error& ex) {
+        psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
+            return psc::fmt::format("ProductCatalog unable to save {} {}", path, ex.what());
+        });
+    }
+}
+
+void
+ProductCatalog::touch(const Glib::ustring& serviceId, gint64 savedSec)
+{
+    auto path = catalog_path(serviceId);
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    if (file) {
+        file.seekp(SAVED_OFFSET);
+        file.write(reinterpret_cast<const char*>(&savedSec), sizeof(savedSec));
+    }
+    if (!file) {
+        psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
+            return psc::fmt::format("ProductCatalog unable to touch {}", path);
+        });
+    }
+}
@@ -0,0 +1,204 @@
+/* -*- Mode: c++; c-basic-offset: 4; tab-width: 4; coding: utf-8; -*-  */
+/*
+ * Copyright (C) 2023 RPf
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "ProductIndex.hpp"
+#include "Weather.hpp"
+
+std::vector<std::string>
+ProductIndex::tokenize(const Glib::ustring& text)
+{
+    std::vector<std::string> words;
+    std::string word;
+    for (auto c : text) {
+        if (g_unichar_isalnum(c)) {
+            gchar buf[6];
+            gint len = g_unichar_to_utf8(g_unichar_tolower(c), buf);
+            word.append(buf, len);
+        }
+        else if (!word.empty()) {
+            words.push_back(std::move(word));
+            word.clear();
+        }
+    }
+    if (!word.empty()) {
+        words.push_back(std::move(word));
+    }
+    return words;
+}
+
+void
+ProductIndex::add_field(guint32 docId, const Glib::ustring& text, float weight)
+{
+    for (auto& word : tokenize(text)) {
+        auto& postings = m_postings[word];
+        if (!postings.empty()
+         && postings.back().doc == docId) {    // the same word again counts once per field
+            postings.back().weight = std::max(postings.back().weight, weight);
+        }
+        else {
+            postings.push_back(Posting{docId, weight});
+        }
+    }
+}
+
+void
+ProductIndex::add(Doc&& doc)
+{
+    auto docId = static_cast<guint32>(m_docs.size());
+    auto& product = doc.product;
+    add_field(docId, product->get_id(), WEIGHT_ID);
+    add_field(docId, product->get_name(), WEIGHT_NAME);
+    add_field(docId, product->get_keywords(), WEIGHT_KEYWORD);
+    add_field(docId, product->get_description(), WEIGHT_DESCRIPTION);
+    m_docs.push_back(std::move(doc));
+}
+
+void
+ProductIndex::rebuild()
+{
+    std::vector<Doc> docs;
+    docs.swap(m_docs);
+    m_postings.clear();
+    for (auto& doc : docs) {
+        add(std::move(doc));
+    }
+}
+
+void
+ProductIndex::update(Weather& weather)
+{
+    auto serviceId = weather.get_service_id();
+    std::erase_if(m_docs, [&] (const Doc& doc) {
+        return doc.serviceId == serviceId;
+    });
+    rebuild();
+    for (auto& product : weather.get_products()) {
+        Doc doc;
+        doc.product = product;
+        doc.serviceId = serviceId;
+        auto bounds = product->getBounds();
+        doc.crs = bounds.getWestSouth().getCoordRefSystem();
+        doc.timeEnabled = !product->get_dimension().empty();
+        doc.hasBounds = static_cast<bool>(doc.crs);
+        if (doc.hasBounds) {
+            auto linear = bounds.convert(CoordRefSystem::CRS_84);
+            doc.west = linear.getWestSouth().getLongitude();
+            doc.south = linear.getWestSouth().getLatitude();
+            doc.east = linear.getEastNorth().getLongitude();
+            doc.north = linear.getEastNorth().getLatitude();
+        }
+        add(std::move(doc));
+    }
+}
+
+void
+ProductIndex::remove(const Glib::ustring& serviceId)
+{
+    std::erase_if(m_docs, [&] (const Doc& doc) {
+        return doc.serviceId == serviceId;
+    });
+    rebuild();
+}
+
+bool
+ProductIndex::is_accepted(const Doc& doc, const ProductQuery& query)
+{
+    if (query.crs
+     && doc.crs != query.crs) {
+        return false;
+    }
+    if (query.timeEnabled
+     && !doc.timeEnabled) {
+        return false;
+    }
+    if (query.useBounds) {
+        auto& bounds = query.bounds;
+        if (!doc.hasBounds
+         || doc.west > bounds.getEastNorth().getLongitude()
+         || doc.east < bounds.getWestSouth().getLongitude()
+         || doc.south > bounds.getEastNorth().getLatitude()
+         || doc.north < bounds.getWestSouth().getLatitude()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<ProductMatch>
+ProductIndex::search(const ProductQuery& query)
+{
+    std::vector<ProductMatch> matches;
+    auto words = tokenize(query.text);
+    if (words.empty()) {
+        for (auto& doc : m_docs) {
+            if (is_accepted(doc, query)) {
+                matches.push_back(ProductMatch{doc.product, doc.serviceId, 0.0});
+            }
+        }
+    }
+    else {
+        // all words have to match, the last one may be a prefix (as typed)
+        std::unordered_map<guint32, std::pair<size_t, double>> scores;    // doc -> words matched, score
+        for (size_t i = 0; i < words.size(); ++i) {
+            auto& word = words[i];
+            bool prefix = i == words.size() - 1;
+            std::unordered_map<guint32, float> wordScores;
+            for (auto entry = m_postings.lower_bound(word);
+                 entry != m_postings.end() && entry->first.compare(0, word.size(), word) == 0;
+                 ++entry) {
+                bool exact = entry->first.size() == word.size();
+                if (!exact && !prefix) {
+                    break;  // no need to look further
+                }
+                float factor = exact ? 1.0f : 0.5f;
+                for (auto& posting : entry->second) {
+                    auto& score = wordScores[posting.doc];
+                    score = std::max(score, posting.weight * factor);
+                }
+            }
+            for (auto& wordScore : wordScores) {
+                auto& score = scores[wordScore.first];
+                if (score.first == i) {     // matched all previous words
+                    ++score.first;
+                    score.second += wordScore.second;
+                }
+            }
+        }
+        for (auto& score : scores) {
+            auto& doc = m_docs[score.first];
+            if (score.second.first == words.size()
+             && is_accepted(doc, query)) {
+                matches.push_back(ProductMatch{doc.product, doc.serviceId, score.second.second});
+            }
+        }
+    }
+    size_t count = std::min(matches.size(), query.limit);
+    std::partial_sort(matches.begin(), matches.begin() + count, matches.end()
+                    , [] (const ProductMatch& a, const ProductMatch& b) {
+        if (a.score != b.score) {
+            return a.score > b.score;
+        }
+        return a.product->get_name() < b.product->get_name();
+    });
+    matches.resize(count);
+    return matches;
+}
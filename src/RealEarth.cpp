@@ -22,10 +22,14 @@
 #include <strings.h>
 #include <memory.h>
 #include <JsonHelper.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <psc_format.hpp>
 
 
 #include "RealEarth.hpp"
-#include "MapProjection.hpp"
+#include "Reprojection.hpp"
 #include "GeoCoordinate.hpp"
 
 // it might be an option to use WMS here as well
@@ -66,60 +70,56 @@ RealEarthImageRequest::build_url(std::shared_ptr<RealEarthProduct>& product)
     std::cout << "Bounds " << bound << std::endl;
     #endif
     addQuery("bounds", bound);
-    std::vector<Glib::ustring> times = product->get_times();
-    if (!times.empty()) {
-        Glib::ustring time = times[times.size()-1];
+    Glib::ustring time;
+    gint64 latest;
+    if (product->get_latest_time(latest)) {
+        time = RealEarthProduct::format_time(latest);
         addQuery("time", time);
     }
-    addQuery("width", Glib::ustring::sprintf("%d", m_pixWidth));
-    addQuery("height", Glib::ustring::sprintf("%d", m_pixWidth));
+    // the server would upsample beyond its native resolution, so leave that to mapping
+    int width = m_pixWidth;
+    int height = m_pixHeight;
+    if (product->has_extent()) {
+        width = std::min(width, native_pixels(m_east - m_west
+                    , product->getEastNorth().getLongitude() - product->getWestSouth().getLongitude()
+                    , product->get_extent_width()));
+        height = std::min(height, native_pixels(m_north - m_south
+                    , product->getEastNorth().getLatitude() - product->getWestSouth().getLatitude()
+                    , product->get_extent_height()));
+    }
+    addQuery("width", Glib::ustring::sprintf("%d", width));
+    addQuery("height", Glib::ustring::sprintf("%d", height));
+    GeoBounds bounds{m_west, m_south, m_east, m_north, CoordRefSystem::CRS_84};
+    set_tile_key(TileKey{m_realEarth->get_service_id(), product->get_id(), time, bounds, m_pixWidth, m_pixHeight});
+}
+
+int
+RealEarthImageRequest::native_pixels(double span, double extentSpan, int extentPixels)
+{
+    if (extentSpan <= 0.0
+     || extentPixels <= 0) {
+        return std::numeric_limits<int>::max();     // unknown, no limit
+    }
+    return std::max(static_cast<int>(std::ceil(std::abs(span) / extentSpan * extentPixels)), 1);
 }
 
 // undo mercator mapping (correctly named coordinate transform) of pix.
-//  By scanning every linear latitude, transform it into a index for the mercator map
-//  and copying this row into weather_pix at the right position.
+//  The image is requested by degrees but delivered as (web-)mercator,
+//  so by converting the bounds we can use the common reprojection.
 //  This expects tiles aligned to equator.
+//  The pix may be smaller than the target (capped at native resolution),
+//  the reprojection scales it up.
 void
 RealEarthImageRequest::mapping(Glib::RefPtr<Gdk::Pixbuf> pix, Glib::RefPtr<Gdk::Pixbuf>& weather_pix)
 {
-    // create a compatible pixmap to clear a requested area
-    Glib::RefPtr<Gdk::Pixbuf> clearPix = Gdk::Pixbuf::create(weather_pix->get_colorspace(), weather_pix->get_has_alpha(), weather_pix->get_bits_per_sample(), pix->get_width(), 1);
-    clearPix->fill(0x0);   // transp. black
-	bool isnorth = m_north > 0.0;
-    //std::string inname = Glib::ustring::sprintf("/home/rpf/in%f%f.png", std::floor(m_west), std::floor(m_north));
-    //pix->save(inname, "png");
-    double pix_height = pix->get_height();
-    MapProjectionMercator projectMercator;
-	double relMercOrigin = projectMercator.fromLinearLatitude((isnorth ? m_north : std::abs(m_south)) / 90.0);
-	for (int linY = 0; linY < pix_height; ++linY) {
-	    double realRelLat = isnorth
-		            ? ((double)(pix_height - linY) / pix_height)
-		            : ((double)linY / pix_height);
-	    double relMerc = projectMercator.fromLinearLatitude(realRelLat);
-	    if (relMerc < relMercOrigin) {
-            // relMerc is now right for a full view 0..90 -> 0-1
-            double relMercMap = isnorth
-                                ? 1.0 - (relMerc / relMercOrigin)
-                                : (relMerc / relMercOrigin);
-            // relMercMap adjust mercator to our map
-            int mercImageY = (int)(relMercMap * pix_height);
-            //std::cout << "Map "
-            //          << realRelLat
-            //          << " to " << relMerc
-            //          << " i " << y
-            //          << " to " << mercImageY
-            //          << std::endl;
-            if (mercImageY >= 0 && mercImageY < pix_height) {     // just to be safe (better than to crash)
-                pix->copy_area(0, mercImageY, pix->get_width(), 1, weather_pix, get_pixX(), get_pixY()+linY);
-            }
-            else {
-                std::cout << "Generated y " << mercImageY << " while mapping exceeded size " << pix->get_height() << std::endl;
-            }
-    	}
-        else {
-            clearPix->copy_area(0, 0, clearPix->get_width(), 1, weather_pix, get_pixX(), get_pixY()+linY);
-        }
-    }
+    bool isnorth = m_north > 0.0;
+    GeoBounds source{m_west, m_south, m_east, m_north, CoordRefSystem::CRS_84};
+    GeoBounds target{m_west, isnorth ? 0.0 : -90.0, m_east, isnorth ? 90.0 : 0.0, CoordRefSystem::CRS_84};
+    auto reprojection = Reprojection::create(source.convert(CoordRefSystem::EPSG_3857)
+                                , pix->get_width(), pix->get_height()
+                                , target, m_pixWidth, m_pixHeight);
+    reprojection->map(pix, weather_pix, get_pixX(), get_pixY());
+    store_mapped(weather_pix, get_pixX(), get_pixY(), m_pixWidth, m_pixHeight);
 }
 
 int
@@ -135,6 +135,56 @@ RealEarthImageRequest::get_pixY()
 }
 
 
+RealEarthTileRequest::RealEarthTileRequest(RealEarth* realEarth, int zoom, int tileX, int tileY
+    , const GeoBounds& target, int pixX, int pixY, int pixWidth, int pixHeight
+    , std::shared_ptr<RealEarthProduct>& product)
+: WeatherImageRequest(realEarth->get_base_url(), "api/image")
+, m_source{tile_bounds(zoom, tileX, tileY)}
+, m_target{target}
+, m_pixX{pixX}
+, m_pixY{pixY}
+, m_pixWidth{pixWidth}
+, m_pixHeight{pixHeight}
+{
+    addQuery("products", product->get_id());
+    addQuery("z", Glib::ustring::sprintf("%d", zoom));
+    addQuery("x", Glib::ustring::sprintf("%d", tileX));
+    addQuery("y", Glib::ustring::sprintf("%d", tileY));
+    Glib::ustring time;
+    gint64 latest;
+    if (product->get_latest_time(latest)) {
+        time = RealEarthProduct::format_time(latest);
+        addQuery("time", time);
+    }
+    // the store keeps the mapped result, that depends on the target placement
+    set_tile_key(TileKey{realEarth->get_service_id(), product->get_id(), time
+                        , m_target, m_pixWidth, m_pixHeight});
+    signal_receive().connect(
+        sigc::mem_fun(*realEarth, &RealEarth::inst_on_image_callback));
+}
+
+GeoBounds
+RealEarthTileRequest::tile_bounds(int zoom, int tileX, int tileY)
+{
+    // the grid is square in mercator meters, so rows are not linear by latitude
+    double span = 2.0 / static_cast<double>(1 << zoom);   // fraction of -1..1
+    return GeoBounds{(-1.0 + tileX * span) * CoordRefSystem::EPSG3857_MAX
+                   , (1.0 - (tileY + 1) * span) * CoordRefSystem::EPSG3857_MAX
+                   , (-1.0 + (tileX + 1) * span) * CoordRefSystem::EPSG3857_MAX
+                   , (1.0 - tileY * span) * CoordRefSystem::EPSG3857_MAX
+                   , CoordRefSystem::EPSG_3857};
+}
+
+void
+RealEarthTileRequest::mapping(Glib::RefPtr<Gdk::Pixbuf> pix, Glib::RefPtr<Gdk::Pixbuf>& weather_pix)
+{
+    auto reprojection = Reprojection::create(m_source, pix->get_width(), pix->get_height()
+                                , m_target, m_pixWidth, m_pixHeight);
+    reprojection->map(pix, weather_pix, m_pixX, m_pixY);
+    store_mapped(weather_pix, m_pixX, m_pixY, m_pixWidth, m_pixHeight);
+}
+
+
 RealEarthProduct::RealEarthProduct(JsonObject* obj)
 : WeatherProduct()
 , m_legend{}
@@ -151,13 +201,77 @@ RealEarthProduct::RealEarthProduct(JsonObject* obj)
     for (guint i = 0; i < len; ++i) {
         Glib::ustring time = json_array_get_string_element(times, i);
         if (!time.empty()) {
-            m_times.push_back(time);
+            add_time(time);
         }
     }
     GeoBounds bounds{-180.0, -m_seedlatbound, 180.0, m_seedlatbound, CoordRefSystem::CRS_84};
     m_bounds = bounds;   // avoid querying extend as it doesn't reveal much
 }
 
+RealEarthProduct::RealEarthProduct(JsonPullParser& parser)
+: WeatherProduct()
+, m_legend{}
+{
+    auto token = parser.next();
+    while (token == JsonPullParser::Token::Key) {
+        auto key = parser.get_string();
+        token = parser.next();
+        if (token == JsonPullParser::Token::String) {
+            auto value = parser.get_string();
+            if (key == "id") {
+                m_id = to_ustring(value);
+            }
+            else if (key == "dataid") {
+                m_dataid = to_ustring(value);
+            }
+            else if (key == "name") {
+                m_name = to_ustring(value);
+            }
+            else if (key == "description") {
+                m_description = to_ustring(value);
+            }
+            else if (key == "type") {
+                m_type = to_ustring(value);
+            }
+            else if (key == "outputtype") {
+                m_outputtype = to_ustring(value);
+            }
+        }
+        else if (token == JsonPullParser::Token::Number
+              && key == "seedlatbound") {
+            m_seedlatbound = parser.get_number();
+        }
+        else if (token == JsonPullParser::Token::BeginArray
+              && key == "times") {
+            while ((token = parser.next()) == JsonPullParser::Token::String) {
+                if (!parser.get_string().empty()) {
+                    add_time(to_ustring(parser.get_string()));
+                }
+            }
+            if (token != JsonPullParser::Token::EndArray) {
+                token = parser.skip(token);
+            }
+        }
+        else {
+            token = parser.skip(token);   // not used
+        }
+        if (token == JsonPullParser::Token::Error
+         || token == JsonPullParser::Token::End) {
+            break;
+        }
+        token = parser.next();
+    }
+    m_valid = token == JsonPullParser::Token::EndObject;
+    GeoBounds bounds{-180.0, -m_seedlatbound, 180.0, m_seedlatbound, CoordRefSystem::CRS_84};
+    m_bounds = bounds;   // avoid querying extend as it doesn't reveal much
+}
+
+Glib::ustring
+RealEarthProduct::to_ustring(std::string_view value)
+{
+    return Glib::ustring(value.begin(), value.end());
+}
+
 // info about it is displayable for us
 bool
 RealEarthProduct::is_displayable()
@@ -165,29 +279,147 @@ RealEarthProduct::is_displayable()
     return m_outputtype == "png24" && !m_times.empty();
 }
 
+bool
+RealEarthProduct::add_time(gint64 time)
+{
+    auto pos = std::lower_bound(m_times.begin(), m_times.end(), time);
+    if (pos != m_times.end() && *pos == time) {
+        return false;
+    }
+    if (m_times.size() >= MAX_TIMES) {
+        if (pos == m_times.begin()) {
+            return false;   // older than any we keep, not news
+        }
+        m_times.pop_front();
+        pos = std::lower_bound(m_times.begin(), m_times.end(), time);
+    }
+    m_times.insert(pos, time);  // usually at end
+    return true;
+}
+
+void
+RealEarthProduct::add_time(const Glib::ustring& time)
+{
+    gint64 value;
+    if (parse_time(time, value)) {
+        add_time(value);
+    }
+    else {
+        psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
+            return psc::fmt::format("RealEarthProduct {} time {} not parsed", m_id, time);
+        });
+    }
+}
+
 // check if the given latest is the contained, if not is it added
 bool
 RealEarthProduct::is_latest(const Glib::ustring& latest)
 {
-    for (auto time : m_times) {
-        if (time == latest) {
-            return true;
-        }
+    gint64 time;
+    if (!parse_time(latest, time)) {
+        psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
+            return psc::fmt::format("RealEarthProduct {} latest {} not parsed", m_id, latest);
+        });
+        return true;    // can't tell
     }
-    m_times.push_back(latest);
-    return false;
+    return !add_time(time);
 }
 
 Glib::ustring
 RealEarthProduct::get_dimension()
 {
     Glib::ustring ret;
-    if (!m_times.empty()) {
-        ret = m_times[m_times.size()-1];
+    gint64 latest;
+    if (get_latest_time(latest)) {
+        ret = format_time(latest);
     }
     return ret;
 }
 
+bool
+RealEarthProduct::parse_time(const Glib::ustring& time, gint64& value)
+{
+    Glib::ustring iso8601 = time;
+    auto pos = iso8601.find(".");
+    if (pos != Glib::ustring::npos)  {
+        iso8601.replace(pos, 1, "T"); // make it iso
+    }
+    auto tz = Glib::TimeZone::create_utc();
+    auto utc = Glib::DateTime::create_from_iso8601(iso8601, tz);
+    if (!utc) {
+        return false;
+    }
+    value = utc.to_unix();
+    return true;
+}
+
+Glib::ustring
+RealEarthProduct::format_time(gint64 value)
+{
+    return Glib::DateTime::create_now_utc(value).format("%Y%m%d.%H%M%S");
+}
+
+bool
+RealEarthProduct::get_latest_time(gint64& time)
+{
+    if (m_times.empty()) {
+        return false;
+    }
+    time = m_times.back();
+    return true;
+}
+
+bool
+RealEarthProduct::get_previous_time(gint64 time, gint64& previous)
+{
+    auto pos = std::lower_bound(m_times.begin(), m_times.end(), time);
+    if (pos == m_times.begin()) {
+        return false;
+    }
+    previous = *std::prev(pos);
+    return true;
+}
+
+bool
+RealEarthProduct::get_next_time(gint64 time, gint64& next)
+{
+    auto pos = std::upper_bound(m_times.begin(), m_times.end(), time);
+    if (pos == m_times.end()) {
+        return false;
+    }
+    next = *pos;
+    return true;
+}
+
+gint64
+RealEarthProduct::get_update_interval()
+{
+    if (m_times.size() < 2) {
+        return 0;
+    }
+    size_t first = m_times.size() - std::min(m_times.size(), static_cast<size_t>(RealEarth::MAX_UPDATE_INTERVALS + 1));
+    auto intervals = static_cast<gint64>(m_times.size() - 1 - first);
+    return std::max((m_times.back() - m_times[first]) / intervals, static_cast<gint64>(0));
+}
+
+gint64
+RealEarthProduct::get_update_due_sec(const Glib::DateTime& nowUtc)
+{
+    auto interval = get_update_interval();
+    gint64 latest;
+    if (!get_latest_time(latest)
+     || interval == 0) {
+        return 0;    // can't tell
+    }
+    return std::max(interval - (nowUtc.to_unix() - latest), static_cast<gint64>(0));
+}
+
+bool
+RealEarthProduct::is_update_due(const Glib::DateTime& nowUtc)
+{
+    return get_update_due_sec(nowUtc) == 0;
+}
+
 /**
  *  return time for latest
  * @param dateTime set date&time to local for latest if possible
@@ -196,27 +428,10 @@ RealEarthProduct::get_dimension()
 bool
 RealEarthProduct::latest(Glib::DateTime& dateTime)
 {
-    if (!m_times.empty()) {
-        Glib::ustring latest = m_times[m_times.size()-1];
-        Glib::ustring iso8601 = latest;
-        auto pos = iso8601.find(".");
-        if (pos == Glib::ustring::npos)  {
-            std::cout << "RealEarthProduct::latest latest " << iso8601 << " no '.' found" << std::endl;
-        }
-        else {
-            iso8601.replace(pos, 1, "T"); // make it iso
-        }
-        auto tz = Glib::TimeZone::create_utc();
-        auto utc = Glib::DateTime::create_from_iso8601(iso8601, tz);
-        if (utc) {
-            //std::cout << "RealEarthProduct::latest parsed " << iso8601 << " to utc " <<  utc.format("%F-%T") << std::endl;
-            dateTime = utc.to_local();
-            //std::cout << "RealEarthProduct::latest local " <<  dateTime.format("%F-%T") << std::endl;
-            return true;
-        }
-        else {
-            std::cout << "RealEarthProduct::latest latest " << iso8601 << " not parsed" << std::endl;
-        }
+    gint64 latest;
+    if (get_latest_time(latest)) {
+        dateTime = Glib::DateTime::create_now_utc(latest).to_local();
+        return true;
     }
     return false;
 }
@@ -268,12 +483,47 @@ RealEarthProduct::set_legend(Glib::RefPtr<Gdk::Pixbuf>& legend) {
     m_signal_legend.emit(m_legend);
 }
 
+void
+RealEarthProduct::write(CatalogWriter& writer)
+{
+    WeatherProduct::write(writer);
+    writer.put_string(m_dataid);
+    writer.put_string(m_description);
+    writer.put_string(m_type);
+    writer.put_string(m_outputtype);
+    writer.put_u32(static_cast<guint32>(m_times.size()));
+    for (auto time : m_times) {
+        writer.put_i64(time);
+    }
+}
+
+bool
+RealEarthProduct::read(CatalogReader& reader)
+{
+    WeatherProduct::read(reader);
+    m_dataid = reader.get_string();
+    m_description = reader.get_string();
+    m_type = reader.get_string();
+    m_outputtype = reader.get_string();
+    m_times.clear();
+    auto count = reader.get_u32();
+    for (guint32 i = 0; i < count && reader.is_valid(); ++i) {
+        add_time(reader.get_i64());
+    }
+    return reader.is_valid();
+}
+
 RealEarth::RealEarth(WeatherConsumer* consumer, const Glib::ustring& base_url)
 : Weather(consumer)
 , m_base_url{base_url}
 {
 }
 
+RealEarth::~RealEarth()
+{
+    m_pollConnection.disconnect();
+}
+
 void
 RealEarth::inst_on_capabilities_callback(const Glib::ustring& error, int status, SpoonMessageDirect* message)
 {
@@ -281,6 +531,9 @@ RealEarth::inst_on_capabilities_callback(const Glib::ustring& error, int status,
         std::cout << "error capabilities " << error << std::endl;
         return;
     }
+    if (is_catalog_confirmed(status, message)) {
+        return;
+    }
     if (status != SpoonMessage::OK) {
         std::cout << "Error capabilities response " << status << std::endl;
         return;
@@ -290,31 +543,42 @@ RealEarth::inst_on_capabilities_callback(const Glib::ustring& error, int status,
         std::cout << "Error capabilities no data" << std::endl;
         return;
     }
-    try {
-        JsonHelper parser;
-        parser.load_data(data);
-        JsonArray* array = parser.get_root_array();
-        guint len = json_array_get_length(array);
-        m_products.clear();
-        for (guint i = 0; i < len; ++i) {
-            JsonObject* jsProduct = parser.get_array_object(array, i);
-            auto product = std::make_shared<RealEarthProduct>(jsProduct);
-            add_product(product);
+    // read products as they come, no need for a document
+    JsonPullParser parser(reinterpret_cast<const char*>(data->get_data()), data->size());
+    auto token = parser.next();
+    if (token == JsonPullParser::Token::BeginArray) {
+        begin_products();
+        while ((token = parser.next()) == JsonPullParser::Token::BeginObject) {
+            auto product = std::make_shared<RealEarthProduct>(parser);
+            if (!product->is_valid()) {
+                break;
+            }
+            merge_product(product);
         }
+        end_products(token == JsonPullParser::Token::EndArray);
+    }
+    if (token == JsonPullParser::Token::EndArray) {
+        save_catalog();
         m_signal_products_completed.emit();
+        prefetch_extents();
     }
-    catch (const JsonException& ex) {
+    else {
         Glib::ustring head(reinterpret_cast<const char*>(data->get_data()), std::min(data->size(), 64u));
-        std::cout << "Unable to parse " << head << "... " << ex.what() << std::endl;
+        std::cout << "Unable to parse " << head << "... " << parser.get_error() << std::endl;
     }
 }
 
 void
 RealEarth::capabilities()
 {
+    if (load_catalog()) {
+        prefetch_extents();
+        return;
+    }
     auto message = std::make_shared<SpoonMessageDirect>(get_base_url(), "api/products");
     message->addQuery("search", "global");
     message->addQuery("timespan", "-8h");
+    add_validators(*message);
     message->signal_receive().connect(sigc::mem_fun(*this, &RealEarth::inst_on_capabilities_callback));
     #ifdef WEATHER_DEBUG
     std::cout << "Weather::capabilities"
@@ -356,7 +620,7 @@ RealEarth::inst_on_latest_callback(const Glib::ustring& error, int status, Spoon
             auto prod = std::dynamic_pointer_cast<RealEarthProduct>(find_product(key));
             if (prod) {
                 if (!prod->is_latest(latest)) {
-                    request(key);  // as the given latest is not latest queue a request
+                    refresh(key);  // as the given latest is not latest queue a request
                 }
             }
         }
@@ -370,36 +634,91 @@ RealEarth::inst_on_latest_callback(const Glib::ustring& error, int status, Spoon
 }
 
 
-// queue a latest request and if it not do a request (this is not useful for products that are not currently displayed!)
+// watch product, the check is deferred so all checks of this cycle share one latest request
+//   (this is not useful for products that are not currently displayed!)
 void
 RealEarth::check_product(const Glib::ustring& weatherProductId)
 {
     if (!weatherProductId.empty() && !m_products.empty()) { // while not ready ignore request
-        auto product= std::make_shared<SpoonMessageDirect>(get_base_url(), "api/latest");
-        product->addQuery("products", weatherProductId);
-        product->signal_receive().connect(sigc::mem_fun(*this, &RealEarth::inst_on_latest_callback));
-        #ifdef WEATHER_DEBUG
-        std::cout << "RealEarth::check_product"
-                  << " url " << product->get_url() << std::endl;
-        #endif
-        getSpoonSession()->send(product);
+        m_watched.insert(weatherProductId);
+        m_checkRequested.insert(weatherProductId);
+        if (!m_pollConnection.connected()) {
+            m_pollConnection = Glib::signal_idle().connect([this] {
+                poll_latest();
+                return false;
+            });
+        }
+    }
+}
+
+void
+RealEarth::unwatch_product(const Glib::ustring& weatherProductId)
+{
+    m_watched.erase(weatherProductId);
+    m_checkRequested.erase(weatherProductId);
+}
+
+gint64
+RealEarth::get_next_check_sec(const Glib::ustring& weatherProductId)
+{
+    auto product = std::dynamic_pointer_cast<RealEarthProduct>(find_product(weatherProductId));
+    if (!product) {
+        return DEFAULT_CHECK_SEC;
+    }
+    auto sec = product->get_update_due_sec(Glib::DateTime::create_now_utc());
+    return std::max(sec, static_cast<gint64>(MIN_CHECK_SEC));
+}
+
+// ask for the latest of all watched products, that are expected to have changed,
+//   the products checked explicitly are always included
+void
+RealEarth::poll_latest()
+{
+    auto now = Glib::DateTime::create_now_utc();
+    Glib::ustring products;
+    for (auto& productId : m_watched) {
+        auto prod = std::dynamic_pointer_cast<RealEarthProduct>(find_product(productId));
+        if (prod
+         && (m_checkRequested.contains(productId)
+          || prod->is_update_due(now))) {
+            if (!products.empty()) {
+                products += ",";
+            }
+            products += productId;
+        }
     }
+    m_checkRequested.clear();
+    if (products.empty()) {
+        logMsg(psc::log::Level::Debug, "latest no product due");
+        return;
+    }
+    auto latest = std::make_shared<SpoonMessageDirect>(get_base_url(), "api/latest");
+    latest->addQuery("products", products);
+    latest->signal_receive().connect(sigc::mem_fun(*this, &RealEarth::inst_on_latest_callback));
+    #ifdef WEATHER_DEBUG
+    std::cout << "RealEarth::poll_latest"
+              << " url " << latest->get_url() << std::endl;
+    #endif
+    getSpoonSession()->send(latest);
 }
 
 void
-RealEarth::inst_on_extend_callback(const Glib::ustring& error, int status, SpoonMessageDirect* message)
+RealEarth::inst_on_extend_callback(const Glib::ustring& error, int status, SpoonMessageDirect* message, std::vector<Glib::ustring> productIds)
 {
     if (!error.empty()) {
         std::cout << "error extend " << error << std::endl;
+        extents_done(productIds);
         return;
     }
     if (status != SpoonMessage::OK) {
         std::cout << "Error extend response " << status << std::endl;
+        extents_done(productIds);
         return;
     }
     auto data = message->get_bytes();
     if (!data) {
         std::cout << "Error extend no data" << std::endl;
+        extents_done(productIds);
         return;
     }
     try {
@@ -425,26 +744,88 @@ RealEarth::inst_on_extend_callback(const Glib::ustring& error, int status, Spoon
         std::cout << "Unable to parse " << head << "... " << ex.what() << std::endl;
     }
 
-    // check if we have a queued request that may now work
-    if (!queued_product_request.empty()) {
-        auto prodReq = queued_product_request;
-        queued_product_request = "";
-        request(prodReq);
+    extents_done(productIds);
+}
+
+void
+RealEarth::extents_done(const std::vector<Glib::ustring>& productIds)
+{
+    for (auto& productId : productIds) {
+        m_extentRequested.erase(productId);
+        if (m_pendingRequests.erase(productId) > 0) {
+            auto product = std::dynamic_pointer_cast<RealEarthProduct>(find_product(productId));
+            if (product
+             && product->has_extent()) {
+                request(productId);     // may now work
+            }
+            else {
+                logMsg(psc::log::Level::Warn, Glib::ustring::sprintf("no extent for %s request dropped", productId));
+            }
+        }
     }
 }
 
 void
-RealEarth::get_extend(std::shared_ptr<RealEarthProduct>& product)
+RealEarth::send_extents(const std::vector<Glib::ustring>& productIds)
 {
+    Glib::ustring products;
+    for (auto& productId : productIds) {
+        if (!products.empty()) {
+            products += ",";
+        }
+        products += productId;
+        m_extentRequested.insert(productId);
+    }
     auto extend = std::make_shared<SpoonMessageDirect>(get_base_url(), "api/extents");
-    extend->addQuery("products", product->get_id());
-    extend->signal_receive().connect(sigc::mem_fun(*this, &RealEarth::inst_on_extend_callback));
+    extend->addQuery("products", products);
+    extend->signal_receive().connect(
+            sigc::bind(sigc::mem_fun(*this, &RealEarth::inst_on_extend_callback), productIds));
     #ifdef WEATHER_DEBUG
-    std::cout << "Weather::get_extend " << extend->get_url()  << std::endl;
+    std::cout << "Weather::send_extents " << extend->get_url()  << std::endl;
     #endif
     getSpoonSession()->send(extend);
 }
 
+void
+RealEarth::get_extend(std::shared_ptr<RealEarthProduct>& product)
+{
+    if (!m_extentRequested.contains(product->get_id())) {
+        send_extents({product->get_id()});
+    }
+}
+
+size_t
+RealEarth::get_pipeline_depth()
+{
+    return m_pendingRequests.size() + get_pending_images();
+}
+
+std::shared_ptr<WeatherProduct>
+RealEarth::create_product()
+{
+    return std::make_shared<RealEarthProduct>();
+}
+
+void
+RealEarth::prefetch_extents()
+{
+    std::vector<Glib::ustring> productIds;
+    for (auto& weatherProduct : m_products) {
+        auto product = std::dynamic_pointer_cast<RealEarthProduct>(weatherProduct);
+        if (product
+         && product->is_displayable()
+         && !product->has_extent()
+         && !m_extentRequested.contains(product->get_id())) {
+            productIds.push_back(product->get_id());
+        }
+    }
+    for (size_t start = 0; start < productIds.size(); start += EXTENTS_PER_REQUEST) {
+        auto end = std::min(productIds.size(), start + EXTENTS_PER_REQUEST);
+        send_extents(std::vector<Glib::ustring>(productIds.begin() + start, productIds.begin() + end));
+    }
+    logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("prefetch extents %zu", productIds.size()));
+}
+
 Glib::RefPtr<Gdk::Pixbuf>
 RealEarth::get_legend(std::shared_ptr<WeatherProduct>& product)
 {
@@ -452,15 +833,13 @@ RealEarth::get_legend(std::shared_ptr<WeatherProduct>& product)
     if (!legend) {
         auto earthProduct = std::dynamic_pointer_cast<RealEarthProduct>(product);
         if (earthProduct) {
-            auto legend = std::make_shared<SpoonMessageDirect>(get_base_url(), "api/legend");
-            legend->addQuery("products", product->get_id());
-            legend->signal_receive().connect(
-                    sigc::bind<std::shared_ptr<RealEarthProduct>>(
-                        sigc::mem_fun(*this, &RealEarth::inst_on_legend_callback), earthProduct));
+            auto legendReq = std::make_shared<SpoonMessageDirect>(get_base_url(), "api/legend");
+            legendReq->addQuery("products", product->get_id());
             #ifdef WEATHER_DEBUG
-            std::cout << "RealEarth::get_legend " << legend->get_url()  << std::endl;
+            std::cout << "RealEarth::get_legend " << legendReq->get_url()  << std::endl;
             #endif
-            getSpoonSession()->send(legend);
+            send_legend(legendReq, product);
+            legend = product->get_legend();     // if it was cached
         }
         else {
             std::cerr << "the passed instance for product was not of type RealEarthProduct" << std::endl;
@@ -567,8 +946,9 @@ RealEarth::request(const Glib::ustring& productId)
     if (!product) {
         return;
     }
-    if (product->get_extend_north() == 0.0) {
-        queued_product_request = product->get_id();
+    serve_last(productId);  // show what we know while fetching
+    if (!product->has_extent()) {
+        m_pendingRequests.insert(product->get_id());  // a repeated request is kept once
         #ifdef WEATHER_DEBUG
         std::cout << "RealEarth::request queued " << product->get_id() << std::endl;
         #endif
@@ -578,6 +958,10 @@ RealEarth::request(const Glib::ustring& productId)
     #ifdef WEATHER_DEBUG
     std::cout << "RealEarth::request request " << product->get_id() << std::endl;
     #endif
+    if (m_tiled) {
+        request_tiles(product);
+        return;
+    }
 
     int image_size = m_consumer->get_weather_image_size() ;
     int image_size2 = image_size / 2;
@@ -589,26 +973,102 @@ RealEarth::request(const Glib::ustring& productId)
                 ,0, 0
                 ,image_size2, image_size2
                 ,product);
-    getSpoonSession()->send(requestWN);
+    send_image(requestWN);
     auto requestWS = std::make_shared<RealEarthImageRequest>(this
                 ,product->get_extend_south(), -180.0
                 ,0.0, 0.0
                 ,0, image_size2
                 ,image_size2, image_size2
                 ,product);
-    getSpoonSession()->send(requestWS);
+    send_image(requestWS);
     auto requestEN = std::make_shared<RealEarthImageRequest>(this
                 ,0.0, 0.0
                 ,product->get_extend_north(), 180.0
                 ,image_size2, 0
                 ,image_size2, image_size2
                 ,product);
-    getSpoonSession()->send(requestEN);
+    send_image(requestEN);
     auto requestES = std::make_shared<RealEarthImageRequest>(this
                 ,product->get_extend_south(), 0.0
                 ,0.0, 180.0
                 ,image_size2, image_size2
                 ,image_size2, image_size2
                 ,product);
-    getSpoonSession()->send(requestES);
+    send_image(requestES);
+}
+
+int
+RealEarth::tile_zoom(int imageSize)
+{
+    int zoom = 0;
+    while ((TILE_SIZE << zoom) < imageSize
+        && zoom < MAX_TILE_ZOOM) {
+        ++zoom;
+    }
+    return zoom;
+}
+
+// the tiles are rendered by the server once for all clients,
+//   at the poles the mercator tiles give more rows than we need
+//   but that is what the grid offers
+void
+RealEarth::request_tiles(std::shared_ptr<RealEarthProduct>& product)
+{
+    int image_size = m_consumer->get_weather_image_size();
+    int native_size = image_size;     // the width of the world at native resolution
+    if (product->has_extent()) {
+        native_size = std::min(image_size, RealEarthImageRequest::native_pixels(360.0
+                    , product->getEastNorth().getLongitude() - product->getWestSouth().getLongitude()
+                    , product->get_extent_width()));
+    }
+    int zoom = tile_zoom(native_size);
+    int tiles = 1 << zoom;
+    CoordRefSystem crs84(CoordRefSystem::CRS_84);
+    CoordRefSystem mercator(CoordRefSystem::EPSG_3857);
+    double north = std::min(product->get_extend_north(), WeatherProduct::MAX_MERCATOR_LAT);
+    double south = std::max(product->get_extend_south(), -WeatherProduct::MAX_MERCATOR_LAT);
+    GeoBounds area{product->getWestSouth().getLongitude(), south
+                 , product->getEastNorth().getLongitude(), north, crs84};
+    area = area.convert(mercator);
+    auto toTile = [&] (double meters) {
+        double rel = meters / CoordRefSystem::EPSG3857_MAX;
+        return std::clamp(static_cast<int>(std::floor((rel + 1.0) / 2.0 * tiles)), 0, tiles - 1);
+    };
+    int col0 = toTile(area.getWestSouth().getLongitude());
+    int col1 = toTile(area.getEastNorth().getLongitude());
+    // rows count from north
+    int row0 = tiles - 1 - toTile(area.getEastNorth().getLatitude());
+    int row1 = tiles - 1 - toTile(area.getWestSouth().getLatitude());
+    auto toPixX = [&] (double lon) {
+        return std::clamp(static_cast<int>(std::round((crs84.toLinearLon(lon) + 1.0) / 2.0 * image_size)), 0, image_size);
+    };
+    auto toPixY = [&] (double lat) {
+        return std::clamp(static_cast<int>(std::round((1.0 - crs84.toLinearLat(lat)) / 2.0 * image_size)), 0, image_size);
+    };
+    int count = 0;
+    // as the session limits the connections per host send them all at once
+    for (int row = row0; row <= row1; ++row) {
+        for (int col = col0; col <= col1; ++col) {
+            auto tile = RealEarthTileRequest::tile_bounds(zoom, col, row).convert(crs84);
+            int pixX0 = toPixX(tile.getWestSouth().getLongitude());
+            int pixX1 = toPixX(tile.getEastNorth().getLongitude());
+            int pixY0 = toPixY(tile.getEastNorth().getLatitude());
+            int pixY1 = toPixY(tile.getWestSouth().getLatitude());
+            if (pixX1 <= pixX0 || pixY1 <= pixY0) {
+                continue;
+            }
+            // the target is snapped to pixels, so neighbouring tiles don't overlap
+            GeoBounds target{crs84.fromLinearLon(static_cast<double>(pixX0) / image_size * 2.0 - 1.0)
+                           , crs84.fromLinearLat(1.0 - static_cast<double>(pixY1) / image_size * 2.0)
+                           , crs84.fromLinearLon(static_cast<double>(pixX1) / image_size * 2.0 - 1.0)
+                           , crs84.fromLinearLat(1.0 - static_cast<double>(pixY0) / image_size * 2.0)
+                           , crs84};
+            auto request = std::make_shared<RealEarthTileRequest>(this, zoom, col, row
+                        , target, pixX0, pixY0, pixX1 - pixX0, pixY1 - pixY0
+                        , product);
+            send_image(request);
+            ++count;
+        }
+    }
+    logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("request tiles %s zoom %d tiles %d", product->get_id(), zoom, count));
 }
@@ -0,0 +1,155 @@
+/* -*- Mode: c++; c-basic-offset: 4; tab-width: 4; coding: utf-8; -*-  */
+/*
+ * Copyright (C) 2023 RPf
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <Log.hpp>
+#include <psc_format.hpp>
+
+#include "RefreshScheduler.hpp"
+#include "Weather.hpp"
+
+RefreshScheduler::RefreshScheduler(guint tickSec)
+: m_tickSec{std::max(tickSec, 1u)}
+, m_wheel(WHEEL_SLOTS)
+{
+    m_timer = Glib::signal_timeout().connect_seconds(sigc::mem_fun(*this, &RefreshScheduler::on_tick), m_tickSec);
+}
+
+RefreshScheduler::~RefreshScheduler()
+{
+    m_timer.disconnect();
+}
+
+std::string
+RefreshScheduler::key(Weather* service, const Glib::ustring& productId)
+{
+    return Glib::ustring::sprintf("%p|%s", static_cast<void*>(service), productId);
+}
+
+void
+RefreshScheduler::schedule(Entry&& entry, gint64 delaySec)
+{
+    if (!entry.displayed) {
+        delaySec <<= entry.backoff;
+        entry.backoff = std::min(entry.backoff + 1u, MAX_BACKOFF);
+    }
+    gint64 ticks = std::max(static_cast<gint64>(1), (delaySec + m_tickSec - 1) / m_tickSec);
+    entry.rounds = static_cast<guint>((ticks - 1) / WHEEL_SLOTS);
+    entry.slot = (m_cursor + static_cast<size_t>(ticks)) % WHEEL_SLOTS;
+    auto k = key(entry.service, entry.productId);
+    auto& list = m_wheel[entry.slot];
+    list.push_back(std::move(entry));
+    m_entries[k] = std::prev(list.end());
+}
+
+void
+RefreshScheduler::remove(const std::string& k)
+{
+    auto entry = m_entries.find(k);
+    if (entry != m_entries.end()) {
+        m_wheel[entry->second->slot].erase(entry->second);
+        m_entries.erase(entry);
+    }
+}
+
+void
+RefreshScheduler::watch(Weather* service, const Glib::ustring& productId, bool displayed)
+{
+    auto k = key(service, productId);
+    m_unwatched.erase(k);
+    if (m_entries.contains(k)) {
+        set_displayed(service, productId, displayed);
+        return;
+    }
+    Entry entry{service, productId, displayed, 0u, 0u, 0u};
+    schedule(std::move(entry), service->get_next_check_sec(productId));
+}
+
+void
+RefreshScheduler::unwatch(Weather* service, const Glib::ustring& productId)
+{
+    auto k = key(service, productId);
+    remove(k);
+    if (m_checking.contains(k)) {   // not in wheel while checked
+        m_unwatched.insert(k);
+    }
+    service->unwatch_product(productId);
+}
+
+void
+RefreshScheduler::set_displayed(Weather* service, const Glib::ustring& productId, bool displayed)
+{
+    auto k = key(service, productId);
+    auto entry = m_entries.find(k);
+    if (entry == m_entries.end()
+     || entry->second->displayed == displayed) {
+        return;
+    }
+    Entry moved = *entry->second;
+    remove(k);
+    moved.displayed = displayed;
+    moved.backoff = 0u;
+    if (displayed) {    // it may be waiting for a long time, check soon
+        schedule(std::move(moved), 0);
+    }
+    else {
+        schedule(std::move(moved), service->get_next_check_sec(productId));
+    }
+}
+
+bool
+RefreshScheduler::on_tick()
+{
+    m_cursor = (m_cursor + 1) % WHEEL_SLOTS;
+    std::vector<Entry> due;
+    auto& list = m_wheel[m_cursor];
+    for (auto iter = list.begin(); iter != list.end(); ) {
+        if (iter->rounds > 0) {
+            --iter->rounds;
+            ++iter;
+        }
+        else {
+            auto k = key(iter->service, iter->productId);
+            m_entries.erase(k);
+            m_checking.insert(k);
+            due.push_back(std::move(*iter));
+            iter = list.erase(iter);
+        }
+    }
+    // check after the wheel is consistent, as services may (un)watch
+    for (auto& entry : due) {
+        auto k = key(entry.service, entry.productId);
+        if (m_unwatched.contains(k)) {  // by a previous check
+            continue;
+        }
+        ++m_checks;
+        entry.service->check_product(entry.productId);
+        if (m_unwatched.contains(k)         // by consumer while checking
+         || m_entries.contains(k)) {        // watched again
+            continue;
+        }
+        auto delaySec = entry.service->get_next_check_sec(entry.productId);
+        psc::log::Log::logAdd(psc::log::Level::Debug, [&] {
+            return psc::fmt::format("Scheduler checked {} next {}s", entry.productId, delaySec);
+        });
+        schedule(std::move(entry), delaySec);
+    }
+    m_checking.clear();
+    m_unwatched.clear();
+    return true;
+}
@@ -0,0 +1,173 @@
+/* -*- Mode: c++; c-basic-offset: 4; tab-width: 4; coding: utf-8; -*-  */
+/*
+ * Copyright (C) 2023 RPf
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <Log.hpp>
+#include <psc_format.hpp>
+
+#include "Reprojection.hpp"
+#include "WorkerPool.hpp"
+
+Reprojection::Reprojection(const GeoBounds& source, int srcWidth, int srcHeight
+               , const GeoBounds& target, int tgtWidth, int tgtHeight)
+: m_srcWidth{srcWidth}
+, m_srcHeight{srcHeight}
+, m_tgtWidth{tgtWidth}
+, m_tgtHeight{tgtHeight}
+{
+    build_tables(source, target);
+}
+
+std::shared_ptr<Reprojection>
+Reprojection::create(const GeoBounds& source, int srcWidth, int srcHeight
+               , const GeoBounds& target, int tgtWidth, int tgtHeight)
+{
+    static std::mutex cacheMutex;
+    static std::map<Glib::ustring, std::shared_ptr<Reprojection>> cache;
+    auto key = Glib::ustring::sprintf("%s %s %dx%d %s %dx%d"
+                    , source.getWestSouth().getCoordRefSystem().identifier()
+                    , source.printValue(','), srcWidth, srcHeight
+                    , target.printValue(','), tgtWidth, tgtHeight);
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto entry = cache.find(key);
+    if (entry != cache.end()) {
+        return entry->second;
+    }
+    if (cache.size() >= MAX_CACHED) {  // keep it simple, the usual set will be back soon
+        cache.clear();
+    }
+    auto reprojection = std::make_shared<Reprojection>(source, srcWidth, srcHeight, target, tgtWidth, tgtHeight);
+    cache.insert(std::make_pair(key, reprojection));
+    return reprojection;
+}
+
+int
+Reprojection::index(double value, double start, double end, int size)
+{
+    if (!std::isfinite(value)
+     || end == start) {
+        return -1;
+    }
+    double rel = (value - start) / (end - start);
+    if (rel < 0.0 || rel >= 1.0) {
+        return -1;  // outside of source
+    }
+    return std::min(static_cast<int>(rel * size), size - 1);
+}
+
+void
+Reprojection::build_tables(const GeoBounds& source, const GeoBounds& target)
+{
+    auto srcCrs = source.getWestSouth().getCoordRefSystem();
+    double srcWest = source.getWestSouth().getLongitude();
+    double srcEast = source.getEastNorth().getLongitude();
+    double srcSouth = source.getWestSouth().getLatitude();
+    double srcNorth = source.getEastNorth().getLatitude();
+    auto tgtCrs = target.getWestSouth().getCoordRefSystem();
+    double tgtWest = tgtCrs.toLinearLon(target.getWestSouth().getLongitude());
+    double tgtEast = tgtCrs.toLinearLon(target.getEastNorth().getLongitude());
+    double tgtSouth = tgtCrs.toLinearLat(target.getWestSouth().getLatitude());
+    double tgtNorth = tgtCrs.toLinearLat(target.getEastNorth().getLatitude());
+    m_rows.resize(m_tgtHeight);
+    for (int y = 0; y < m_tgtHeight; ++y) {
+        // use pixel center, image rows go from north to south
+        double linLat = tgtNorth - (static_cast<double>(y) + 0.5) / m_tgtHeight * (tgtNorth - tgtSouth);
+        double srcLat = srcCrs.fromLinearLat(linLat);
+        m_rows[y] = index(srcLat, srcNorth, srcSouth, m_srcHeight);
+    }
+    m_columns.resize(m_tgtWidth);
+    m_identityColumns = m_tgtWidth == m_srcWidth;
+    for (int x = 0; x < m_tgtWidth; ++x) {
+        double linLon = tgtWest + (static_cast<double>(x) + 0.5) / m_tgtWidth * (tgtEast - tgtWest);
+        double srcLon = srcCrs.fromLinearLon(linLon);
+        m_columns[x] = index(srcLon, srcWest, srcEast, m_srcWidth);
+        if (m_columns[x] != x) {
+            m_identityColumns = false;
+        }
+    }
+}
+
+void
+Reprojection::map_rows(const PixelArea& src, const PixelArea& target, int startRow, int endRow)
+{
+    const int channels = std::min(src.channels, target.channels);
+    const bool addAlpha = target.channels == 4 && src.channels < 4;
+    for (int y = startRow; y < endRow; ++y) {
+        guint8* tgtRow = target.pixels + static_cast<gsize>(y) * target.rowstride;
+        int srcY = m_rows[y];
+        if (srcY < 0) {
+            std::memset(tgtRow, 0, static_cast<gsize>(target.width) * target.channels);  // transp. black
+            continue;
+        }
+        const guint8* srcRow = src.pixels + static_cast<gsize>(srcY) * src.rowstride;
+        if (m_identityColumns && src.channels == target.channels) {
+            std::memcpy(tgtRow, srcRow, static_cast<gsize>(target.width) * target.channels);
+            continue;
+        }
+        for (int x = 0; x < target.width; ++x) {
+            guint8* tgtPix = tgtRow + x * target.channels;
+            int srcX = m_columns[x];
+            if (srcX < 0) {
+                std::memset(tgtPix, 0, target.channels);
+                continue;
+            }
+            const guint8* srcPix = srcRow + srcX * src.channels;
+            std::memcpy(tgtPix, srcPix, channels);
+            if (addAlpha) {
+                tgtPix[3] = 0xff;
+            }
+        }
+    }
+}
+
+void
+Reprojection::map(const Glib::RefPtr<Gdk::Pixbuf>& src, Glib::RefPtr<Gdk::Pixbuf>& target, int pixX, int pixY)
+{
+    if (src->get_width() != m_srcWidth
+     || src->get_height() != m_srcHeight
+     || src->get_bits_per_sample() != 8
+     || target->get_bits_per_sample() != 8) {
+        psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
+            return psc::fmt::format("Reprojection source {}x{} expected {}x{}"
+                                   , src->get_width(), src->get_height(), m_srcWidth, m_srcHeight);
+        });
+        return;
+    }
+    if (pixX < 0 || pixY < 0
+     || pixX >= target->get_width()
+     || pixY >= target->get_height()) {
+        return;
+    }
+    int rows = std::min(m_tgtHeight, target->get_height() - pixY);
+    // resolve pixels here, the workers shoud not touch the pixbufs
+    PixelArea srcArea{const_cast<guint8*>(src->get_pixels()), src->get_rowstride(), src->get_n_channels(), m_srcWidth};
+    PixelArea tgtArea{target->get_pixels(), target->get_rowstride(), target->get_n_channels()
+                        , std::min(m_tgtWidth, target->get_width() - pixX)};
+    tgtArea.pixels += static_cast<gsize>(pixY) * tgtArea.rowstride + static_cast<gsize>(pixX) * tgtArea.channels;
+    auto& pool = WorkerPool::get_default();
+    int stripRows = std::max(MIN_STRIP_ROWS, rows / static_cast<int>(pool.get_size()) + 1);
+    unsigned strips = static_cast<unsigned>((rows + stripRows - 1) / stripRows);
+    pool.run_parallel(strips, [&] (unsigned strip) {
+        int start = static_cast<int>(strip) * stripRows;
+        int end = std::min(start + stripRows, rows);
+        map_rows(srcArea, tgtArea, start, end);
+    });
+}
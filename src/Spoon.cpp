@@ -23,8 +23,11 @@
 
 #include "Spoon.hpp"
 
-SpoonSession::SpoonSession(const Glib::ustring& user_agent)
-: m_session{soup_session_new()}
+SpoonSession::SpoonSession(const Glib::ustring& user_agent, int maxConnsPerHost, int maxConns)
+: m_session{soup_session_new_with_options(   // these are construct only
+                  "max-conns-per-host", maxConnsPerHost > 0 ? maxConnsPerHost : SOUP_MAX_CONNS_PER_HOST
+                , "max-conns", maxConns > 0 ? maxConns : SOUP_MAX_CONNS
+                , nullptr)}
 {
     #ifdef SPOON_DEBUG_INTERNAL
     SoupLogger* log = soup_logger_new(SOUP_LOGGER_LOG_MINIMAL);
@@ -83,6 +86,51 @@ SpoonMessage::addQuery(const Glib::ustring& name, const Glib::ustring& value)
     m_query.insert(std::make_pair(name, value));
 }
 
+void
+SpoonMessage::addHeader(const Glib::ustring& name, const Glib::ustring& value)
+{
+    m_headers.insert(std::make_pair(name, value));
+}
+
+Glib::ustring
+SpoonMessage::get_response_header(const Glib::ustring& name)
+{
+    auto entry = m_responseHeaders.find(name.lowercase());
+    if (entry != m_responseHeaders.end()) {
+        return entry->second;
+    }
+    return Glib::ustring();
+}
+
+SoupMessage*
+SpoonMessage::create_message()
+{
+    SoupMessage* msg = soup_message_new(get_method(), get_url().c_str());
+    if (msg) {
+        SoupMessageHeaders* headers = soup_message_get_request_headers(msg);
+        for (auto& entry : m_headers) {
+            soup_message_headers_append(headers, entry.first.c_str(), entry.second.c_str());
+        }
+    }
+    return msg;
+}
+
+void
+SpoonMessage::set_response_headers(SoupMessage* msg)
+{
+    m_responseHeaders.clear();
+    SoupMessageHeaders* headers = soup_message_get_response_headers(msg);
+    if (headers) {
+        SoupMessageHeadersIter iter;
+        soup_message_headers_iter_init(&iter, headers);
+        const char* name;
+        const char* value;
+        while (soup_message_headers_iter_next(&iter, &name, &value)) {
+            m_responseHeaders.insert(std::make_pair(Glib::ustring(name).lowercase(), Glib::ustring(value)));
+        }
+    }
+}
+
 Glib::ustring
 SpoonMessage::get_url()
 {
@@ -244,6 +292,7 @@ SpoonMessageDirect::callback(GObject *source, GAsyncResult *result, gpointer use
         if (spoonmsg) {
             SoupMessage* msg = soup_session_get_async_result_message(SOUP_SESSION(source), result);
             status = soup_message_get_status(msg);
+            spoonmsg->set_response_headers(msg);
             psc::log::Log::logAdd(psc::log::Level::Debug, [&] {
                 return psc::fmt::format("Got {} url {}", static_cast<int>(status), spoonmsg->get_url());
             });
@@ -255,7 +304,7 @@ SpoonMessageDirect::callback(GObject *source, GAsyncResult *result, gpointer use
 void
 SpoonMessageDirect::send()
 {
-    SoupMessage* msg = soup_message_new(get_method(), get_url().c_str());
+    SoupMessage* msg = create_message();
     GCancellable* cancellable = get_cancelable();
     psc::log::Log::logAdd(psc::log::Level::Debug, [&] {
         return psc::fmt::format("send {} url {} msg {}", get_method(), get_url(), static_cast<void*>(msg));
@@ -322,6 +371,7 @@ SpoonMessageStream::callback(GObject *source, GAsyncResult *result, gpointer use
         if (spoonmsg) {
             SoupMessage* msg = soup_session_get_async_result_message(SOUP_SESSION(source), result);
             status = soup_message_get_status(msg);
+            spoonmsg->set_response_headers(msg);
             psc::log::Log::logAdd(psc::log::Level::Debug, [&] {
                 return psc::fmt::format("Got {} url {} stream {}", static_cast<int>(status), spoonmsg->get_url(), static_cast<void*>(stream));
             });
@@ -336,7 +386,7 @@ SpoonMessageStream::callback(GObject *source, GAsyncResult *result, gpointer use
 void
 SpoonMessageStream::send()
 {
-    SoupMessage* msg = soup_message_new(get_method(), get_url().c_str());
+    SoupMessage* msg = create_message();
     psc::log::Log::logAdd(psc::log::Level::Debug, [&] {
         return psc::fmt::format("send {} url {} msg {}", get_method(), get_url(), static_cast<void*>(msg));
     });
@@ -0,0 +1,391 @@
+/* -*- Mode: c++; c-basic-offset: 4; tab-width: 4; coding: utf-8; -*-  */
+/*
+ * Copyright (C) 2023 RPf
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <glib/gstdio.h>
+#include <Log.hpp>
+#include <psc_format.hpp>
+
+#include "TileStore.hpp"
+
+TileKey::TileKey(const Glib::ustring& service, const Glib::ustring& productId, const Glib::ustring& time
+            , const GeoBounds& bounds, int width, int height)
+: m_service{service}
+, m_productId{productId}
+, m_time{time}
+, m_bounds{bounds}
+, m_width{width}
+, m_height{height}
+{
+}
+
+Glib::ustring
+TileKey::to_string() const
+{
+    return Glib::ustring::sprintf("%s|%s|%s|%s|%s|%dx%d"
+            , m_service
+            , m_productId
+            , m_time
+            , m_bounds.printValue(',')
+            , m_bounds.getWestSouth().getCoordRefSystem().identifier()
+            , m_width, m_height);
+}
+
+Glib::ustring
+TileKey::slot() const
+{
+    return Glib::ustring::sprintf("%s|%s|%s|%s|%dx%d"
+            , m_service
+            , m_productId
+            , m_bounds.printValue(',')
+            , m_bounds.getWestSouth().getCoordRefSystem().identifier()
+            , m_width, m_height);
+}
+
+std::string
+TileKey::hash() const
+{
+    auto key = to_string();
+    return TileStore::sha256(key.data(), key.bytes());
+}
+
+TileStore::TileStore(const std::string& dir)
+: m_dir{dir}
+{
+    for (auto sub : {"objects", "keys", "last"}) {
+        auto path = Glib::build_filename(m_dir, sub);
+        if (g_mkdir_with_parents(path.c_str(), 0700) != 0) {
+            psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
+                return psc::fmt::format("TileStore unable to create {}", path);
+            });
+        }
+    }
+}
+
+std::shared_ptr<TileStore>
+TileStore::create_default()
+{
+    auto dir = Glib::build_filename(Glib::get_user_cache_dir(), "geodata", "tiles");
+    return std::make_shared<TileStore>(dir);
+}
+
+std::string
+TileStore::sha256(const void* data, gsize len)
+{
+    gchar* sum = g_compute_checksum_for_data(G_CHECKSUM_SHA256, static_cast<const guchar*>(data), len);
+    std::string ret{sum};
+    g_free(sum);
+    return ret;
+}
+
+std::string
+TileStore::object_path(const std::string& contentHash)
+{
+    return Glib::build_filename(m_dir, "objects", contentHash + ".raw");
+}
+
+std::string
+TileStore::key_path(const std::string& keyHash)
+{
+    return Glib::build_filename(m_dir, "keys", keyHash);
+}
+
+std::string
+TileStore::last_path(const Glib::ustring& service, const Glib::ustring& productId)
+{
+    Glib::ustring product = service + "|" + productId;
+    return Glib::build_filename(m_dir, "last", sha256(product.data(), product.bytes()) + ".ini");
+}
+
+static void
+unmap_tile(guchar* pixels, gpointer data)
+{
+    g_mapped_file_unref(static_cast<GMappedFile*>(data));
+}
+
+Glib::RefPtr<Gdk::Pixbuf>
+TileStore::lookup(const TileKey& key)
+{
+    if (!key.is_cacheable()) {
+        return Glib::RefPtr<Gdk::Pixbuf>();
+    }
+    return lookup_hash(key.hash());
+}
+
+Glib::RefPtr<Gdk::Pixbuf>
+TileStore::lookup_hash(const std::string& keyHash)
+{
+    Glib::RefPtr<Gdk::Pixbuf> pix;
+    auto keyPath = key_path(keyHash);
+    if (!Glib::file_test(keyPath, Glib::FileTest::EXISTS)) {
+        return pix;
+    }
+    try {
+        auto contentHash = Glib::file_get_contents(keyPath);
+        auto objPath = object_path(contentHash);
+        GError* error = nullptr;
+        GMappedFile* mapped = g_mapped_file_new(objPath.c_str(), FALSE, &error);
+        if (error) {
+            psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
+                return psc::fmt::format("TileStore unable to map {} {}", objPath, error->message);
+            });
+            g_error_free(error);
+            return pix;
+        }
+        auto len = g_mapped_file_get_length(mapped);
+        auto data = reinterpret_cast<const guint8*>(g_mapped_file_get_contents(mapped));
+        Header header;
+        if (len >= sizeof(Header)) {
+            std::memcpy(&header, data, sizeof(Header));
+        }
+        if (len < sizeof(Header)
+         || header.magic != MAGIC
+         || header.version != VERSION
+         || header.width <= 0
+         || header.height <= 0
+         || (header.n_channels != 3 && header.n_channels != 4)
+         || len < sizeof(Header) + static_cast<gsize>(header.rowstride) * header.height) {
+            psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
+                return psc::fmt::format("TileStore invalid object {} len {}", objPath, len);
+            });
+            g_mapped_file_unref(mapped);
+            return pix;
+        }
+        // the pixbuf keeps the mapping until it is no longer used
+        GdkPixbuf* gpix = gdk_pixbuf_new_from_data(data + sizeof(Header)
+                            , GDK_COLORSPACE_RGB, header.n_channels == 4, 8
+                            , header.width, header.height, header.rowstride
+                            , unmap_tile, mapped);
+        pix = Glib::wrap(gpix);
+    }
+    catch (const Glib::Error& ex) {
+        psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
+            return psc::fmt::format("TileStore unable to read key {} {}", keyHash, ex.what());
+        });
+    }
+    return pix;
+}
+
+void
+TileStore::store(const TileKey& key, int size, const Glib::RefPtr<Gdk::Pixbuf>& pix, int x, int y, int width, int height)
+{
+    if (!pix
+     || pix->get_bits_per_sample() != 8
+     || width <= 0 || height <= 0
+     || x < 0 || y < 0
+     || x + width > pix->get_width()
+     || y + height > pix->get_height()) {
+        return;
+    }
+    Header header{};
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.width = width;
+    header.height = height;
+    header.n_channels = pix->get_n_channels();
+    header.rowstride = width * header.n_channels;   // packed, the source may use padding
+    std::string content;
+    content.resize(sizeof(Header) + static_cast<gsize>(header.rowstride) * height);
+    std::memcpy(content.data(), &header, sizeof(Header));
+    const guint8* src = pix->get_pixels() + y * pix->get_rowstride() + x * header.n_channels;
+    auto dst = content.data() + sizeof(Header);
+    for (int row = 0; row < height; ++row) {
+        std::memcpy(dst, src, header.rowstride);
+        src += pix->get_rowstride();
+        dst += header.rowstride;
+    }
+    // the header is part of the object, same pixels with a different geometry are not the same
+    auto contentHash = sha256(content.data(), content.size());
+    auto keyHash = key.hash();
+    try {
+        auto objPath = object_path(contentHash);
+        if (!Glib::file_test(objPath, Glib::FileTest::EXISTS)) {   // deduplicate
+            Glib::file_set_contents(objPath, content.data(), content.size());
+        }
+        Glib::file_set_contents(key_path(keyHash), contentHash.data(), contentHash.size());
+        set_last(key, keyHash, x, y, size);
+    }
+    catch (const Glib::Error& ex) {
+        psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
+            return psc::fmt::format("TileStore unable to store {} {}", key.to_string(), ex.what());
+        });
+    }
+}
+
+void
+TileStore::set_last(const TileKey& key, const std::string& keyHash, int x, int y, int size)
+{
+    auto path = last_path(key.get_service(), key.get_product_id());
+    auto keyFile = Glib::KeyFile::create();
+    try {
+        if (Glib::file_test(path, Glib::FileTest::EXISTS)) {
+            keyFile->load_from_file(path);
+        }
+    }
+    catch (const Glib::Error& ex) {
+        psc::log::Log::logAdd(psc::log::Level::Debug, [&] {
+            return psc::fmt::format("TileStore ignoring last {} {}", path, ex.what());
+        });
+    }
+    if (!keyFile->has_group("composite")
+     || keyFile->get_integer("composite", "size") != size) {
+        keyFile = Glib::KeyFile::create();     // start over, tiles of a different size won't fit
+        keyFile->set_integer("composite", "size", size);
+    }
+    // a slot is identified by its position, a newer time replaces the tile
+    auto group = Glib::ustring::sprintf("tile_%d_%d", x, y);
+    keyFile->set_string(group, "key", keyHash);
+    keyFile->set_integer(group, "x", x);
+    keyFile->set_integer(group, "y", y);
+    keyFile->save_to_file(path);
+}
+
+std::vector<TilePlacement>
+TileStore::get_last(const Glib::ustring& service, const Glib::ustring& productId, int size)
+{
+    std::vector<TilePlacement> tiles;
+    auto path = last_path(service, productId);
+    if (!Glib::file_test(path, Glib::FileTest::EXISTS)) {
+        return tiles;
+    }
+    try {
+        auto keyFile = Glib::KeyFile::create();
+        keyFile->load_from_file(path);
+        if (keyFile->get_integer("composite", "size") == size) {
+            for (auto& group : keyFile->get_groups()) {
+                if (group != "composite") {
+                    TilePlacement tile;
+                    tile.keyHash = keyFile->get_string(group, "key");
+                    tile.pixX = keyFile->get_integer(group, "x");
+                    tile.pixY = keyFile->get_integer(group, "y");
+                    tiles.push_back(tile);
+                }
+            }
+        }
+    }
+    catch (const Glib::Error& ex) {
+        psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
+            return psc::fmt::format("TileStore unable to read last {} {}", path, ex.what());
+        });
+        tiles.clear();
+    }
+    return tiles;
+}
+
+void
+TileStore::prune(gint64 maxAgeSec)
+{
+    gint64 limit = g_get_real_time() / G_USEC_PER_SEC - maxAgeSec;
+    std::set<std::string> referenced;
+    try {
+        auto keysDir = Glib::build_filename(m_dir, "keys");
+        Glib::Dir keys(keysDir);
+        for (auto name : keys) {
+            auto path = Glib::build_filename(keysDir, name);
+            GStatBuf stat;
+            if (g_stat(path.c_str(), &stat) == 0
+             && stat.st_mtime < limit) {
+                g_unlink(path.c_str());
+            }
+            else {
+                referenced.insert(Glib::file_get_contents(path));
+            }
+        }
+    }
+    catch (const Glib::Error& ex) {
+        psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
+            return psc::fmt::format("TileStore prune {}", ex.what());
+        });
+        return;     // don't remove what may be referenced
+    }
+    remove_unreferenced(referenced);
+}
+
+void
+TileStore::prune_size(gint64 maxBytes)
+{
+    struct Entry {
+        std::string path;
+        std::string contentHash;
+        gint64 mtime;
+    };
+    std::vector<Entry> entries;
+    try {
+        auto keysDir = Glib::build_filename(m_dir, "keys");
+        Glib::Dir keys(keysDir);
+        for (auto name : keys) {
+            auto path = Glib::build_filename(keysDir, name);
+            GStatBuf stat;
+            if (g_stat(path.c_str(), &stat) == 0) {
+                entries.push_back(Entry{path, Glib::file_get_contents(path), static_cast<gint64>(stat.st_mtime)});
+            }
+        }
+    }
+    catch (const Glib::Error& ex) {
+        psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
+            return psc::fmt::format("TileStore prune size {}", ex.what());
+        });
+        return;
+    }
+    // keep the newest, a shared object counts once
+    std::sort(entries.begin(), entries.end(), [] (const Entry& a, const Entry& b) {
+        return a.mtime > b.mtime;
+    });
+    std::set<std::string> referenced;
+    gint64 total{0};
+    for (auto& entry : entries) {
+        if (!referenced.contains(entry.contentHash)) {
+            GStatBuf stat;
+            auto objPath = object_path(entry.contentHash);
+            gint64 size = g_stat(objPath.c_str(), &stat) == 0 ? static_cast<gint64>(stat.st_size) : 0;
+            if (total + size > maxBytes) {
+                g_unlink(entry.path.c_str());
+                continue;
+            }
+            total += size;
+            referenced.insert(entry.contentHash);
+        }
+    }
+    remove_unreferenced(referenced);
+    psc::log::Log::logAdd(psc::log::Level::Debug, [&] {
+        return psc::fmt::format("TileStore kept {} bytes", total);
+    });
+}
+
+void
+TileStore::remove_unreferenced(const std::set<std::string>& referenced)
+{
+    try {
+        auto objectsDir = Glib::build_filename(m_dir, "objects");
+        Glib::Dir objects(objectsDir);
+        for (auto name : objects) {
+            auto contentHash = name.substr(0, name.find('.'));
+            if (!referenced.contains(contentHash)) {
+                auto path = Glib::build_filename(objectsDir, name);
+                g_unlink(path.c_str());
+            }
+        }
+    }
+    catch (const Glib::Error& ex) {
+        psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
+            return psc::fmt::format("TileStore remove objects {}", ex.what());
+        });
+    }
+}
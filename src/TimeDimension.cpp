@@ -0,0 +1,333 @@
+/* -*- Mode: c++; c-basic-offset: 4; tab-width: 4; coding: utf-8; -*-  */
+/*
+ * Copyright (C) 2023 RPf
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <optional>
+#include <StringUtils.hpp>
+
+#include "TimeDimension.hpp"
+
+void
+TimeDimension::clear()
+{
+    m_segments.clear();
+}
+
+bool
+TimeDimension::parse(const Glib::ustring& dimension)
+{
+    clear();
+    std::vector<gint64> values;
+    Glib::ustring compact;  // values may be formatted by line
+    for (auto c : dimension) {
+        if (!g_unichar_isspace(c)) {
+            compact += c;
+        }
+    }
+    std::vector<Glib::ustring> items;
+    StringUtils::split(compact, ',', items);
+    for (auto& item : items) {
+        std::vector<Glib::ustring> parts;
+        StringUtils::split(item, '/', parts);
+        gint64 start, end;
+        if (parts.size() == 1) {
+            if (parse_time(parts[0], start)) {
+                values.push_back(start);
+            }
+        }
+        else if (parts.size() >= 2
+              && parse_time(parts[0], start)
+              && parse_time(parts[1], end)) {
+            int period = parts.size() >= 3 ? parse_period(parts[2]) : 0;
+            if (period > 0 && end > start) {
+                end = start + (end - start) / period * period;    // keep end on the grid
+                m_segments.emplace_back(Segment{start, end, period});
+            }
+            else {  // no usable period, use what we know
+                values.push_back(start);
+                values.push_back(end);
+            }
+        }
+    }
+    add_values(values);
+    std::sort(m_segments.begin(), m_segments.end(), [] (const Segment& a, const Segment& b) {
+        return a.start < b.start;
+    });
+    return !empty();
+}
+
+// join runs of evenly spaced values, so a regular list takes the space of a interval
+void
+TimeDimension::add_values(std::vector<gint64>& values)
+{
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    std::optional<Segment> run;
+    for (auto value : values) {
+        if (run && run->period == 0) {
+            run->period = value - run->start;
+            run->end = value;
+        }
+        else if (run && value - run->end == run->period) {
+            run->end = value;
+        }
+        else {
+            if (run) {
+                m_segments.push_back(*run);
+            }
+            run = Segment{value, value, 0};
+        }
+    }
+    if (run) {
+        m_segments.push_back(*run);
+    }
+}
+
+gint64
+TimeDimension::get_start() const
+{
+    return empty() ? 0 : m_segments.front().start;
+}
+
+gint64
+TimeDimension::get_end() const
+{
+    return empty() ? 0 : m_segments.back().end;
+}
+
+gint64
+TimeDimension::get_count() const
+{
+    gint64 count{0};
+    for (auto& segment : m_segments) {
+        count += segment.period > 0 ? (segment.end - segment.start) / segment.period + 1 : 1;
+    }
+    return count;
+}
+
+gint64
+TimeDimension::get_last_period() const
+{
+    if (empty()) {
+        return 0;
+    }
+    auto& last = m_segments.back();
+    if (last.period > 0) {
+        return last.period;
+    }
+    if (m_segments.size() >= 2) {
+        return last.start - m_segments[m_segments.size() - 2].end;
+    }
+    return 0;
+}
+
+std::vector<TimeDimension::Segment>::const_iterator
+TimeDimension::find_segment(gint64 time) const
+{
+    auto next = std::upper_bound(m_segments.begin(), m_segments.end(), time, [] (gint64 time, const Segment& segment) {
+        return time < segment.start;
+    });
+    if (next == m_segments.begin()) {
+        return m_segments.end();
+    }
+    return std::prev(next);
+}
+
+gint64
+TimeDimension::floor_value(const Segment& segment, gint64 time)
+{
+    if (time >= segment.end) {
+        return segment.end;
+    }
+    if (segment.period <= 0) {
+        return segment.start;
+    }
+    return segment.start + (time - segment.start) / segment.period * segment.period;
+}
+
+bool
+TimeDimension::find_latest(gint64 limit, gint64& value) const
+{
+    auto segment = find_segment(limit);
+    if (segment == m_segments.end()) {
+        return false;
+    }
+    value = floor_value(*segment, limit);
+    return true;
+}
+
+bool
+TimeDimension::find_nearest(gint64 time, gint64& value) const
+{
+    if (empty()) {
+        return false;
+    }
+    auto segment = find_segment(time);
+    if (segment == m_segments.end()) {
+        value = m_segments.front().start;
+        return true;
+    }
+    gint64 below = floor_value(*segment, time);
+    std::optional<gint64> above;
+    if (below < time) {
+        if (time < segment->end) {
+            above = below + segment->period;
+        }
+        else if (std::next(segment) != m_segments.end()) {
+            above = std::next(segment)->start;
+        }
+    }
+    value = above && *above - time < time - below ? *above : below;
+    return true;
+}
+
+std::vector<gint64>
+TimeDimension::get_values(gint64 from, gint64 to, size_t max) const
+{
+    std::vector<gint64> values;
+    auto segment = find_segment(from);
+    if (segment == m_segments.end()) {
+        segment = m_segments.begin();
+    }
+    for (; segment != m_segments.end() && segment->start <= to; ++segment) {
+        gint64 value = segment->start;
+        if (value < from && segment->period > 0) {    // first on grid >= from
+            value += (from - value + segment->period - 1) / segment->period * segment->period;
+        }
+        gint64 last = std::min(segment->end, to);
+        while (value <= last && values.size() < max) {
+            if (value >= from) {
+                values.push_back(value);
+            }
+            if (segment->period <= 0) {
+                break;
+            }
+            value += segment->period;
+        }
+    }
+    return values;
+}
+
+void
+TimeDimension::extend(gint64 time)
+{
+    if (!empty() && time <= get_end()) {
+        return;
+    }
+    if (!empty()) {
+        auto& last = m_segments.back();
+        if (last.period == 0) {
+            last.period = time - last.end;
+            last.end = time;
+            return;
+        }
+        if (time - last.end == last.period) {
+            last.end = time;
+            return;
+        }
+    }
+    m_segments.emplace_back(Segment{time, time, 0});
+}
+
+bool
+TimeDimension::parse_time(const Glib::ustring& iso8601, gint64& value)
+{
+    auto text = iso8601;
+    if (text.find('T') == text.npos) {  // just a date, that is not accepted by glib
+        text += "T00:00:00Z";
+    }
+    auto tz = Glib::TimeZone::create_utc();
+    auto dateTime = Glib::DateTime::create_from_iso8601(text, tz);
+    if (!dateTime) {
+        return false;
+    }
+    value = dateTime.to_unix();
+    return true;
+}
+
+Glib::DateTime
+TimeDimension::to_date_time(gint64 value)
+{
+    return Glib::DateTime::create_now_utc(value);
+}
+
+/*
+D.3 periods
+An ISO 8601 Period is used to indicate the time resolution of the available data. The ISO 8601 format for
+representing a period of time is used to represent the resolution: Designator P (for Period), number of years Y,
+months M, days D, time designator T, number of hours H, minutes M, seconds S. Unneeded elements may be
+omitted.
+EXAMPLE 1 P1Y — 1 year
+EXAMPLE 2 P1M10D — 1 month plus 10 days
+EXAMPLE 3 PT2H — 2 hours
+EXAMPLE 4 PT1.5S — 1.5 seconds
+ * but no one elaborates on just P ...(when we guess from end that is ~30min behind now, what just may be delay, no live images :( )
+*/
+int
+TimeDimension::parse_period(const Glib::ustring& period)
+{
+    int timePeriodSec{0};
+    int val = 0;
+    bool time = false;
+    for (uint32_t i = 0; i < period.size(); ++i) {
+        gunichar c = period.at(i);
+        if (i == 0 && c != 'P') {
+            break;
+        }
+        else {
+            if (c == 'T') {
+                time = true;
+            }
+            else {
+                if (g_unichar_isdigit(c)) {    // wont recognize decimal
+                    val = val * 10 + g_unichar_xdigit_value(c);
+                }
+                else if (!time) {
+                    if (c == 'D') {
+                        timePeriodSec += val * SECS_PER_DAY;
+                        val = 0;
+                    }
+                    else if (c == 'M') {  // ~ estimate
+                        timePeriodSec += val * SECS_PER_MONTH;
+                        val = 0;
+                    }
+                    else if (c == 'Y') {  // ~ estimate
+                        timePeriodSec += val  * SECS_PRE_YEAR;
+                        val = 0;
+                    }
+                }
+                else {
+                    if (c == 'H') {
+                        timePeriodSec += val * SECS_PER_HOUR;
+                        val = 0;
+                    }
+                    else if (c == 'M') {
+                        timePeriodSec += val * SECS_PER_MINUTE;
+                        val = 0;
+                    }
+                    else if (c == 'S') {
+                        timePeriodSec += val;
+                        val = 0;
+                    }
+                }
+            }
+        }
+    }
+    return timePeriodSec;
+}
@@ -18,6 +18,7 @@
 #include <sstream>      // std::ostringstream
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
 #include <JsonHelper.hpp>
 #include <psc_format.hpp>
 #include <StringUtils.hpp>
@@ -38,37 +39,104 @@ WeatherImageRequest::WeatherImageRequest(const Glib::ustring& host, const Glib::
 {
 }
 
+void
+WeatherImageRequest::set_tile_store(const std::shared_ptr<TileStore>& tileStore, int size)
+{
+    m_tileStore = tileStore;
+    m_compositeSize = size;
+}
+
+void
+WeatherImageRequest::store_mapped(Glib::RefPtr<Gdk::Pixbuf>& weather_pix, int x, int y, int width, int height)
+{
+    if (m_tileStore
+     && m_tileKey.is_cacheable()) {
+        m_tileStore->store(m_tileKey, m_compositeSize, weather_pix, x, y, width, height);
+    }
+}
+
+TileStoreImageRequest::TileStoreImageRequest(const Glib::RefPtr<Gdk::Pixbuf>& pix, int pixX, int pixY)
+: WeatherImageRequest("", "")
+, m_pix{pix}
+, m_pixX{pixX}
+, m_pixY{pixY}
+{
+}
 
 Glib::RefPtr<Gdk::Pixbuf>
-WeatherImageRequest::get_pixbuf()
+TileStoreImageRequest::get_pixbuf()
 {
+    return m_pix;
+}
+
+// as the stored tile was mapped before, just place it
+void
+TileStoreImageRequest::mapping(Glib::RefPtr<Gdk::Pixbuf> pix, Glib::RefPtr<Gdk::Pixbuf>& weather_pix)
+{
+    int width = std::min(pix->get_width(), weather_pix->get_width() - m_pixX);
+    int height = std::min(pix->get_height(), weather_pix->get_height() - m_pixY);
+    if (width > 0 && height > 0) {
+        pix->copy_area(0, 0, width, height, weather_pix, m_pixX, m_pixY);
+    }
+}
+
+
+bool
+WeatherImageRequest::read_body()
+{
+    if (m_bodyRead) {
+        return true;
+    }
     GInputStream *stream = get_stream();
     psc::log::Log::logAdd(psc::log::Level::Debug, [&] {
-        return psc::fmt::format("pixbuf stream {}", static_cast<void*>(stream));
+        return psc::fmt::format("body stream {}", static_cast<void*>(stream));
+    });
+    if (!stream) {
+        psc::log::Log::logAdd(psc::log::Level::Error, "WeatherRequest::read_body no data ");
+        return false;
+    }
+    bool ok = true;
+    GError *error = nullptr;
+    unsigned char data[8192];
+    while (true) {
+        gssize len = g_input_stream_read(stream, data, sizeof(data), nullptr, &error);
+        if (error) {
+            psc::log::Log::logAdd(psc::log::Level::Error, [&] {
+                return psc::fmt::format("Error reading http {}", error->message);
+            });
+            g_error_free(error);
+            ok = false;
+            break;
+        }
+        if (len <= 0) {
+            break;
+        }
+        m_body.insert(m_body.end(), data, data + len);
+    }
+    psc::log::Log::logAdd(psc::log::Level::Debug, [&] {
+        return psc::fmt::format("body close {} len {}", static_cast<void*>(stream), m_body.size());
     });
-    if (stream) {
+    g_input_stream_close(stream, nullptr, nullptr);
+    m_bodyRead = ok;
+    return ok;
+}
+
+Glib::ustring
+WeatherImageRequest::get_body_hash()
+{
+    if (!read_body()) {
+        return Glib::ustring();
+    }
+    return TileStore::sha256(m_body.data(), m_body.size());
+}
+
+Glib::RefPtr<Gdk::Pixbuf>
+WeatherImageRequest::get_pixbuf()
+{
+    if (read_body()) {
         try {
             Glib::RefPtr<Gdk::PixbufLoader> loader = Gdk::PixbufLoader::create();
-            GError *error = nullptr;
-            unsigned char data[8192];
-            while (true) {
-                gssize len = g_input_stream_read(stream, data, sizeof(data), nullptr, &error);
-                if (len <= 0) {
-                    break;
-                }
-                if (error) {
-                    psc::log::Log::logAdd(psc::log::Level::Error, [&] {
-                        return psc::fmt::format("Error reading http {}", error->message);
-                    });
-                    g_error_free(error);
-                    break;
-                }
-                loader->write(data, len);
-            }
-            psc::log::Log::logAdd(psc::log::Level::Debug, [&] {
-                return psc::fmt::format("pixbuf close {}", static_cast<void*>(stream));
-            });
-            g_input_stream_close(stream, nullptr, nullptr);
+            loader->write(m_body.data(), m_body.size());
             loader->close();
             return loader->get_pixbuf();
         }
@@ -78,9 +146,6 @@ WeatherImageRequest::get_pixbuf()
             });
         }
     }
-    else {
-        psc::log::Log::logAdd(psc::log::Level::Error, "WeatherRequest::get_pixbuf no data ");
-    }
     return Glib::RefPtr<Gdk::Pixbuf>();
 }
 
@@ -103,11 +168,84 @@ WeatherProduct::signal_legend()
     return m_signal_legend;
 }
 
+void
+WeatherProduct::write(CatalogWriter& writer)
+{
+    writer.put_string(m_id);
+    writer.put_string(m_name);
+    writer.put_string(m_bounds.getWestSouth().getCoordRefSystem().identifier());
+    writer.put_double(m_bounds.getWestSouth().getLongitude());
+    writer.put_double(m_bounds.getWestSouth().getLatitude());
+    writer.put_double(m_bounds.getEastNorth().getLongitude());
+    writer.put_double(m_bounds.getEastNorth().getLatitude());
+    writer.put_u32(static_cast<guint32>(m_extent_width));
+    writer.put_u32(static_cast<guint32>(m_extent_height));
+    writer.put_double(m_seedlatbound);
+}
+
+bool
+WeatherProduct::read(CatalogReader& reader)
+{
+    m_id = reader.get_string();
+    m_name = reader.get_string();
+    auto crs = CoordRefSystem::parse(reader.get_string());
+    double west = reader.get_double();
+    double south = reader.get_double();
+    double east = reader.get_double();
+    double north = reader.get_double();
+    m_bounds = GeoBounds{west, south, east, north, crs};
+    m_extent_width = static_cast<int>(reader.get_u32());
+    m_extent_height = static_cast<int>(reader.get_u32());
+    m_seedlatbound = reader.get_double();
+    return reader.is_valid();
+}
+
+bool
+WeatherProduct::update(WeatherProduct& other)
+{
+    if (m_extent_width > 0
+     && other.m_extent_width == 0) {   // the extent is requested separately, keep it
+        other.m_bounds = m_bounds;
+        other.m_extent_width = m_extent_width;
+        other.m_extent_height = m_extent_height;
+    }
+    if (is_same(other)) {
+        return false;
+    }
+    take(other);
+    return true;
+}
+
+// compare as kept in catalog, that covers all values of the types
+bool
+WeatherProduct::is_same(WeatherProduct& other)
+{
+    CatalogWriter current;
+    write(current);
+    CatalogWriter updated;
+    other.write(updated);
+    return current.get_data() == updated.get_data();
+}
+
+void
+WeatherProduct::take(WeatherProduct& other)
+{
+    CatalogWriter updated;
+    other.write(updated);
+    CatalogReader reader(std::string(updated.get_data()));
+    read(reader);
+}
+
 Weather::Weather(WeatherConsumer* consumer)
 : m_consumer{consumer}
 {
 }
 
+Weather::~Weather()
+{
+    m_legendPrefetchConnection.disconnect();
+}
+
 WeatherConsumer*
 Weather::get_consumer()
 {
@@ -130,6 +268,9 @@ void Weather::logMsg(
 void
 Weather::inst_on_image_callback(const Glib::ustring& error, int status, SpoonMessageStream* message)
 {
+    if (m_pendingImages > 0) {
+        --m_pendingImages;
+    }
     if (!error.empty()) {
         logMsg(psc::log::Level::Warn, Glib::ustring::sprintf("error image %s", error));
         return;
@@ -145,6 +286,23 @@ Weather::inst_on_image_callback(const Glib::ustring& error, int status, SpoonMes
     }
     auto request = dynamic_cast<WeatherImageRequest*>(message);
     if (request) {
+        // on refresh servers often deliver the same image for a new time, skip decoding&mapping
+        auto hash = request->get_body_hash();
+        auto slot = request->get_tile_key().slot();
+        auto entry = m_slotHashes.find(slot);
+        bool unchanged = !hash.empty()
+                      && entry != m_slotHashes.end()
+                      && entry->second == hash;
+        if (m_slotHashes.size() >= MAX_SLOT_HASHES
+         && entry == m_slotHashes.end()) {
+            m_slotHashes.clear();   // at worst an unchanged image is decoded again
+        }
+        m_slotHashes[slot] = hash;
+        if (unchanged && request->is_refresh()) {
+            ++m_skippedImages;
+            logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("image unchanged %s skipped %lu", slot, static_cast<unsigned long>(m_skippedImages)));
+            return;
+        }
         if (m_consumer) {
             m_consumer->weather_image_notify(*request);
         }
@@ -155,9 +313,16 @@ Weather::inst_on_image_callback(const Glib::ustring& error, int status, SpoonMes
 }
 
 void
-Weather::inst_on_legend_callback(const Glib::ustring& error, int status, SpoonMessageDirect* message, std::shared_ptr<WeatherProduct> product)
+Weather::inst_on_legend_callback(const Glib::ustring& error, int status, SpoonMessageDirect* message)
 {
-   if (!error.empty()) {
+    auto url = message->get_url();
+    std::vector<std::shared_ptr<WeatherProduct>> products;
+    auto entry = m_legendRequests.find(url);
+    if (entry != m_legendRequests.end()) {
+        products = std::move(entry->second);
+        m_legendRequests.erase(entry);
+    }
+    if (!error.empty()) {
         logMsg(psc::log::Level::Warn, Glib::ustring::sprintf("error legend %s", error));
         return;
     }
@@ -170,60 +335,431 @@ Weather::inst_on_legend_callback(const Glib::ustring& error, int status, SpoonMe
         logMsg(psc::log::Level::Warn, "Error legend no data");
         return;
     }
-    try {
-        Glib::RefPtr<Gdk::PixbufLoader> loader = Gdk::PixbufLoader::create();
-        loader->write(data->get_data(), data->size());
-        loader->close();
-        if (loader->get_pixbuf()) {
-            auto pixbuf = loader->get_pixbuf();
-            logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("Loading legend pixbuf chan %d width %d height %d", pixbuf->get_n_channels(), pixbuf->get_width(), pixbuf->get_height()));
-            if (product) {
-                product->set_legend(pixbuf);
-            }
+    Glib::RefPtr<Gdk::Pixbuf> pixbuf;
+    if (m_legendCache) {
+        pixbuf = m_legendCache->store(url, data->get_data(), data->size());
+    }
+    else {
+        try {
+            Glib::RefPtr<Gdk::PixbufLoader> loader = Gdk::PixbufLoader::create();
+            loader->write(data->get_data(), data->size());
+            loader->close();
+            pixbuf = loader->get_pixbuf();
         }
-        else {
-            logMsg(psc::log::Level::Warn, "Error loading legend empty pixbuf");
+        catch (const Glib::Error& ex) {
+            logMsg(psc::log::Level::Warn, Glib::ustring::sprintf("Error reading legend pixmap %s",  ex.what()));
+            return;
         }
     }
-    catch (const Glib::Error& ex) {
-        logMsg(psc::log::Level::Warn, Glib::ustring::sprintf("Error reading legend pixmap %s",  ex.what()));
+    if (!pixbuf) {
+        logMsg(psc::log::Level::Warn, "Error loading legend empty pixbuf");
+        return;
+    }
+    logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("Loading legend pixbuf chan %d width %d height %d products %zu", pixbuf->get_n_channels(), pixbuf->get_width(), pixbuf->get_height(), products.size()));
+    for (auto& product : products) {
+        product->set_legend(pixbuf);
     }
 }
 
+void
+Weather::send_legend(const std::shared_ptr<SpoonMessageDirect>& message, const std::shared_ptr<WeatherProduct>& product)
+{
+    auto url = message->get_url();
+    if (m_legendCache) {
+        auto pixbuf = m_legendCache->lookup(url);
+        if (pixbuf) {
+            product->set_legend(pixbuf);
+            return;
+        }
+    }
+    auto entry = m_legendRequests.find(url);
+    if (entry != m_legendRequests.end()) {      // already requested (e.g. by prefetch)
+        if (std::find(entry->second.begin(), entry->second.end(), product) == entry->second.end()) {
+            entry->second.push_back(product);
+        }
+        return;
+    }
+    m_legendRequests[url].push_back(product);
+    message->signal_receive().connect(sigc::mem_fun(*this, &Weather::inst_on_legend_callback));
+    getSpoonSession()->send(message);
+}
+
+void
+Weather::setLegendCache(const std::shared_ptr<LegendCache>& legendCache)
+{
+    if (!m_legendCache) {
+        m_signal_products_completed.connect(sigc::mem_fun(*this, &Weather::prefetch_legends));
+    }
+    m_legendCache = legendCache;
+}
+
+// queue all legends not known yet, they are requested with low priority a few at a time
+void
+Weather::prefetch_legends()
+{
+    m_legendPrefetch.clear();
+    for (auto& product : m_products) {
+        if (product->is_displayable()
+         && !product->get_legend()) {
+            m_legendPrefetch.push_back(product->get_id());
+        }
+    }
+    if (!m_legendPrefetch.empty()
+     && !m_legendPrefetchConnection.connected()) {
+        m_legendPrefetchConnection = Glib::signal_timeout().connect(
+                sigc::mem_fun(*this, &Weather::on_prefetch_legends), LEGEND_PREFETCH_MS, Glib::PRIORITY_LOW);
+    }
+    logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("prefetch legends %zu", m_legendPrefetch.size()));
+}
+
+bool
+Weather::on_prefetch_legends()
+{
+    while (!m_legendPrefetch.empty()
+        && m_legendRequests.size() < MAX_LEGEND_PREFETCH) {
+        auto product = find_product(m_legendPrefetch.front());
+        m_legendPrefetch.pop_front();
+        if (product && !product->get_legend()) {
+            get_legend(product);
+        }
+    }
+    return !m_legendPrefetch.empty();
+}
+
+guint32
+ProductIds::intern(const Glib::ustring& id)
+{
+    auto entry = m_handles.find(id.raw());
+    if (entry != m_handles.end()) {
+        return entry->second;
+    }
+    auto handle = static_cast<guint32>(m_ids.size());
+    m_ids.push_back(id);
+    m_handles.insert(std::make_pair(id.raw(), handle));
+    return handle;
+}
+
+bool
+ProductIds::find(const Glib::ustring& id, guint32& handle) const
+{
+    auto entry = m_handles.find(id.raw());
+    if (entry == m_handles.end()) {
+        return false;
+    }
+    handle = entry->second;
+    return true;
+}
+
 void
 Weather::add_product(std::shared_ptr<WeatherProduct> product)
 {
-    const Glib::ustring& productId = product->get_id();
-    auto entry = std::pair<Glib::ustring, std::shared_ptr<WeatherProduct>>(productId, product);
-    m_products.insert(entry);
+    auto handle = m_productIds.intern(product->get_id());
+    product->set_handle(handle);
+    if (handle >= m_productsByHandle.size()) {
+        m_productsByHandle.resize(handle + 1);
+    }
+    auto& slot = m_productsByHandle[handle];
+    if (slot) {     // replaces
+        std::replace(m_products.begin(), m_products.end(), slot, product);
+    }
+    else {      // sorted by id, as products were listed before
+        auto pos = std::upper_bound(m_products.begin(), m_products.end(), product
+                        , [] (const std::shared_ptr<WeatherProduct>& a, const std::shared_ptr<WeatherProduct>& b) {
+            return a->get_id() < b->get_id();
+        });
+        m_products.insert(pos, product);
+    }
+    slot = product;
+}
+
+void
+Weather::remove_product(const Glib::ustring& productId)
+{
+    auto product = find_product(productId);
+    if (product) {
+        unwatch_product(productId);
+        m_productsByHandle[product->get_handle()].reset();
+        std::erase(m_products, product);
+    }
+}
+
+void
+Weather::begin_products()
+{
+    m_unseenProducts.clear();
+    for (auto& product : m_products) {
+        m_unseenProducts.insert(product->get_id());
+    }
+    m_productChanges = WeatherProductChanges{};
+}
+
+void
+Weather::merge_product(const std::shared_ptr<WeatherProduct>& product)
+{
+    auto known = find_product(product->get_id());
+    if (!known) {
+        add_product(product);
+        m_productChanges.added.push_back(product->get_id());
+        m_signal_product_added.emit(product);
+        return;
+    }
+    if (m_unseenProducts.erase(product->get_id()) > 0
+     && known->update(*product)) {
+        m_productChanges.changed.push_back(product->get_id());
+    }
+}
+
+void
+Weather::end_products(bool complete)
+{
+    if (complete) {     // if incomplete we can't tell what was removed
+        for (auto& productId : m_unseenProducts) {
+            remove_product(productId);
+            m_productChanges.removed.push_back(productId);
+        }
+    }
+    m_unseenProducts.clear();
+    logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("products added %zu removed %zu changed %zu"
+            , m_productChanges.added.size(), m_productChanges.removed.size(), m_productChanges.changed.size()));
+    if (!m_productChanges.empty()) {
+        m_signal_products_changed.emit(m_productChanges);
+    }
+    m_productChanges = WeatherProductChanges{};
 }
 
 std::shared_ptr<WeatherProduct>
 Weather::find_product(const Glib::ustring& productId)
 {
-    auto entry = m_products.find(productId);
-    if (entry != m_products.end()) {
-        return (*entry).second;
+    guint32 handle;
+    if (m_productIds.find(productId, handle)) {
+        return find_product(handle);
     }
     return std::shared_ptr<WeatherProduct>();
 }
 
-std::vector<std::shared_ptr<WeatherProduct>>
-Weather::get_products()
+std::shared_ptr<WeatherProduct>
+Weather::find_product(guint32 handle)
+{
+    if (handle < m_productsByHandle.size()) {
+        return m_productsByHandle[handle];
+    }
+    return std::shared_ptr<WeatherProduct>();
+}
+
+void
+Weather::setTileStore(const std::shared_ptr<TileStore>& tileStore)
+{
+    m_tileStore = tileStore;
+}
+
+void
+Weather::send_image(const std::shared_ptr<WeatherImageRequest>& request)
+{
+    if (m_tileStore) {
+        auto& tileKey = request->get_tile_key();
+        auto pix = m_tileStore->lookup(tileKey);
+        if (pix) {
+            logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("image from store %s", tileKey.to_string()));
+            TileStoreImageRequest stored(pix, request->get_pixX(), request->get_pixY());
+            if (m_consumer) {
+                m_consumer->weather_image_notify(stored);
+            }
+            return;
+        }
+        request->set_tile_store(m_tileStore, m_consumer->get_weather_image_size());
+    }
+    request->set_refresh(is_refreshing(request->get_tile_key().get_product_id()));
+    ++m_pendingImages;
+    getSpoonSession()->send(request);
+}
+
+void
+Weather::refresh(const Glib::ustring& productId)
+{
+    set_refreshing(productId, true);
+    request(productId);
+    set_refreshing(productId, false);
+}
+
+void
+Weather::set_refreshing(const Glib::ustring& productId, bool refreshing)
+{
+    if (refreshing) {
+        m_refreshing.insert(productId);
+    }
+    else {
+        m_refreshing.erase(productId);
+    }
+}
+
+bool
+Weather::is_refreshing(const Glib::ustring& productId)
+{
+    if (m_refreshing.empty()) {
+        return false;
+    }
+    if (m_refreshing.contains(productId)) {
+        return true;
+    }
+    std::vector<Glib::ustring> members;
+    StringUtils::split(productId, ',', members);
+    return std::any_of(members.begin(), members.end(), [this] (const Glib::ustring& member) {
+        return m_refreshing.contains(member);
+    });
+}
+
+guint64
+Weather::get_skipped_images()
 {
-    std::vector<std::shared_ptr<WeatherProduct>> weatherProducts;
-    weatherProducts.reserve(m_products.size());
-    for (auto& prod : m_products) {
-        weatherProducts.push_back(prod.second);
+    return m_skippedImages;
+}
+
+void
+Weather::serve_last(const Glib::ustring& productId)
+{
+    if (!m_tileStore
+     || !m_consumer
+     || m_servedLast.contains(productId)) {
+        return;
+    }
+    m_servedLast.insert(productId);
+    auto tiles = m_tileStore->get_last(get_service_id(), productId, m_consumer->get_weather_image_size());
+    for (auto& tile : tiles) {
+        auto pix = m_tileStore->lookup_hash(tile.keyHash);
+        if (pix) {
+            TileStoreImageRequest stored(pix, tile.pixX, tile.pixY);
+            m_consumer->weather_image_notify(stored);
+        }
     }
-    return weatherProducts;
+    logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("served last %s tiles %zu", productId, tiles.size()));
+}
+
+void
+Weather::setCatalog(const std::shared_ptr<ProductCatalog>& catalog, gint64 ttlSec)
+{
+    m_catalog = catalog;
+    m_catalogTtlSec = ttlSec;
+}
+
+bool
+Weather::load_catalog()
+{
+    if (!m_catalog) {
+        return false;
+    }
+    if (!m_catalogLoaded) {
+        m_catalogLoaded = true;
+        auto reader = m_catalog->load(get_service_id());
+        if (!reader) {
+            return false;
+        }
+        std::vector<std::shared_ptr<WeatherProduct>> products;
+        gint64 savedSec{0};
+        if (reader->get_u32() == ProductCatalog::MAGIC
+         && reader->get_u32() == ProductCatalog::VERSION) {
+            savedSec = reader->get_i64();
+            auto serviceId = reader->get_string();
+            auto etag = reader->get_string();
+            auto lastModified = reader->get_string();
+            if (serviceId == get_service_id()) {
+                read_catalog_extra(*reader);
+                guint32 count = reader->get_u32();
+                for (guint32 i = 0; i < count && reader->is_valid(); ++i) {
+                    auto product = create_product();
+                    if (product->read(*reader)) {
+                        products.push_back(product);
+                    }
+                }
+                m_catalogEtag = etag;
+                m_catalogLastModified = lastModified;
+            }
+        }
+        if (!reader->is_valid()
+         || products.empty()) {
+            logMsg(psc::log::Level::Warn, Glib::ustring::sprintf("catalog %s not usable", get_service_id()));
+            m_catalogEtag.clear();
+            m_catalogLastModified.clear();
+            return false;
+        }
+        m_catalogSavedSec = savedSec;
+        begin_products();
+        for (auto& product : products) {
+            merge_product(product);
+        }
+        end_products(true);
+        logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("catalog %s products %zu", get_service_id(), m_products.size()));
+        m_signal_products_completed.emit();
+    }
+    gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+    return m_catalogSavedSec > 0
+        && now - m_catalogSavedSec < m_catalogTtlSec;
+}
+
+void
+Weather::save_catalog()
+{
+    if (!m_catalog) {
+        return;
+    }
+    CatalogWriter writer;
+    m_catalogSavedSec = g_get_real_time() / G_USEC_PER_SEC;
+    writer.put_u32(ProductCatalog::MAGIC);
+    writer.put_u32(ProductCatalog::VERSION);
+    writer.put_i64(m_catalogSavedSec);
+    writer.put_string(get_service_id());
+    writer.put_string(m_catalogEtag);
+    writer.put_string(m_catalogLastModified);
+    write_catalog_extra(writer);
+    writer.put_u32(static_cast<guint32>(m_products.size()));
+    for (auto& product : m_products) {
+        product->write(writer);
+    }
+    m_catalog->save(get_service_id(), writer);
+}
+
+void
+Weather::add_validators(SpoonMessage& message)
+{
+    if (m_catalogSavedSec == 0) {   // without catalog we need the full response
+        return;
+    }
+    if (!m_catalogEtag.empty()) {
+        message.addHeader("If-None-Match", m_catalogEtag);
+    }
+    if (!m_catalogLastModified.empty()) {
+        message.addHeader("If-Modified-Since", m_catalogLastModified);
+    }
+}
+
+bool
+Weather::is_catalog_confirmed(int status, SpoonMessage* message)
+{
+    if (status == SpoonMessage::NOT_MODIFIED
+     && m_catalog
+     && m_catalogSavedSec > 0) {
+        m_catalogSavedSec = g_get_real_time() / G_USEC_PER_SEC;
+        m_catalog->touch(get_service_id(), m_catalogSavedSec);
+        logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("catalog %s not modified", get_service_id()));
+        return true;
+    }
+    if (status == SpoonMessage::OK) {
+        m_catalogEtag = message->get_response_header("ETag");
+        m_catalogLastModified = message->get_response_header("Last-Modified");
+    }
+    return false;
+}
+
+void
+Weather::setSpoonSession(const std::shared_ptr<SpoonSession>& session)
+{
+    spoonSession = session;
 }
 
 std::shared_ptr<SpoonSession>
 Weather::getSpoonSession()
 {
     if (!spoonSession) {
-        spoonSession = std::make_shared<SpoonSession>("map private use ");// last ws will add libsoup3
+        spoonSession = std::make_shared<SpoonSession>("map private use ", MAX_CONNS_PER_HOST);// last ws will add libsoup3
     }
     return spoonSession;
 }
@@ -261,6 +797,18 @@ Weather::signal_products_completed()
     return m_signal_products_completed;
 }
 
+Weather::type_signal_product_added
+Weather::signal_product_added()
+{
+    return m_signal_product_added;
+}
+
+Weather::type_signal_products_changed
+Weather::signal_products_changed()
+{
+    return m_signal_products_changed;
+}
+
 void
 Weather::setLog(const std::shared_ptr<psc::log::Log>& log)
 {
@@ -0,0 +1,165 @@
+/* -*- Mode: c++; c-basic-offset: 4; tab-width: 4; coding: utf-8; -*-  */
+/*
+ * Copyright (C) 2023 RPf
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <Log.hpp>
+#include <psc_format.hpp>
+
+#include "WeatherRegistry.hpp"
+#include "WebMapService.hpp"
+#include "RealEarth.hpp"
+#include "WebMapTileService.hpp"
+
+WeatherRegistry::WeatherRegistry(WeatherConsumer* consumer, int minPeriodSec, const WeatherBudget& budget)
+: m_consumer{consumer}
+, m_minPeriodSec{minPeriodSec}
+, m_budget{budget}
+, m_session{std::make_shared<SpoonSession>("map private use ", budget.maxConnsPerHost, budget.maxConns)}
+{
+}
+
+WeatherRegistry::~WeatherRegistry()
+{
+    // services may be kept by others, they must not call us any more
+    for (auto& connection : m_completedConnections) {
+        connection.disconnect();
+    }
+}
+
+void
+WeatherRegistry::enable_caches(const std::shared_ptr<TileStore>& tileStore, const std::shared_ptr<ProductCatalog>& catalog
+                             , const std::shared_ptr<LegendCache>& legendCache)
+{
+    m_tileStore = tileStore;
+    m_catalog = catalog;
+    m_legendCache = legendCache;
+    if (m_tileStore
+     && m_budget.tileMaxAgeSec > 0) {
+        m_tileStore->prune(m_budget.tileMaxAgeSec);
+    }
+    if (m_tileStore
+     && m_budget.tileMaxBytes > 0) {
+        m_tileStore->prune_size(m_budget.tileMaxBytes);
+    }
+    if (m_legendCache) {
+        m_legendCache->set_max_bytes(m_budget.legendMaxBytes);
+    }
+}
+
+std::shared_ptr<WebMapService>
+WeatherRegistry::add_web_map_service(const std::shared_ptr<WebMapServiceConf>& conf)
+{
+    auto service = std::make_shared<WebMapService>(m_consumer, conf, m_minPeriodSec);
+    add(service);
+    return service;
+}
+
+std::shared_ptr<RealEarth>
+WeatherRegistry::add_real_earth(const Glib::ustring& baseUrl)
+{
+    auto service = std::make_shared<RealEarth>(m_consumer, baseUrl);
+    add(service);
+    return service;
+}
+
+std::shared_ptr<WebMapTileService>
+WeatherRegistry::add_web_map_tile_service(const std::shared_ptr<WebMapServiceConf>& conf)
+{
+    auto service = std::make_shared<WebMapTileService>(m_consumer, conf);
+    add(service);
+    return service;
+}
+
+void
+WeatherRegistry::add(const std::shared_ptr<Weather>& service)
+{
+    service->setSpoonSession(m_session);
+    if (m_tileStore) {
+        service->setTileStore(m_tileStore);
+    }
+    if (m_catalog) {
+        service->setCatalog(m_catalog);
+    }
+    if (m_legendCache) {
+        service->setLegendCache(m_legendCache);
+    }
+    // the connection is removed with the registry, so this is safe
+    auto ptr = service.get();
+    auto connection = service->signal_products_completed().connect([this, ptr] {
+        for (auto& registered : m_services) {
+            if (registered.get() == ptr) {
+                on_service_completed(registered);
+                break;
+            }
+        }
+    });
+    m_completedConnections.push_back(connection);
+    m_services.push_back(service);
+}
+
+void
+WeatherRegistry::capabilities()
+{
+    // the requests are async, so all are in transfer at once (as far as the budget allows)
+    for (auto& service : m_services) {
+        service->capabilities();
+    }
+}
+
+void
+WeatherRegistry::on_service_completed(std::shared_ptr<Weather> service)
+{
+    m_index.update(*service);
+    m_completed.insert(service->get_service_id());
+    psc::log::Log::logAdd(psc::log::Level::Debug, [&] {
+        return psc::fmt::format("Registry {} completed indexed {}", service->get_service_id(), m_index.get_size());
+    });
+    m_signal_service_completed.emit(service);
+    if (m_completed.size() == m_services.size()) {
+        m_signal_completed.emit();
+    }
+}
+
+std::shared_ptr<Weather>
+WeatherRegistry::find_service(const Glib::ustring& serviceId)
+{
+    for (auto& service : m_services) {
+        if (service->get_service_id() == serviceId) {
+            return service;
+        }
+    }
+    return std::shared_ptr<Weather>();
+}
+
+std::vector<ProductMatch>
+WeatherRegistry::search(const ProductQuery& query)
+{
+    return m_index.search(query);
+}
+
+WeatherRegistry::type_signal_service_completed
+WeatherRegistry::signal_service_completed()
+{
+    return m_signal_service_completed;
+}
+
+WeatherRegistry::type_signal_completed
+WeatherRegistry::signal_completed()
+{
+    return m_signal_completed;
+}
@@ -18,13 +18,18 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <StringUtils.hpp>
 #include <limits>
 #include <Log.hpp>
 #include <psc_format.hpp>
 
 #include "WebMapService.hpp"
-#include "MapProjection.hpp"
+#include "Reprojection.hpp"
 
 // docs (even if the examples are outdated):
 // https://sos.noaa.gov/support/sos/how-to/wms-tutorial/all/
@@ -33,25 +38,29 @@
 // http://portal.opengeospatial.org/files/?artifact_id=14416
 
 WebMapImageRequest::WebMapImageRequest(WebMapService* webMapService
-        , const GeoBounds& bounds
-        , int pixX, int pixY, int pixWidth, int pixHeight
+        , const WebMapTile& tile
         , std::shared_ptr<WebMapProduct>& product)
+: WebMapImageRequest(webMapService, tile, std::vector<std::shared_ptr<WebMapProduct>>{product})
+{
+}
+
+WebMapImageRequest::WebMapImageRequest(WebMapService* webMapService
+        , const WebMapTile& tile
+        , const std::vector<std::shared_ptr<WebMapProduct>>& products)
 : WeatherImageRequest(webMapService->getServiceConf()->getAddress(), "")
 , m_webMapService{webMapService}
-, m_bounds{bounds}
-, m_pixX{pixX}
-, m_pixY{pixY}
-, m_pixWidth{pixWidth}
-, m_pixHeight{pixHeight}
+, m_tile{tile}
 {
+    auto& product = products.front();
+    auto layers = WebMapService::compound_id(products);
     addQuery("service", "WMS");
     addQuery("version", "1.3.0");
     addQuery("REQUEST", "GetMap");
-    addQuery("LAYERS", product->get_id());
+    addQuery("LAYERS", layers);
     addQuery("CRS", product->getCoordRefSystem().identifier());
     addQuery("FORMAT", "image/png");
-    addQuery("HEIGHT", std::to_string(m_pixHeight));
-    addQuery("WIDTH", std::to_string(m_pixWidth));
+    addQuery("HEIGHT", std::to_string(m_tile.height));
+    addQuery("WIDTH", std::to_string(m_tile.width));
     addQuery("TRANSPARENT", "TRUE");    // prefer transparent
     auto latest = product->getLatestTime();
     if (latest) {
@@ -60,189 +69,342 @@ WebMapImageRequest::WebMapImageRequest(WebMapService* webMapService
     else {
         psc::log::Log::logAdd(psc::log::Level::Debug, "Using no time");
     }
-    Glib::ustring bound = m_bounds.printValue(',');
+    auto& bounds = m_tile.bounds;
+    Glib::ustring bound = bounds.printValue(',');
     psc::log::Log::logAdd(psc::log::Level::Debug, [&] {
         return psc::fmt::format("time {} bound {} m_westSouth lon {} lat {} ref {} m_eastNorth lon {} lat {} ref {}"
                             , (latest ? latest.format_iso8601() : Glib::ustring{})
                             , bound
-                            , m_bounds.getWestSouth().getLongitude()
-                            , m_bounds.getWestSouth().getLatitude()
-                            , m_bounds.getWestSouth().getCoordRefSystem().identifier()
-                            , m_bounds.getEastNorth().getLongitude()
-                            , m_bounds.getEastNorth().getLatitude()
-                            , m_bounds.getEastNorth().getCoordRefSystem().identifier());
+                            , bounds.getWestSouth().getLongitude()
+                            , bounds.getWestSouth().getLatitude()
+                            , bounds.getWestSouth().getCoordRefSystem().identifier()
+                            , bounds.getEastNorth().getLongitude()
+                            , bounds.getEastNorth().getLatitude()
+                            , bounds.getEastNorth().getCoordRefSystem().identifier());
     });
     addQuery("BBOX", bound);
+    set_tile_key(TileKey{webMapService->get_service_id(), layers
+                    , (latest ? latest.format_iso8601() : Glib::ustring{})
+                    , bounds, m_tile.width, m_tile.height});
     signal_receive().connect(
         sigc::mem_fun(*webMapService, &WebMapService::inst_on_image_callback));
 }
 
+// the target is always linear (equirectangular),
+//   the source may use any of the supported crs.
 void
 WebMapImageRequest::mapping(Glib::RefPtr<Gdk::Pixbuf> pix, Glib::RefPtr<Gdk::Pixbuf>& weather_pix)
 {
-    Glib::RefPtr<Gdk::Pixbuf> clearPix = Gdk::Pixbuf::create(pix->get_colorspace(), pix->get_has_alpha(), pix->get_bits_per_sample(), pix->get_width(), 1);
-    clearPix->fill(0x0);   // transp. black
-	bool isnorth = m_bounds.getEastNorth().getLatitude() > 0.0;
-    double pix_height = pix->get_height();
-	double relOrigin = (isnorth
-                        ? m_bounds.getEastNorth().getCoordRefSystem().toLinearLat(m_bounds.getEastNorth().getLatitude())
-                        : std::abs(m_bounds.getWestSouth().getCoordRefSystem().toLinearLat(m_bounds.getWestSouth().getLatitude())));
-	for (int linY = 0; linY < pix_height; ++linY) {
-	    double relLat = isnorth
-		            ? ((double)(pix_height - linY) / pix_height)
-		            : ((double)linY / pix_height);
-	    // still have to adapt, target will always be 0...90 but source 0...max
-	    if (relLat < relOrigin) {
-            double relMap = isnorth
-                    ? 1.0 - (relLat / relOrigin)
-                    : (relLat / relOrigin);
-            int linYsrc = (int)(relMap * pix_height);
-            if (linYsrc >= 0 && linYsrc < pix_height) {     // just to be safe (better than to crash)
-                pix->copy_area(0, linYsrc, pix->get_width(), 1, weather_pix, m_pixX, m_pixY+linY);
-            }
-            else {
-                psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
-                    return psc::fmt::format( "Generated lin y {} while mapping exceeded size {}", linYsrc, pix_height);
-                });
+    auto reprojection = Reprojection::create(m_tile.bounds, pix->get_width(), pix->get_height()
+                                , m_tile.target, m_tile.pixWidth, m_tile.pixHeight);
+    reprojection->map(pix, weather_pix, m_tile.pixX, m_tile.pixY);
+    if (m_tile.crop) {
+        crop(weather_pix);
+    }
+    store_mapped(weather_pix, m_tile.pixX, m_tile.pixY, m_tile.pixWidth, m_tile.pixHeight);
+}
+
+// clear the pixels of tile outside of the crop area (transp. black)
+void
+WebMapImageRequest::crop(Glib::RefPtr<Gdk::Pixbuf>& weather_pix)
+{
+    int channels = weather_pix->get_n_channels();
+    int rowstride = weather_pix->get_rowstride();
+    guint8* pixels = weather_pix->get_pixels();
+    int x1 = std::min(m_tile.pixX + m_tile.pixWidth, weather_pix->get_width());
+    int y1 = std::min(m_tile.pixY + m_tile.pixHeight, weather_pix->get_height());
+    int cropX1 = m_tile.cropX + m_tile.cropWidth;
+    int cropY1 = m_tile.cropY + m_tile.cropHeight;
+    for (int y = std::max(m_tile.pixY, 0); y < y1; ++y) {
+        guint8* row = pixels + static_cast<gsize>(y) * rowstride;
+        bool inside = y >= m_tile.cropY && y < cropY1;
+        for (int x = std::max(m_tile.pixX, 0); x < x1; ++x) {
+            if (!inside || x < m_tile.cropX || x >= cropX1) {
+                std::memset(row + x * channels, 0, channels);
             }
-    	}
-        else {
-            clearPix->copy_area(0, 0, clearPix->get_width(), 1, weather_pix, m_pixX, m_pixY+linY);
         }
     }
 }
 
-WebMapProduct::WebMapProduct(WebMapService* webMapService)
-: WeatherProduct()
-, m_timePeriodSec{webMapService->getMinPeriodSec()}
-, m_webMapService{webMapService}
+void
+CapabilitiesDocument::append(const char* data, gsize len)
 {
-    m_parseLevel.push(ParseContext::None);  // keep this so we always return something on pop
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_text.append(data, len);
 }
 
-void
-WebMapProduct::start_element(Glib::Markup::ParseContext& context,
-    const Glib::ustring& element_name,
-    const Glib::Markup::Parser::AttributeMap& attributes)
+std::string
+CapabilitiesDocument::get_range(gsize start, gsize end)
 {
-    if (element_name == "Name") {
-        m_context = ParseContext::Name;
-    }
-    else if (element_name == "Title") {
-        m_context = ParseContext::Title;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    end = std::min(end, m_text.size());
+    if (start >= end) {
+        return std::string();
     }
-    else if (element_name == "Abstract") {
-        m_context = ParseContext::Abstract;
-    }
-    else if (element_name == "KeywordList") {
-        m_context = ParseContext::KeywordList;
+    return m_text.substr(start, end - start);
+}
+
+std::string
+CapabilitiesDocument::checksum(gsize start, gsize end)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    end = std::min(end, m_text.size());
+    if (start >= end) {
+        return std::string();
     }
-    else if (element_name == "Keyword") {
-        m_context = ParseContext::Keyword;
+    gchar* sum = g_compute_checksum_for_data(G_CHECKSUM_SHA1
+                        , reinterpret_cast<const guchar*>(m_text.data() + start), end - start);
+    std::string ret{sum};
+    g_free(sum);
+    return ret;
+}
+
+bool
+CapabilitiesDocument::next_markup(gsize from, gsize& start, gsize& end)
+{
+    start = m_text.find('<', from);
+    if (start == std::string::npos) {
+        return false;
     }
-    else if (element_name == "CRS") {
-        m_context = ParseContext::CRS;
+    // the parts the parser skips, these may contain anything that looks like a tag
+    static const std::pair<const char*, const char*> skipped[] = {
+        {"<!--", "-->"},
+        {"<![CDATA[", "]]>"},
+        {"<?", "?>"}
+    };
+    for (auto& [open, close] : skipped) {
+        auto len = std::strlen(open);
+        auto avail = std::min(len, m_text.size() - start);
+        if (m_text.compare(start, avail, open, avail) == 0) {
+            if (avail < len) {
+                return false;   // can't tell yet
+            }
+            end = m_text.find(close, start + len);
+            if (end == std::string::npos) {
+                return false;
+            }
+            end += std::strlen(close);
+            return true;
+        }
     }
-    else if (element_name == "EX_GeographicBoundingBox") {
-        m_context = ParseContext::EX_GeographicBoundingBox;
+    char quote = '\0';   // attribute values may contain '>'
+    for (end = start + 1; end < m_text.size(); ++end) {
+        char c = m_text[end];
+        if (quote != '\0') {
+            if (c == quote) {
+                quote = '\0';
+            }
+        }
+        else if (c == '"' || c == '\'') {
+            quote = c;
+        }
+        else if (c == '>') {
+            ++end;
+            return true;
+        }
     }
-    else if (element_name == "westBoundLongitude") {
-        m_context = ParseContext::westBoundLongitude;
+    return false;
+}
+
+CapabilitiesDocument::TagKind
+CapabilitiesDocument::tag_kind(const char* name, gsize start, gsize end)
+{
+    auto nameStart = start + 1;
+    bool closing = m_text[nameStart] == '/';
+    if (closing) {
+        ++nameStart;
     }
-    else if (element_name == "eastBoundLongitude") {
-        m_context = ParseContext::eastBoundLongitude;
+    auto len = std::strlen(name);
+    if (nameStart + len >= end
+     || m_text.compare(nameStart, len, name) != 0) {
+        return TagKind::Other;
     }
-    else if (m_context == ParseContext::EX_GeographicBoundingBox
-          && element_name == "southBoundLatitude") {
-        m_context = ParseContext::southBoundLatitude;
+    char next = m_text[nameStart + len];   // avoid matching e.g. LayerLimit
+    if (next != '>' && next != '/' && !g_ascii_isspace(next)) {
+        return TagKind::Other;
     }
-    else if (element_name == "northBoundLatitude") {
-        m_context = ParseContext::northBoundLatitude;
+    if (closing) {
+        return TagKind::End;
     }
-    else if (element_name == "BoundingBox") {
-        auto crs = attributes.find("CRS");
-        if (crs != attributes.end()
-         && getCoordRefSystem() == CoordRefSystem::None) {  // if we did not find a useable crs up to now
-            m_crs = CoordRefSystem::parse(crs->second);     // servers seem not to mind being asked one advertised with bounds
-        }
-        auto minx = attributes.find("minx");
-        auto maxx = attributes.find("maxx");
-        auto miny = attributes.find("miny");
-        auto maxy = attributes.find("maxy");
-        if (crs != attributes.end()
-         && crs->second == getCoordRefSystem().identifier()
-         && minx != attributes.end()
-         && maxx != attributes.end()
-         && miny != attributes.end()
-         && maxy != attributes.end()) {
-            bool latFirst = getCoordRefSystem().is_latitude_first();
-            m_bounds.getWestSouth().parseLongitude(latFirst ? miny->second : minx->second);
-            m_bounds.getWestSouth().parseLatitude(latFirst ? minx->second : miny->second);
-            m_bounds.getWestSouth().setCoordRefSystem(getCoordRefSystem());
-            m_bounds.getEastNorth().parseLongitude(latFirst ? maxy->second : maxx->second);
-            m_bounds.getEastNorth().parseLatitude(latFirst ? maxx->second : maxy->second);
-            m_bounds.getEastNorth().setCoordRefSystem(getCoordRefSystem());
+    return m_text[end - 2] == '/' ? TagKind::Empty : TagKind::Start;
+}
+
+gsize
+CapabilitiesDocument::find_start_tag(const char* name, gsize from)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    gsize start, end;
+    while (next_markup(from, start, end)) {
+        auto kind = tag_kind(name, start, end);
+        if (kind == TagKind::Start
+         || kind == TagKind::Empty) {
+            return start;
         }
-        m_context = ParseContext::BoundingBox;
+        from = end;
     }
-    else if (element_name == "Dimension") {
-        auto name = attributes.find("name");
-        if (name != attributes.end()
-         && name->second == "time") {
-            auto def = attributes.find("default");
-            if (def != attributes.end()
-             && def->second != "current") {
-                // prefere text
+    return std::string::npos;
+}
+
+gsize
+CapabilitiesDocument::find_element_end(const char* name, gsize start)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int depth = 0;
+    gsize from = start;
+    gsize tagStart, tagEnd;
+    while (next_markup(from, tagStart, tagEnd)) {
+        switch (tag_kind(name, tagStart, tagEnd)) {
+        case TagKind::Start:
+            ++depth;
+            break;
+        case TagKind::End:
+            if (--depth <= 0) {
+                return tagEnd;
             }
+            break;
+        case TagKind::Empty:
+            if (depth == 0) {
+                return tagEnd;
+            }
+            break;
+        case TagKind::Other:
+            break;
         }
-        m_context = ParseContext::Dimension;
+        from = tagEnd;
     }
-    else if (element_name == "Style") {
-        m_context = ParseContext::Style;
-    }
-    else if (element_name == "LegendURL") {
-        auto width = attributes.find("width");
-        if (width != attributes.end()) {
-            m_LastLegendWidth = width->second;
-        }
-        m_context = ParseContext::LegendURL;
+    return std::string::npos;
+}
 
+WebMapProduct::WebMapProduct(WebMapService* webMapService, bool indexOnly)
+: WeatherProduct()
+, m_timePeriodSec{webMapService->getMinPeriodSec()}
+, m_webMapService{webMapService}
+, m_indexOnly{indexOnly}
+{
+    m_parseLevel.push(ParseContext::None);  // keep this so we always return something on pop
+}
+
+// the element names we are interested in, lookup by view avoids comparing one by one
+ParseContext
+WebMapProduct::element_context(const Glib::ustring& element_name)
+{
+    static const std::unordered_map<std::string_view, ParseContext> contexts{
+          {"Name", ParseContext::Name}
+        , {"Title", ParseContext::Title}
+        , {"Abstract", ParseContext::Abstract}
+        , {"KeywordList", ParseContext::KeywordList}
+        , {"Keyword", ParseContext::Keyword}
+        , {"CRS", ParseContext::CRS}
+        , {"EX_GeographicBoundingBox", ParseContext::EX_GeographicBoundingBox}
+        , {"westBoundLongitude", ParseContext::westBoundLongitude}
+        , {"eastBoundLongitude", ParseContext::eastBoundLongitude}
+        , {"southBoundLatitude", ParseContext::southBoundLatitude}
+        , {"northBoundLatitude", ParseContext::northBoundLatitude}
+        , {"BoundingBox", ParseContext::BoundingBox}
+        , {"Dimension", ParseContext::Dimension}
+        , {"Style", ParseContext::Style}
+        , {"LegendURL", ParseContext::LegendURL}
+        , {"Format", ParseContext::Format}
+        , {"OnlineResource", ParseContext::OnlineResource}
+        , {"Attribution", ParseContext::Attribution}
+        , {"MinScaleDenominator", ParseContext::MinScaleDenominator}
+        , {"MaxScaleDenominator", ParseContext::MaxScaleDenominator}
+    };
+    auto entry = contexts.find(std::string_view(element_name.data(), element_name.bytes()));
+    if (entry != contexts.end()) {
+        return entry->second;
     }
-    else if (element_name == "Format") {
-        m_context = ParseContext::Format;
-    }
-    else if (element_name == "OnlineResource") {
-        auto type = attributes.find("xlink:type");
-        if (type != attributes.end()
-         && type->second == "simple") {
-            auto link = attributes.find("xlink:href");
-            if (link != attributes.end()) {
-                auto url = link->second;
-                // this is probably a EumetSat quirk ...
-                if (!m_LastLegendWidth.empty()) {   // the default url doesn't work
-                    url += "&WIDTH=" + m_LastLegendWidth;
-                    m_LastLegendWidth.clear();
-                }
-                m_legends.push_back(url);
+    return ParseContext::None;
+}
+
+void
+WebMapProduct::start_element(Glib::Markup::ParseContext& context,
+    const Glib::ustring& element_name,
+    const Glib::Markup::Parser::AttributeMap& attributes)
+{
+    auto elementContext = element_context(element_name);
+    switch (elementContext) {
+    case ParseContext::None:
+        #ifdef WEATHER_DEBUG
+        std::cout << "Unhandled element start " << element_name << std::endl;
+        #endif
+        break;  // keep context of parent
+    case ParseContext::southBoundLatitude:
+        if (m_context == ParseContext::EX_GeographicBoundingBox) {
+            m_context = elementContext;
+        }
+        break;
+    case ParseContext::BoundingBox:
+        start_bounding_box(attributes);
+        m_context = elementContext;
+        break;
+    case ParseContext::LegendURL: {
+            auto width = attributes.find("width");
+            if (width != attributes.end()
+             && !m_indexOnly) {
+                m_LastLegendWidth = width->second;
             }
+            m_context = elementContext;
         }
-        m_context = ParseContext::OnlineResource;
-    }
-    else if (element_name == "Attribution") {
-        m_context = ParseContext::Attribution;
+        break;
+    case ParseContext::OnlineResource:
+        if (!m_indexOnly) {
+            start_online_resource(attributes);
+        }
+        m_context = elementContext;
+        break;
+    default:
+        m_context = elementContext;
+        break;
     }
-    else if (element_name == "MinScaleDenominator") {
-        m_context = ParseContext::MinScaleDenominator;
+    m_parseLevel.push(m_context);
+}
+
+void
+WebMapProduct::start_bounding_box(const Glib::Markup::Parser::AttributeMap& attributes)
+{
+    auto crs = attributes.find("CRS");
+    if (crs != attributes.end()
+     && getCoordRefSystem() == CoordRefSystem::None) {  // if we did not find a useable crs up to now
+        m_crs = CoordRefSystem::parse(crs->second);     // servers seem not to mind being asked one advertised with bounds
     }
-    else if (element_name == "MaxScaleDenominator") {
-        m_context = ParseContext::MaxScaleDenominator;
+    auto minx = attributes.find("minx");
+    auto maxx = attributes.find("maxx");
+    auto miny = attributes.find("miny");
+    auto maxy = attributes.find("maxy");
+    if (crs != attributes.end()
+     && crs->second == getCoordRefSystem().identifier()
+     && minx != attributes.end()
+     && maxx != attributes.end()
+     && miny != attributes.end()
+     && maxy != attributes.end()) {
+        bool latFirst = getCoordRefSystem().is_latitude_first();
+        m_bounds.getWestSouth().parseLongitude(latFirst ? miny->second : minx->second);
+        m_bounds.getWestSouth().parseLatitude(latFirst ? minx->second : miny->second);
+        m_bounds.getWestSouth().setCoordRefSystem(getCoordRefSystem());
+        m_bounds.getEastNorth().parseLongitude(latFirst ? maxy->second : maxx->second);
+        m_bounds.getEastNorth().parseLatitude(latFirst ? maxx->second : maxy->second);
+        m_bounds.getEastNorth().setCoordRefSystem(getCoordRefSystem());
     }
-    else {
-        #ifdef WEATHER_DEBUG
-        std::cout << "Unhandled element start " << element_name << std::endl;
-        #endif
+}
+
+void
+WebMapProduct::start_online_resource(const Glib::Markup::Parser::AttributeMap& attributes)
+{
+    auto type = attributes.find("xlink:type");
+    if (type != attributes.end()
+     && type->second == "simple") {
+        auto link = attributes.find("xlink:href");
+        if (link != attributes.end()) {
+            auto url = link->second;
+            // this is probably a EumetSat quirk ...
+            if (!m_LastLegendWidth.empty()) {   // the default url doesn't work
+                url += "&WIDTH=" + m_LastLegendWidth;
+                m_LastLegendWidth.clear();
+            }
+            m_legends.push_back(url);
+        }
     }
-    m_parseLevel.push(m_context);
 }
 
 void
@@ -253,9 +415,50 @@ WebMapProduct::end_element(Glib::Markup::ParseContext& context,
     m_context = m_parseLevel.top();
 }
 
+void
+WebMapProduct::set_layer(const std::shared_ptr<CapabilitiesDocument>& document, gsize start, gsize end)
+{
+    m_document = document;
+    m_layerStart = start;
+    m_layerEnd = end;
+    m_layerChecksum = document->checksum(start, end);
+}
+
+// parse the details from the layer as kept with document
+void
+WebMapProduct::materialize()
+{
+    if (!m_document) {
+        return;
+    }
+    auto layer = m_document->get_range(m_layerStart, m_layerEnd);
+    m_document.reset();     // only once, and release the document when all are done
+    m_indexOnly = false;
+    m_keywords.clear();     // are appended
+    auto id = m_id;
+    WebMapLayerParser parser(this);
+    Glib::Markup::ParseContext context(parser);
+    try {
+        context.parse(layer.data(), layer.data() + layer.size());
+        context.end_parse();
+    }
+    catch (const Glib::MarkupError& ex) {
+        psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
+            return psc::fmt::format("Layer {} details not parsed {}", id, ex.what());
+        });
+    }
+    if (m_id != id) {   // the range didn't match, keep at least the index
+        psc::log::Log::logAdd(psc::log::Level::Warn, [&] {
+            return psc::fmt::format("Layer {} details found {}", id, m_id);
+        });
+        m_id = id;
+    }
+}
+
 Glib::ustring
 WebMapProduct::get_legend_url()
 {
+    materialize();
     if (!m_legends.empty()) {
         return m_legends[0];    // unsure there are 2 legends (but as we use the default style the first seems to be right)
     }
@@ -268,39 +471,76 @@ WebMapProduct::getCoordRefSystem()
     return m_crs;
 }
 
+// kept by index parse, as these are used for search
 Glib::ustring
 WebMapProduct::get_description()
 {
     return m_abstract;
 }
 
+Glib::ustring
+WebMapProduct::to_ustring(std::string_view text)
+{
+    return Glib::ustring(text.begin(), text.end());
+}
+
+// only some contexts keep the text, so the others need no conversion
+bool
+WebMapProduct::is_text_used()
+{
+    switch (m_context) {
+    case ParseContext::Name:
+    case ParseContext::Title:
+        return m_parseLevel.size() == 2;
+    case ParseContext::CRS:
+        return !m_crs;
+    case ParseContext::westBoundLongitude:
+    case ParseContext::eastBoundLongitude:
+    case ParseContext::southBoundLatitude:
+    case ParseContext::northBoundLatitude:
+        return m_parseLevel.size() == 3
+            && getCoordRefSystem();
+    case ParseContext::Abstract:
+    case ParseContext::Keyword:
+    case ParseContext::Dimension:
+        return true;            // used for search
+    case ParseContext::Attribution:
+        return !m_indexOnly;    // details
+    default:
+        return false;
+    }
+}
+
 void
-WebMapProduct::text(Glib::Markup::ParseContext& context, const Glib::ustring& text)
+WebMapProduct::text(Glib::Markup::ParseContext& context, std::string_view text)
 {
     switch (m_context) {
     case ParseContext::None:
         break;
     case ParseContext::Name:
         if (m_parseLevel.size() == 2) {
-            m_id = text;
+            m_id = to_ustring(text);
         }
         break;
     case ParseContext::Title:
         if (m_parseLevel.size() == 2) {
-            m_name = text;
+            m_name = to_ustring(text);
         }
         break;
     case ParseContext::Abstract:
-        m_abstract = text;
+        m_abstract = to_ustring(text);
         break;
     case ParseContext::KeywordList:
         break;
     case ParseContext::Keyword:
-        m_keywords = text;
+        if (!m_keywords.empty()) {  // keep all
+            m_keywords += " ";
+        }
+        m_keywords += to_ustring(text);
         break;
     case ParseContext::CRS:
         if (!m_crs) {    // keep the first usable
-            m_crs = CoordRefSystem::parse(text);
+            m_crs = CoordRefSystem::parse(to_ustring(text));
             #ifdef WEATHER_DEBUG
             if (m_crs == CoordRefSystem::None) {
                 std::cout << "WebMapProduct::text " << get_id()
@@ -314,7 +554,7 @@ WebMapProduct::text(Glib::Markup::ParseContext& context, const Glib::ustring& te
     case ParseContext::westBoundLongitude:
         if (m_parseLevel.size() == 3    // could check parent element
          && getCoordRefSystem()) {      // only useful with crs defined
-            m_bounds.getWestSouth().parseLongitude(text);
+            m_bounds.getWestSouth().setLongitude(fromGeographic(to_ustring(text), false));
             m_bounds.getWestSouth().setCoordRefSystem(getCoordRefSystem());
             #ifdef WEATHER_DEBUG
             std::cout << "ParseContext::westBoundLongitude "
@@ -328,7 +568,7 @@ WebMapProduct::text(Glib::Markup::ParseContext& context, const Glib::ustring& te
     case ParseContext::eastBoundLongitude:
         if (m_parseLevel.size() == 3
          && getCoordRefSystem()) {      // only useful with crs defined)
-            m_bounds.getEastNorth().parseLongitude(text);
+            m_bounds.getEastNorth().setLongitude(fromGeographic(to_ustring(text), false));
             m_bounds.getEastNorth().setCoordRefSystem(getCoordRefSystem());
             #ifdef WEATHER_DEBUG
             std::cout << "ParseContext::eastBoundLongitude "
@@ -342,7 +582,7 @@ WebMapProduct::text(Glib::Markup::ParseContext& context, const Glib::ustring& te
     case ParseContext::southBoundLatitude:
         if (m_parseLevel.size() == 3
          && getCoordRefSystem()) {      // only useful with crs defined
-            m_bounds.getWestSouth().parseLatitude(text);
+            m_bounds.getWestSouth().setLatitude(fromGeographic(to_ustring(text), true));
             m_bounds.getWestSouth().setCoordRefSystem(getCoordRefSystem());
             #ifdef WEATHER_DEBUG
             std::cout << "ParseContext::southBoundLatitude "
@@ -356,7 +596,7 @@ WebMapProduct::text(Glib::Markup::ParseContext& context, const Glib::ustring& te
     case ParseContext::northBoundLatitude:
         if (m_parseLevel.size() == 3
          && getCoordRefSystem()) {      // only useful with crs defined
-            m_bounds.getEastNorth().parseLatitude(text);
+            m_bounds.getEastNorth().setLatitude(fromGeographic(to_ustring(text), true));
             m_bounds.getEastNorth().setCoordRefSystem(getCoordRefSystem());
             #ifdef WEATHER_DEBUG
             std::cout << "ParseContext::northBoundLatitude "
@@ -378,11 +618,13 @@ WebMapProduct::text(Glib::Markup::ParseContext& context, const Glib::ustring& te
     case ParseContext::BoundingBox:
         break;
     case ParseContext::Dimension:
-        m_dimension = text;
-        parseDimension(m_dimension);
+        m_dimension = to_ustring(text);
+        if (!m_indexOnly) {     // the times are parsed on first use
+            parseDimension(m_dimension);
+        }
         break;
     case ParseContext::Attribution:
-        m_attribution = text;
+        m_attribution = to_ustring(text);
         break;
     case ParseContext::MinScaleDenominator:
         break;
@@ -391,111 +633,147 @@ WebMapProduct::text(Glib::Markup::ParseContext& context, const Glib::ustring& te
     }
 }
 
+// EX_GeographicBoundingBox is always given in degree, convert it to the crs we use
+double
+WebMapProduct::fromGeographic(const Glib::ustring& text, bool latitude)
+{
+    CoordRefSystem crs84(CoordRefSystem::CRS_84);
+    double value = GeoCoordinate::parseDouble(text);
+    if (latitude) {
+        if (m_crs == CoordRefSystem::EPSG_3857) {   // mercator can't reach the poles
+            value = std::clamp(value, -MAX_MERCATOR_LAT, MAX_MERCATOR_LAT);
+        }
+        return m_crs.fromLinearLat(crs84.toLinearLat(value));
+    }
+    return m_crs.fromLinearLon(crs84.toLinearLon(value));
+}
+
 void
 WebMapProduct::parseDimension(const Glib::ustring& dimension)
 {
+    m_timeDimension.parse(dimension);
     std::vector<Glib::ustring> parts;
     StringUtils::split(dimension, '/', parts);
     if (parts.size() == 3) {
-        m_timeDimStart = parts[0];
-        m_timeDimEnd = parts[1];
-        m_timeDimPeriod = parts[2];
-        m_timePeriodSec = periodSeconds(m_timeDimPeriod);
-        #ifdef WEATHER_DEBUG
-        std::cout << "WebMapProduct::parseDimension "
-                  << get_id()
-                  << " got " << dimension
-                  << " end " << m_timeDimEnd
-                  << " dim " << m_timeDimPeriod
-                  << " period " << m_timePeriodSec << "s"
-                  << std::endl;
-        #endif
-    }
-    else {  // alternative discrete values
-        parts.clear();
-        StringUtils::split(dimension, ',', parts);
-        if (parts.size() >= 2) {
-            for (uint32_t i = 0; i < parts.size(); ++i) {
-                if (m_timeDimStart.empty()) {
-                    m_timeDimStart = parts[i];
-                }
-                else {
-                    m_timeDimEnd = parts[i];
-                }
-            }
-        }
+        m_timePeriodSec = periodSeconds(parts[2]);
     }
+    #ifdef WEATHER_DEBUG
+    std::cout << "WebMapProduct::parseDimension "
+              << get_id()
+              << " got " << dimension
+              << " times " << m_timeDimension.get_count()
+              << " period " << m_timePeriodSec << "s"
+              << std::endl;
+    #endif
 }
 
-
-/*
-D.3 periods
-An ISO 8601 Period is used to indicate the time resolution of the available data. The ISO 8601 format for
-representing a period of time is used to represent the resolution: Designator P (for Period), number of years Y,
-months M, days D, time designator T, number of hours H, minutes M, seconds S. Unneeded elements may be
-omitted.
-EXAMPLE 1 P1Y — 1 year
-EXAMPLE 2 P1M10D — 1 month plus 10 days
-EXAMPLE 3 PT2H — 2 hours
-EXAMPLE 4 PT1.5S — 1.5 seconds
- * but no one elaborates on just P ...(when we guess from end that is ~30min behind now, what just may be delay, no live images :( )
-*/
+// the period limited by the configured minimum (avoids refreshing too often)
 int
 WebMapProduct::periodSeconds(const Glib::ustring& timeDimPeriod)
 {
-    int timePeriodSec{0};
-    int val = 0;
-    bool time = false;
-    for (uint32_t i = 0; i < timeDimPeriod.size(); ++i) {
-        gunichar c = timeDimPeriod.at(i);
-        if (i == 0 && c != 'P') {
-            break;
-        }
-        else {
-            if (c == 'T') {
-                time = true;
-            }
-            else {
-                if (g_unichar_isdigit(c)) {    // wont recognize decimal
-                    val = val * 10 + g_unichar_xdigit_value(c);
-                }
-                else if (!time) {
-                    if (c == 'D') {
-                        timePeriodSec += val * SECS_PER_DAY;
-                        val = 0;
-                    }
-                    else if (c == 'M') {  // ~ estimate
-                        timePeriodSec += val * SECS_PER_MONTH;
-                        val = 0;
-                    }
-                    else if (c == 'Y') {  // ~ estimate
-                        timePeriodSec += val  * SECS_PRE_YEAR;
-                        val = 0;
-                    }
-                }
-                else {
-                    if (c == 'H') {
-                        timePeriodSec += val * SECS_PER_HOUR;
-                        val = 0;
-                    }
-                    else if (c == 'M') {
-                        timePeriodSec += val * SECS_PER_MINUTE;
-                        val = 0;
-                    }
-                    else if (c == 'S') {
-                        timePeriodSec += val;
-                        val = 0;
-                    }
-                }
-            }
-        }
-    }
+    int timePeriodSec = TimeDimension::parse_period(timeDimPeriod);
     if (timePeriodSec < m_webMapService->getMinPeriodSec()) {
         timePeriodSec = m_webMapService->getMinPeriodSec();
     }
     return timePeriodSec;
 }
 
+// a layer that was not used is kept as text, so it is parsed only when needed
+void
+WebMapProduct::write(CatalogWriter& writer)
+{
+    WeatherProduct::write(writer);
+    writer.put_string(m_crs.identifier());
+    writer.put_string(m_layerChecksum);
+    writer.put_string(m_abstract);
+    writer.put_string(m_keywords);
+    writer.put_string(m_dimension);
+    if (m_document) {
+        writer.put_u32(LAYER_TEXT);
+        writer.put_string(m_document->get_range(m_layerStart, m_layerEnd));
+        return;
+    }
+    writer.put_u32(LAYER_DETAILS);
+    writer.put_string(m_attribution);
+    writer.put_strings(m_legends);
+}
+
+bool
+WebMapProduct::read(CatalogReader& reader)
+{
+    WeatherProduct::read(reader);
+    m_crs = CoordRefSystem::parse(reader.get_string());
+    m_layerChecksum = reader.get_string();
+    m_abstract = reader.get_string();
+    m_keywords = reader.get_string();
+    m_dimension = reader.get_string();
+    m_timeDimension.clear();
+    if (reader.get_u32() == LAYER_TEXT) {
+        auto layer = reader.get_string();
+        auto document = std::make_shared<CapabilitiesDocument>();
+        document->append(layer.data(), layer.bytes());
+        m_document = document;
+        m_layerStart = 0;
+        m_layerEnd = layer.bytes();
+        m_indexOnly = true;
+        return reader.is_valid();
+    }
+    m_document.reset();
+    m_attribution = reader.get_string();
+    m_legends = reader.get_strings();
+    if (!m_dimension.empty()) {
+        parseDimension(m_dimension);
+    }
+    return reader.is_valid();
+}
+
+bool
+WebMapProduct::is_same(WeatherProduct& other)
+{
+    auto webMapOther = dynamic_cast<WebMapProduct*>(&other);
+    if (!webMapOther
+     || m_layerChecksum.empty()
+     || webMapOther->m_layerChecksum.empty()) {
+        return WeatherProduct::is_same(other);
+    }
+    // the index values may differ by the extent that is kept
+    CatalogWriter current;
+    WeatherProduct::write(current);
+    CatalogWriter updated;
+    webMapOther->WeatherProduct::write(updated);
+    return current.get_data() == updated.get_data()
+        && m_crs == webMapOther->m_crs
+        && m_layerChecksum == webMapOther->m_layerChecksum;
+}
+
+// copies the state as is, a layer not yet materialized stays so
+void
+WebMapProduct::take(WeatherProduct& other)
+{
+    auto webMapOther = dynamic_cast<WebMapProduct*>(&other);
+    if (!webMapOther) {
+        WeatherProduct::take(other);
+        return;
+    }
+    CatalogWriter updated;
+    webMapOther->WeatherProduct::write(updated);
+    CatalogReader reader(std::string(updated.get_data()));
+    WeatherProduct::read(reader);
+    m_crs = webMapOther->m_crs;
+    m_abstract = webMapOther->m_abstract;
+    m_keywords = webMapOther->m_keywords;
+    m_attribution = webMapOther->m_attribution;
+    m_dimension = webMapOther->m_dimension;
+    m_legends = webMapOther->m_legends;
+    m_timeDimension = webMapOther->m_timeDimension;
+    m_timePeriodSec = webMapOther->m_timePeriodSec;
+    m_indexOnly = webMapOther->m_indexOnly;
+    m_document = webMapOther->m_document;
+    m_layerStart = webMapOther->m_layerStart;
+    m_layerEnd = webMapOther->m_layerEnd;
+    m_layerChecksum = webMapOther->m_layerChecksum;
+}
+
 bool
 WebMapProduct::is_displayable()
 {
@@ -503,15 +781,36 @@ WebMapProduct::is_displayable()
     return displayable;
 }
 
+int
+WebMapProduct::get_period_sec()
+{
+    materialize();
+    return m_timePeriodSec;
+}
+
+Glib::ustring
+WebMapProduct::get_keywords()
+{
+    return m_keywords;
+}
+
 Glib::ustring
 WebMapProduct::get_dimension()
 {
     return m_dimension;
 }
 
+const TimeDimension&
+WebMapProduct::get_time_dimension()
+{
+    materialize();
+    return m_timeDimension;
+}
+
 bool
 WebMapProduct::is_latest()
 {
+    materialize();
     Glib::DateTime utcLatest = getLatestTime();
     if (utcLatest) {
         utcLatest = utcLatest.add_seconds(m_timePeriodSec);
@@ -521,14 +820,14 @@ WebMapProduct::is_latest()
         std::cout << "WebMapProduct::is_latest "
                   << get_id()
                   << " period " << m_timePeriodSec
-                  << " dimEnd " << m_timeDimEnd
+                  << " dimEnd " << TimeDimension::to_date_time(m_timeDimension.get_end()).format_iso8601()
                   << " latest " << utcLatest.format_iso8601()
                   << " now " << now.format_iso8601()
                   << " cmp " << now.compare(utcLatest)
                   << std::endl;
         #endif
         if (now.compare(utcLatest) >= 0) {   // we passed the expected time
-            m_timeDimEnd = utcLatest.format_iso8601();
+            m_timeDimension.extend(utcLatest.to_unix());
             return false;
         }
     }
@@ -551,26 +850,26 @@ WebMapProduct::set_legend(Glib::RefPtr<Gdk::Pixbuf>& legendImage)
 Glib::DateTime
 WebMapProduct::getLatestTime()
 {
+    materialize();
     Glib::DateTime latestTime;
-    if (!m_timeDimEnd.empty()) {
-        auto iso8601 = m_timeDimEnd;
-        auto tz = Glib::TimeZone::create_utc();
-        latestTime = Glib::DateTime::create_from_iso8601(iso8601, tz);
+    if (!m_timeDimension.empty()) {
+        gint64 latest = m_timeDimension.get_end();
         if (m_webMapService->getServiceConf()->isViewCurrentTime()) {
-            auto now = Glib::DateTime::create_now_utc();
-            now = now.add_seconds(-m_webMapService->getServiceConf()->getDelaySec()); // compare with past as service introduce delay
+            // dwd will include prognosis, use the latest that is visible now (as service introduce delay)
+            gint64 now = g_get_real_time() / G_USEC_PER_SEC - m_webMapService->getServiceConf()->getDelaySec();
+            if (!m_timeDimension.find_latest(now, latest)) {
+                latest = m_timeDimension.get_start();  // all in future, use the first
+            }
             psc::log::Log::logAdd(psc::log::Level::Debug, [&] {
-                return psc::fmt::format("getLatestTime use now {} delay {}s period {}s using adjusting {}"
-                        , now.format_iso8601(), m_webMapService->getServiceConf()->getDelaySec(), m_timePeriodSec, latestTime.format_iso8601());
+                return psc::fmt::format("getLatestTime use now {} delay {}s adjusted {}"
+                        , now, m_webMapService->getServiceConf()->getDelaySec(), latest);
             });
-            while (latestTime.compare(now) > 0) {                   // dwd will include prognosis but we are more so keep rolling
-                latestTime = latestTime.add_seconds(-m_timePeriodSec);
-            }
         }
+        latestTime = TimeDimension::to_date_time(latest);
     }
     psc::log::Log::logAdd(psc::log::Level::Debug, [&] {
         return psc::fmt::format("result using {}"
-                , latestTime.format_iso8601());
+                , latestTime ? latestTime.format_iso8601() : Glib::ustring{});
     });
     return latestTime;
 }
@@ -600,65 +899,391 @@ WebMapService::WebMapService(WeatherConsumer* consumer, const std::shared_ptr<We
 {
 }
 
+WebMapService::~WebMapService()
+{
+    if (m_capabilitiesLoader) {
+        m_capabilitiesLoader->detach();
+    }
+}
+
 void
 WebMapService::capabilities()
 {
-    auto message = std::make_shared<SpoonMessageDirect>(getServiceConf()->getAddress(), "");
+    if (load_catalog()) {
+        return;
+    }
+    auto message = std::make_shared<SpoonMessageStream>(getServiceConf()->getAddress(), "");
     message->addQuery("service", "WMS");
     message->addQuery("version", "1.3.0");
     message->addQuery("request", "GetCapabilities");
+    add_validators(*message);
     message->signal_receive().connect(sigc::mem_fun(*this, &WebMapService::inst_on_capabilities_callback));
     logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("capabilities url %s", message->get_url()));
     getSpoonSession()->send(message);
 }
 
 void
-WebMapService::inst_on_capabilities_callback(const Glib::ustring& error, int status, SpoonMessageDirect* message)
+WebMapService::inst_on_capabilities_callback(const Glib::ustring& error, int status, SpoonMessageStream* message)
 {
     if (!error.empty()) {
         logMsg(psc::log::Level::Warn, Glib::ustring::sprintf("capabilities %s", error));
         return;
     }
+    if (is_catalog_confirmed(status, message)) {
+        return;
+    }
     if (status != SpoonMessage::OK) {
         logMsg(psc::log::Level::Warn, Glib::ustring::sprintf("capabilities response %d %s", status, SpoonMessage::decodeStatus(status)));
         return;
     }
-    auto data = message->get_bytes();
-    if (!data) {
+    auto stream = message->get_stream();
+    if (!stream) {
         logMsg(psc::log::Level::Warn, "capabilities no data");
         return;
     }
-    logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("capabilities len %d", data->size()));
-
-    NXMLParser parser(this);
-    Glib::Markup::ParseContext context(parser);	// , Glib::Markup::ParseFlags::TREAT_CDATA_AS_TEXT
-    m_products.clear();
-    auto start = reinterpret_cast<const char*>(data->get_data());
-    auto end = start + data->size();
-    try {
-        context.parse(start, end);  // could feed this incrementally
-        context.end_parse();
+    if (m_capabilitiesLoader) {     // a previous load is obsolete
+        m_capabilitiesLoader->detach();
     }
-    catch (const Glib::MarkupError& ex) {
-        logMsg(psc::log::Level::Error, Glib::ustring::sprintf("Markup error %s", ex.what()));
+    begin_products();
+    m_capabilitiesLoader = std::make_shared<WebMapCapabilitiesLoader>(this);
+    m_capabilitiesLoader->start(stream);
+}
+
+void
+WebMapService::add_parsed_product(const std::shared_ptr<WebMapProduct>& product)
+{
+    merge_product(product);
+}
+
+void
+WebMapService::capabilities_loaded(const Glib::ustring& error)
+{
+    if (!error.empty()) {
+        logMsg(psc::log::Level::Error, Glib::ustring::sprintf("Markup error %s", error));
     }
     #ifdef WEATHER_DEBUG
     int usable = 0;
-    for (auto entry : m_products) {
-        auto prod = entry.second;
+    for (auto& prod : m_products) {
         if (prod->is_displayable()) {
             ++usable;
         }
         else {
-            std::cout << "WebMapService::inst_on_capabilities_callback unusable  " << prod->get_id() << std::endl;
+            std::cout << "WebMapService::capabilities_loaded unusable  " << prod->get_id() << std::endl;
         }
     }
-    std::cout << "WebMapService::inst_on_capabilities_callback got " << m_products.size() << " products usable " << usable << std::endl;
+    std::cout << "WebMapService::capabilities_loaded got " << m_products.size() << " products usable " << usable << std::endl;
     #endif
-    logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("capabilities products decoded %d", m_products.size()));
+    logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("capabilities products decoded %zu", m_products.size()));
+    end_products(error.empty());
+    if (error.empty()) {
+        save_catalog();
+    }
     m_signal_products_completed.emit();
 }
 
+std::shared_ptr<WeatherProduct>
+WebMapService::create_product()
+{
+    return std::make_shared<WebMapProduct>(this);
+}
+
+void
+WebMapService::write_catalog_extra(CatalogWriter& writer)
+{
+    writer.put_u32(static_cast<guint32>(m_maxWidth));
+    writer.put_u32(static_cast<guint32>(m_maxHeight));
+}
+
+void
+WebMapService::read_catalog_extra(CatalogReader& reader)
+{
+    int maxWidth = static_cast<int>(reader.get_u32());
+    int maxHeight = static_cast<int>(reader.get_u32());
+    set_max_size(maxWidth, maxHeight);
+}
+
+void
+WebMapService::set_max_size(int maxWidth, int maxHeight)
+{
+    m_maxWidth = maxWidth;
+    m_maxHeight = maxHeight;
+}
+
+// split a hemisphere of product into tiles
+//   the tiles are built in the linear (target) space, so each tile can be mapped on its own.
+//   The outer row of tiles is extended to the pole so the space beyond the product gets cleared.
+void
+WebMapService::plan_hemisphere(const GeoBounds& bounds, int image_size, bool north, std::vector<WebMapTile>& tiles)
+{
+    CoordRefSystem crs84(CoordRefSystem::CRS_84);
+    auto westSouth = bounds.getWestSouth();
+    auto eastNorth = bounds.getEastNorth();
+    auto crs = westSouth.getCoordRefSystem();
+    int image_size2 = image_size / 2;
+    auto toPixX = [&] (double linLon) {
+        return std::clamp(static_cast<int>(std::round((linLon + 1.0) / 2.0 * image_size)), 0, image_size);
+    };
+    auto toPixY = [&] (double linLat) {
+        return std::clamp(static_cast<int>(std::round((1.0 - linLat) / 2.0 * image_size)), 0, image_size);
+    };
+    auto toLinLon = [&] (int pixX) {
+        return static_cast<double>(pixX) / image_size * 2.0 - 1.0;
+    };
+    auto toLinLat = [&] (int pixY) {
+        return 1.0 - static_cast<double>(pixY) / image_size * 2.0;
+    };
+    int x0 = toPixX(westSouth.getLinearLongitude());
+    int x1 = toPixX(eastNorth.getLinearLongitude());
+    int y0 = north ? toPixY(eastNorth.getLinearLatitude()) : image_size2;
+    int y1 = north ? image_size2 : toPixY(westSouth.getLinearLatitude());
+    if (x1 <= x0 || y1 <= y0) {
+        return;
+    }
+    int tileSize = getServiceConf()->getTileSize();
+    if (tileSize <= 0) {
+        tileSize = image_size2;
+    }
+    int limitWidth = m_maxWidth > 0 ? std::min(m_maxWidth, tileSize) : tileSize;
+    int limitHeight = m_maxHeight > 0 ? std::min(m_maxHeight, tileSize) : tileSize;
+    int columns = (x1 - x0 + limitWidth - 1) / limitWidth;
+    int rows = (y1 - y0 + limitHeight - 1) / limitHeight;
+    double equatorLat = crs.fromLinearLat(0.0);
+    for (int row = 0; row < rows; ++row) {
+        int ty0 = y0 + (y1 - y0) * row / rows;
+        int ty1 = y0 + (y1 - y0) * (row + 1) / rows;
+        // use the exact product values at the outer edges
+        double srcNorth = (row == 0)
+                        ? (north ? eastNorth.getLatitude() : equatorLat)
+                        : crs.fromLinearLat(toLinLat(ty0));
+        double srcSouth = (row == rows - 1)
+                        ? (north ? equatorLat : westSouth.getLatitude())
+                        : crs.fromLinearLat(toLinLat(ty1));
+        int pixY0 = (north && row == 0) ? 0 : ty0;
+        int pixY1 = (!north && row == rows - 1) ? image_size : ty1;
+        for (int column = 0; column < columns; ++column) {
+            int tx0 = x0 + (x1 - x0) * column / columns;
+            int tx1 = x0 + (x1 - x0) * (column + 1) / columns;
+            double srcWest = (column == 0)
+                           ? westSouth.getLongitude()
+                           : crs.fromLinearLon(toLinLon(tx0));
+            double srcEast = (column == columns - 1)
+                           ? eastNorth.getLongitude()
+                           : crs.fromLinearLon(toLinLon(tx1));
+            WebMapTile tile{
+                  GeoBounds{srcWest, srcSouth, srcEast, srcNorth, crs}
+                , tx1 - tx0
+                , ty1 - ty0
+                , GeoBounds{crs84.fromLinearLon(toLinLon(tx0)), crs84.fromLinearLat(toLinLat(pixY1))
+                          , crs84.fromLinearLon(toLinLon(tx1)), crs84.fromLinearLat(toLinLat(pixY0))
+                          , crs84}
+                , tx0
+                , pixY0
+                , tx1 - tx0
+                , pixY1 - pixY0};
+            tiles.push_back(tile);
+        }
+    }
+}
+
+// use the cells of a global grid that intersect bounds,
+//   the cells are a power of two subdivision of CRS:84 sized to fit the limits.
+//   So the requests only depend on crs, cell and image_size.
+void
+WebMapService::plan_grid(const GeoBounds& bounds, int image_size, std::vector<WebMapTile>& tiles)
+{
+    CoordRefSystem crs84(CoordRefSystem::CRS_84);
+    auto westSouth = bounds.getWestSouth();
+    auto eastNorth = bounds.getEastNorth();
+    auto crs = westSouth.getCoordRefSystem();
+    int tileSize = getServiceConf()->getTileSize();
+    if (tileSize <= 0) {
+        tileSize = image_size / 2;
+    }
+    int limit = tileSize;
+    if (m_maxWidth > 0) {
+        limit = std::min(limit, m_maxWidth);
+    }
+    if (m_maxHeight > 0) {
+        limit = std::min(limit, m_maxHeight);
+    }
+    int cells = 1;
+    while (cells < MAX_GRID_CELLS
+        && image_size / cells > limit) {
+        cells *= 2;
+    }
+    auto toPix = [&] (int cell) {
+        return static_cast<int>(static_cast<gint64>(cell) * image_size / cells);
+    };
+    auto toLin = [&] (int cell) {     // cell edge as linear value -1...1
+        return static_cast<double>(cell) / cells * 2.0 - 1.0;
+    };
+    // mercator can't reach the poles, use a limit independent of product
+    double maxLinLat = crs == CoordRefSystem::EPSG_3857
+                     ? crs84.toLinearLat(WeatherProduct::MAX_MERCATOR_LAT)
+                     : 1.0;
+    double linWest = westSouth.getLinearLongitude();
+    double linEast = eastNorth.getLinearLongitude();
+    double linSouth = westSouth.getLinearLatitude();
+    double linNorth = eastNorth.getLinearLatitude();
+    int column0 = std::clamp(static_cast<int>(std::floor((linWest + 1.0) / 2.0 * cells)), 0, cells);
+    int column1 = std::clamp(static_cast<int>(std::ceil((linEast + 1.0) / 2.0 * cells)), 0, cells);
+    int row0 = std::clamp(static_cast<int>(std::floor((1.0 - linNorth) / 2.0 * cells)), 0, cells);
+    int row1 = std::clamp(static_cast<int>(std::ceil((1.0 - linSouth) / 2.0 * cells)), 0, cells);
+    // the product area in pixels, anything else is cropped
+    int cropX0 = std::clamp(static_cast<int>(std::round((linWest + 1.0) / 2.0 * image_size)), 0, image_size);
+    int cropX1 = std::clamp(static_cast<int>(std::round((linEast + 1.0) / 2.0 * image_size)), 0, image_size);
+    int cropY0 = std::clamp(static_cast<int>(std::round((1.0 - linNorth) / 2.0 * image_size)), 0, image_size);
+    int cropY1 = std::clamp(static_cast<int>(std::round((1.0 - linSouth) / 2.0 * image_size)), 0, image_size);
+    for (int row = row0; row < row1; ++row) {
+        double cellNorth = std::min(-toLin(row), maxLinLat);
+        double cellSouth = std::max(-toLin(row + 1), -maxLinLat);
+        if (cellNorth <= cellSouth) {
+            continue;   // beyond mercator
+        }
+        int pixY0 = std::clamp(static_cast<int>(std::round((1.0 - cellNorth) / 2.0 * image_size)), 0, image_size);
+        int pixY1 = std::clamp(static_cast<int>(std::round((1.0 - cellSouth) / 2.0 * image_size)), 0, image_size);
+        for (int column = column0; column < column1; ++column) {
+            int pixX0 = toPix(column);
+            int pixX1 = toPix(column + 1);
+            if (pixX1 <= pixX0 || pixY1 <= pixY0) {
+                continue;
+            }
+            WebMapTile tile{
+                  GeoBounds{crs.fromLinearLon(toLin(column)), crs.fromLinearLat(cellSouth)
+                          , crs.fromLinearLon(toLin(column + 1)), crs.fromLinearLat(cellNorth)
+                          , crs}
+                , pixX1 - pixX0
+                , pixY1 - pixY0
+                , GeoBounds{crs84.fromLinearLon(toLin(column)), crs84.fromLinearLat(cellSouth)
+                          , crs84.fromLinearLon(toLin(column + 1)), crs84.fromLinearLat(cellNorth)
+                          , crs84}
+                , pixX0
+                , pixY0
+                , pixX1 - pixX0
+                , pixY1 - pixY0};
+            tile.crop = pixX0 < cropX0 || pixX1 > cropX1 || pixY0 < cropY0 || pixY1 > cropY1;
+            tile.cropX = cropX0;
+            tile.cropY = cropY0;
+            tile.cropWidth = cropX1 - cropX0;
+            tile.cropHeight = cropY1 - cropY0;
+            tiles.push_back(tile);
+        }
+    }
+}
+
+std::vector<WebMapTile>
+WebMapService::plan_tiles(const std::shared_ptr<WebMapProduct>& product, int image_size)
+{
+    auto westSouth = product->getWestSouth();
+    auto eastNorth = product->getEastNorth();
+    GeoBounds bounds{westSouth.getLongitude(), westSouth.getLatitude()
+                   , eastNorth.getLongitude(), eastNorth.getLatitude(), product->getCoordRefSystem()};
+    return plan_tiles(bounds, image_size);
+}
+
+std::vector<WebMapTile>
+WebMapService::plan_tiles(const GeoBounds& bounds, int image_size)
+{
+    std::vector<WebMapTile> tiles;
+    if (getServiceConf()->isGridAligned()) {
+        plan_grid(bounds, image_size, tiles);
+        return tiles;
+    }
+    if (bounds.getEastNorth().getLatitude() > 0.0) {    // query if needed
+        plan_hemisphere(bounds, image_size, true, tiles);
+    }
+    if (bounds.getWestSouth().getLatitude() < 0.0) {
+        plan_hemisphere(bounds, image_size, false, tiles);
+    }
+    return tiles;
+}
+
+Glib::ustring
+WebMapService::compound_id(const std::vector<std::shared_ptr<WebMapProduct>>& products)
+{
+    Glib::ustring id;
+    for (auto& product : products) {
+        if (!id.empty()) {
+            id += ",";
+        }
+        id += product->get_id();
+    }
+    return id;
+}
+
+void
+WebMapService::request_layers(const std::vector<Glib::ustring>& productIds)
+{
+    // group by what has to match for one request, keeping the order of layers
+    std::vector<std::pair<Glib::ustring, std::vector<std::shared_ptr<WebMapProduct>>>> groups;
+    for (auto& productId : productIds) {
+        auto product = std::dynamic_pointer_cast<WebMapProduct>(find_product(productId));
+        if (!product) {
+            logMsg(psc::log::Level::Warn, Glib::ustring::sprintf("request layer %s not found", productId));
+            continue;
+        }
+        auto latest = product->getLatestTime();
+        auto key = product->getCoordRefSystem().identifier() + "|" + (latest ? latest.format_iso8601() : Glib::ustring{});
+        auto group = std::find_if(groups.begin(), groups.end(), [&] (const auto& entry) {
+            return entry.first == key;
+        });
+        if (group == groups.end()) {
+            groups.emplace_back(key, std::vector<std::shared_ptr<WebMapProduct>>{product});
+        }
+        else {
+            group->second.push_back(product);
+        }
+    }
+    for (auto& group : groups) {
+        if (group.second.size() == 1) {
+            request(group.second.front()->get_id());
+        }
+        else {
+            request_compound(group.second);
+        }
+    }
+}
+
+void
+WebMapService::refresh_layers(const std::vector<Glib::ustring>& productIds)
+{
+    for (auto& productId : productIds) {
+        set_refreshing(productId, true);
+    }
+    request_layers(productIds);
+    for (auto& productId : productIds) {
+        set_refreshing(productId, false);
+    }
+}
+
+void
+WebMapService::request_compound(const std::vector<std::shared_ptr<WebMapProduct>>& products)
+{
+    auto layers = compound_id(products);
+    serve_last(layers);
+    // cover the union of the layers (the server leaves the rest transparent)
+    auto westSouth = products.front()->getWestSouth();
+    auto eastNorth = products.front()->getEastNorth();
+    double west = westSouth.getLongitude();
+    double south = westSouth.getLatitude();
+    double east = eastNorth.getLongitude();
+    double north = eastNorth.getLatitude();
+    for (auto& product : products) {
+        west = std::min(west, product->getWestSouth().getLongitude());
+        south = std::min(south, product->getWestSouth().getLatitude());
+        east = std::max(east, product->getEastNorth().getLongitude());
+        north = std::max(north, product->getEastNorth().getLatitude());
+    }
+    GeoBounds bounds{west, south, east, north, products.front()->getCoordRefSystem()};
+    auto tiles = plan_tiles(bounds, m_consumer->get_weather_image_size());
+    for (auto& tile : tiles) {
+        auto request = std::make_shared<WebMapImageRequest>(this, tile, products);
+        logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("request %s", request->get_url()));
+        send_image(request);
+    }
+    logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("request %s tiles %zu", layers, tiles.size()));
+}
+
 void
 WebMapService::request(const Glib::ustring& productId)
 {
@@ -668,81 +1293,17 @@ WebMapService::request(const Glib::ustring& productId)
         logMsg(psc::log::Level::Warn, Glib::ustring::sprintf("request product %s not found", productId));
         return;
     }
+    serve_last(productId);  // show what we know while fetching
 
-    int image_size = m_consumer->get_weather_image_size() ;
-    int image_size2 = image_size / 2;
-    // always query in four steps
-    // as we reduced the number of requests send them all at once
-    CoordRefSystem crs84(CoordRefSystem::CRS_84);
-    auto greenLon = product->getWestSouth().getCoordRefSystem().fromLinearLon(crs84.toLinearLon(0.0));
-    auto equatorLat = product->getWestSouth().getCoordRefSystem().fromLinearLat(crs84.toLinearLat(0.0));
-    if (product->getEastNorth().getLatitude() > 0.0) {    // query if needed
-        if (product->getWestSouth().getLongitude() < 0.0) {
-            double linLonWest = std::abs(product->getWestSouth().getLinearLongitude());
-            int xOffs = static_cast<int>(linLonWest * image_size2);
-            GeoBounds boundsWN{
-                product->getWestSouth().getLongitude(), equatorLat
-                , greenLon, product->getEastNorth().getLatitude()
-                , product->getWestSouth().getCoordRefSystem()};
-            auto requestWN = std::make_shared<WebMapImageRequest>(this
-                        , boundsWN
-                        , image_size2 - xOffs, 0
-                        , xOffs, image_size2
-                        , product);
-            logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("request NW %s", requestWN->get_url()));
-            getSpoonSession()->send(requestWN);
-        }
-        if (product->getEastNorth().getLongitude() > 0.0) {
-            double linLonEast = product->getEastNorth().getLinearLongitude();
-            int xOffs = static_cast<int>(linLonEast * image_size2);
-            GeoBounds boundsEN{
-                greenLon, equatorLat
-                , product->getEastNorth().getLongitude(), product->getEastNorth().getLatitude()
-                , product->getEastNorth().getCoordRefSystem()
-            };
-            auto requestEN = std::make_shared<WebMapImageRequest>(this
-                        , boundsEN
-                        , image_size2, 0
-                        , xOffs, image_size2
-                        , product);
-            #ifdef WEATHER_DEBUG
-            std::cout << "WebMapService::request product " << product->get_id() << " url " << requestEN->get_url() << std::endl;
-            #endif
-            getSpoonSession()->send(requestEN);
-        }
-    }
-    if (product->getWestSouth().getLatitude() < 0.0) {    // query if needed
-        if (product->getWestSouth().getLongitude() < 0.0) {
-            double linLonWest = std::abs(product->getWestSouth().getLinearLongitude());
-            int xOffs = static_cast<int>(linLonWest * image_size2);
-            GeoBounds boundsWS{
-                product->getWestSouth().getLongitude(), product->getWestSouth().getLatitude()
-                , greenLon, equatorLat
-                , product->getEastNorth().getCoordRefSystem()
-            };
-            auto requestWS = std::make_shared<WebMapImageRequest>(this
-                        , boundsWS
-                        , image_size2 - xOffs, image_size2
-                        , xOffs, image_size2
-                        , product);
-            getSpoonSession()->send(requestWS);
-        }
-        if (product->getEastNorth().getLongitude() > 0.0) {
-            double linLonEast = product->getEastNorth().getLinearLongitude();
-            int xOffs = static_cast<int>(linLonEast * image_size2);
-            GeoBounds boundsES{
-                greenLon, product->getWestSouth().getLatitude()
-                , product->getEastNorth().getLongitude(), equatorLat
-                , product->getWestSouth().getCoordRefSystem()
-            };
-            auto requestES = std::make_shared<WebMapImageRequest>(this
-                        , boundsES
-                        , image_size2, image_size2
-                        , xOffs, image_size2
-                        , product);
-            getSpoonSession()->send(requestES);
-        }
+    int image_size = m_consumer->get_weather_image_size();
+    auto tiles = plan_tiles(product, image_size);
+    // as the session allows some connections per host send them all at once
+    for (auto& tile : tiles) {
+        auto request = std::make_shared<WebMapImageRequest>(this, tile, product);
+        logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("request %s", request->get_url()));
+        send_image(request);
     }
+    logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("request %s tiles %zu", productId, tiles.size()));
 }
 
 void
@@ -755,11 +1316,29 @@ WebMapService::check_product(const Glib::ustring& weatherProductId)
             #ifdef WEATHER_DEBUG
             std::cout << "WebMapService::check_product requested" << std::endl;
             #endif
-            request(weatherProductId);
+            refresh(weatherProductId);
         }
     }
 }
 
+// the next time is expected a period after the latest, and it takes delay to be visible
+gint64
+WebMapService::get_next_check_sec(const Glib::ustring& weatherProductId)
+{
+    auto product = std::dynamic_pointer_cast<WebMapProduct>(find_product(weatherProductId));
+    if (!product) {
+        return DEFAULT_CHECK_SEC;
+    }
+    auto latest = product->getLatestTime();
+    if (!latest) {
+        return std::max(static_cast<gint64>(product->get_period_sec()), static_cast<gint64>(MIN_CHECK_SEC));
+    }
+    auto next = latest.add_seconds(product->get_period_sec() + getServiceConf()->getDelaySec());
+    auto now = Glib::DateTime::create_now_utc();
+    gint64 sec = next.difference(now) / G_TIME_SPAN_SECOND;
+    return std::max(sec, static_cast<gint64>(MIN_CHECK_SEC));
+}
+
 Glib::RefPtr<Gdk::Pixbuf>
 WebMapService::get_legend(std::shared_ptr<WeatherProduct>& product)
 {
@@ -771,22 +1350,69 @@ WebMapService::get_legend(std::shared_ptr<WeatherProduct>& product)
             return Glib::RefPtr<Gdk::Pixbuf>();
         }
         auto legendURL = webMapProduct->get_legend_url();
+        if (legendURL.empty()) {
+            return legend;
+        }
         auto legendReq = std::make_shared<SpoonMessageDirect>(legendURL, "");
-        legendReq->signal_receive().connect(
-                    sigc::bind<std::shared_ptr<WeatherProduct>>(
-                        sigc::mem_fun(*this, &WebMapService::inst_on_legend_callback), webMapProduct));
         #ifdef WEATHER_DEBUG
         std::cout << "WebMapService::get_legend " << legendURL  << std::endl;
         #endif
-        getSpoonSession()->send(legendReq);
+        send_legend(legendReq, product);
+        legend = product->get_legend();     // if it was cached
     }
     return legend;
 }
 
 
-NXMLParser::NXMLParser(WebMapService* webMapService)
+WebMapLayerParser::WebMapLayerParser(WebMapProduct* webMapProduct)
+: m_webMapProduct{webMapProduct}
+{
+}
+
+void
+WebMapLayerParser::on_start_element(Glib::Markup::ParseContext& context,
+        const Glib::ustring& element_name,
+        const Glib::Markup::Parser::AttributeMap& attributes)
+{
+    if (element_name == "Layer") {     // as NXMLParser the layer is not passed
+        ++m_layerDepth;
+    }
+    else if (m_layerDepth <= 1) {
+        m_webMapProduct->start_element(context, element_name, attributes);
+    }
+}
+
+void
+WebMapLayerParser::on_end_element(Glib::Markup::ParseContext& context,
+		const Glib::ustring& element_name)
+{
+    if (element_name == "Layer") {
+        --m_layerDepth;
+    }
+    else if (m_layerDepth <= 1) {
+        m_webMapProduct->end_element(context, element_name);
+    }
+}
+
+void
+WebMapLayerParser::on_text(Glib::Markup::ParseContext& context,
+		const Glib::ustring& text)
+{
+    if (m_layerDepth <= 1
+     && m_webMapProduct->is_text_used()) {
+        auto repl = StringUtils::replaceAll(text, "&#13;", "\r");
+        repl = StringUtils::replaceAll(repl, "&#10;", "\n");
+        m_webMapProduct->text(context, std::string_view(repl.data(), repl.bytes()));
+    }
+}
+
+NXMLParser::NXMLParser(WebMapService* webMapService, const type_slot_product& productSlot, const type_slot_limits& limitsSlot
+                , const std::shared_ptr<CapabilitiesDocument>& document)
 : m_webMapService{webMapService}
 , m_webMapProduct{}
+, m_productSlot{productSlot}
+, m_limitsSlot{limitsSlot}
+, m_document{document}
 {
 }
 
@@ -795,12 +1421,31 @@ NXMLParser::on_start_element(Glib::Markup::ParseContext& context,
         const Glib::ustring& element_name,
         const Glib::Markup::Parser::AttributeMap& attributes)
 {
-    if (element_name == "Layer") {
+    if (!m_webMapProduct
+     && (element_name == "MaxWidth"
+      || element_name == "MaxHeight")) {
+        m_serviceElement = element_name;
+    }
+    else if (element_name == "Layer") {
+        ++m_layerCount;
+        if (m_document) {   // the parser gives no byte positions, so count the layers in text
+            while (m_scanCount < m_layerCount) {
+                m_layerStart = m_document->find_start_tag("Layer", m_scanOffset);
+                if (m_layerStart == std::string::npos) {
+                    break;
+                }
+                m_scanOffset = m_layerStart + 1;
+                ++m_scanCount;
+            }
+        }
+        std::shared_ptr<WebMapProduct> product;
         auto queryable = attributes.find("queryable");
         if (queryable != attributes.end()
          && queryable->second == "1") {    // ignore global layer, and not queryable ?
-            m_webMapProduct = std::make_shared<WebMapProduct>(m_webMapService);
+            product = std::make_shared<WebMapProduct>(m_webMapService, static_cast<bool>(m_document));
         }
+        m_layers.push_back(OpenLayer{product, m_layerStart});
+        m_webMapProduct = product;
     }
     else if (m_webMapProduct) {
         m_webMapProduct->start_element(context, element_name, attributes);
@@ -812,11 +1457,31 @@ NXMLParser::on_end_element(Glib::Markup::ParseContext& context,
 		const Glib::ustring& element_name)
 {
     if (element_name == "Layer") {
-        if (m_webMapProduct) {
-            m_webMapService->add_product(m_webMapProduct);
+        if (m_layers.empty()) {
+            return;
+        }
+        auto layer = m_layers.back();
+        m_layers.pop_back();
+        if (layer.product
+         && m_document
+         && layer.start != std::string::npos) {
+            auto end = m_document->find_element_end("Layer", layer.start);
+            if (end != std::string::npos) {
+                layer.product->set_layer(m_document, layer.start, end);
+            }
         }
-        m_webMapProduct.reset();
+        if (layer.product
+         && layer.product->is_displayable()) {  // we have no use for the others
+            m_productSlot(layer.product);
+        }
+        // continue with the enclosing layer
+        m_webMapProduct = m_layers.empty() ? std::shared_ptr<WebMapProduct>() : m_layers.back().product;
+        return;
+    }
+    if (element_name == "Service") {   // the limits come before the layers
+        m_limitsSlot(m_maxWidth, m_maxHeight);
     }
+    m_serviceElement.clear();
     if (m_webMapProduct) {
         m_webMapProduct->end_element(context, element_name);
     }
@@ -826,10 +1491,26 @@ void
 NXMLParser::on_text(Glib::Markup::ParseContext& context,
 		const Glib::ustring& text)
 {
-    if (m_webMapProduct) {
-        auto repl = StringUtils::replaceAll(text, "&#13;", "\r");
-        repl = StringUtils::replaceAll(repl, "&#10;", "\n");
-        m_webMapProduct->text(context, repl);
+    if (!m_serviceElement.empty()) {
+        int value = static_cast<int>(GeoCoordinate::parseDouble(text));
+        if (m_serviceElement == "MaxWidth") {
+            m_maxWidth = value;
+        }
+        else {
+            m_maxHeight = value;
+        }
+    }
+    else if (m_webMapProduct
+          && m_webMapProduct->is_text_used()) {
+        std::string_view view(text.data(), text.bytes());
+        if (view.find("&#1") == std::string_view::npos) {  // usually nothing to replace
+            m_webMapProduct->text(context, view);
+        }
+        else {
+            auto repl = StringUtils::replaceAll(text, "&#13;", "\r");
+            repl = StringUtils::replaceAll(repl, "&#10;", "\n");
+            m_webMapProduct->text(context, std::string_view(repl.data(), repl.bytes()));
+        }
     }
 }
 
@@ -840,3 +1521,223 @@ NXMLParser::on_error(Glib::Markup::ParseContext& context,
 {
 	throw error;
 }
+
+WebMapCapabilitiesLoader::WebMapCapabilitiesLoader(WebMapService* webMapService)
+: m_webMapService{webMapService}
+, m_cancellable{g_cancellable_new()}
+{
+    m_dispatcher.connect(sigc::mem_fun(*this, &WebMapCapabilitiesLoader::on_dispatch));
+}
+
+WebMapCapabilitiesLoader::~WebMapCapabilitiesLoader()
+{
+    stop();
+    if (m_stream) {
+        g_object_unref(m_stream);
+    }
+    g_object_unref(m_cancellable);
+}
+
+void
+WebMapCapabilitiesLoader::start(GInputStream* stream)
+{
+    m_stream = G_INPUT_STREAM(g_object_ref(stream)); // keep it beyond the callback
+    m_thread = std::thread(&WebMapCapabilitiesLoader::parse, this);
+    read_next();
+}
+
+void
+WebMapCapabilitiesLoader::stop()
+{
+    g_cancellable_cancel(m_cancellable);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_end = true;
+        m_chunks.clear();
+    }
+    m_condition.notify_one();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void
+WebMapCapabilitiesLoader::detach()
+{
+    stop();     // the worker may use the service so stop it first
+    m_webMapService = nullptr;
+}
+
+void
+WebMapCapabilitiesLoader::read_next()
+{
+    // the pending read keeps us alive
+    auto self = new std::shared_ptr<WebMapCapabilitiesLoader>(shared_from_this());
+    g_input_stream_read_bytes_async(m_stream, CHUNK_SIZE, G_PRIORITY_LOW, m_cancellable, &WebMapCapabilitiesLoader::on_read, self);
+}
+
+void
+WebMapCapabilitiesLoader::on_read(GObject* source, GAsyncResult* result, gpointer user_data)
+{
+    auto self = static_cast<std::shared_ptr<WebMapCapabilitiesLoader>*>(user_data);
+    auto loader = *self;
+    delete self;
+    GError* error = nullptr;
+    GBytes* bytes = g_input_stream_read_bytes_finish(G_INPUT_STREAM(source), result, &error);
+    if (error) {
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            loader->push_end(error->message);
+        }
+        g_error_free(error);
+        return;
+    }
+    gsize size{0};
+    auto data = static_cast<const char*>(g_bytes_get_data(bytes, &size));
+    if (size > 0) {
+        loader->push_chunk(std::string(data, size));
+        loader->read_next();
+    }
+    else {
+        g_input_stream_close(loader->m_stream, nullptr, nullptr);
+        loader->push_end(Glib::ustring());
+    }
+    g_bytes_unref(bytes);
+}
+
+void
+WebMapCapabilitiesLoader::push_chunk(std::string&& chunk)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_chunks.push_back(std::move(chunk));
+    }
+    m_condition.notify_one();
+}
+
+void
+WebMapCapabilitiesLoader::push_end(const Glib::ustring& error)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_end = true;
+        if (!error.empty()) {
+            m_error = error;
+        }
+    }
+    m_condition.notify_one();
+}
+
+// runs in worker
+void
+WebMapCapabilitiesLoader::parse()
+{
+    auto document = std::make_shared<CapabilitiesDocument>();
+    NXMLParser parser(m_webMapService
+                    , sigc::mem_fun(*this, &WebMapCapabilitiesLoader::on_parsed_product)
+                    , sigc::mem_fun(*this, &WebMapCapabilitiesLoader::on_parsed_limits)
+                    , document);
+    Glib::ustring error;
+    {   // the context shoud be gone before we report finished
+        Glib::Markup::ParseContext context(parser);	// , Glib::Markup::ParseFlags::TREAT_CDATA_AS_TEXT
+        bool failed = false;
+        while (true) {
+            std::string chunk;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [this] {
+                    return m_end || !m_chunks.empty();
+                });
+                if (m_stop) {
+                    return;
+                }
+                if (m_chunks.empty()) {     // m_end
+                    break;
+                }
+                chunk = std::move(m_chunks.front());
+                m_chunks.pop_front();
+            }
+            if (!failed) {
+                try {
+                    document->append(chunk.data(), chunk.size());
+                    context.parse(chunk.data(), chunk.data() + chunk.size());
+                }
+                catch (const Glib::MarkupError& ex) {
+                    error = ex.what();
+                    failed = true;      // keep on reading so the stream is finished
+                }
+            }
+        }
+        if (!failed) {
+            try {
+                context.end_parse();
+            }
+            catch (const Glib::MarkupError& ex) {
+                error = ex.what();
+            }
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!error.empty() && m_error.empty()) {
+            m_error = error;
+        }
+        m_finished = true;
+    }
+    m_dispatcher.emit();
+}
+
+// runs in worker
+void
+WebMapCapabilitiesLoader::on_parsed_product(const std::shared_ptr<WebMapProduct>& product)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_products.push_back(product);
+    }
+    m_dispatcher.emit();
+}
+
+// runs in worker
+void
+WebMapCapabilitiesLoader::on_parsed_limits(int maxWidth, int maxHeight)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_limits = true;
+    m_maxWidth = maxWidth;
+    m_maxHeight = maxHeight;
+}
+
+void
+WebMapCapabilitiesLoader::on_dispatch()
+{
+    std::deque<std::shared_ptr<WebMapProduct>> products;
+    bool limits;
+    int maxWidth;
+    int maxHeight;
+    bool finished;
+    Glib::ustring error;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        products.swap(m_products);
+        limits = m_limits;
+        m_limits = false;
+        maxWidth = m_maxWidth;
+        maxHeight = m_maxHeight;
+        finished = m_finished;
+        error = m_error;
+    }
+    if (!m_webMapService) {
+        return;
+    }
+    if (limits) {
+        m_webMapService->set_max_size(maxWidth, maxHeight);
+    }
+    for (auto& product : products) {
+        m_webMapService->add_parsed_product(product);
+    }
+    if (finished && !m_completed) {
+        m_completed = true;
+        m_webMapService->capabilities_loaded(error);
+    }
+}
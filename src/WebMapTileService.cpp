@@ -0,0 +1,774 @@
+/* -*- Mode: c++; c-basic-offset: 4; tab-width: 4; coding: utf-8; -*-  */
+/*
+ * Copyright (C) 2023 RPf
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cmath>
+#include <StringUtils.hpp>
+#include <Log.hpp>
+#include <psc_format.hpp>
+
+#include "WebMapTileService.hpp"
+#include "Reprojection.hpp"
+
+// the standard
+// https://portal.ogc.org/files/?artifact_id=35326
+
+double
+WebMapTileMatrixSet::meters_per_unit(CoordRefSystem crs)
+{
+    if (crs == CoordRefSystem::EPSG_3857) {
+        return 1.0;
+    }
+    return 2.0 * M_PI * 6378137.0 / 360.0;  // degree
+}
+
+double
+WebMapTileMatrixSet::get_tile_span_x(const WebMapTileMatrix& matrix) const
+{
+    return matrix.tileWidth * matrix.scaleDenominator * PIXEL_SIZE_M / meters_per_unit(crs);
+}
+
+double
+WebMapTileMatrixSet::get_tile_span_y(const WebMapTileMatrix& matrix) const
+{
+    return matrix.tileHeight * matrix.scaleDenominator * PIXEL_SIZE_M / meters_per_unit(crs);
+}
+
+const WebMapTileMatrix*
+WebMapTileMatrixSet::find_matrix(double linearPerPixel) const
+{
+    const WebMapTileMatrix* coarsest{nullptr};
+    double coarsestLinear{0.0};
+    const WebMapTileMatrix* finest{nullptr};
+    double finestLinear{0.0};
+    for (auto& matrix : matrices) {
+        if (matrix.tileWidth <= 0) {
+            continue;
+        }
+        double linear = crs.toLinearLon(get_tile_span_x(matrix)) / matrix.tileWidth;
+        if (linear <= linearPerPixel
+         && (!coarsest || linear > coarsestLinear)) {
+            coarsest = &matrix;
+            coarsestLinear = linear;
+        }
+        if (!finest || linear < finestLinear) {
+            finest = &matrix;
+            finestLinear = linear;
+        }
+    }
+    return coarsest ? coarsest : finest;
+}
+
+CoordRefSystem
+WebMapTileMatrixSet::parse_crs(const Glib::ustring& supportedCrs)
+{
+    auto crs = supportedCrs.uppercase();
+    if (crs.find("CRS84") != crs.npos
+     || crs.find("CRS:84") != crs.npos) {
+        return CoordRefSystem::CRS_84;
+    }
+    auto pos = crs.rfind(':');
+    auto code = pos != crs.npos ? crs.substr(pos + 1) : crs;
+    if (code == "4326") {
+        return CoordRefSystem::EPSG_4326;
+    }
+    if (code == "3857" || code == "900913" || code == "102100") {
+        return CoordRefSystem::EPSG_3857;
+    }
+    return CoordRefSystem::None;
+}
+
+WebMapTileRequest::WebMapTileRequest(WebMapTileService* webMapTileService, const Glib::ustring& url
+        , const GeoBounds& source, int tileWidth, int tileHeight
+        , const GeoBounds& target, int pixX, int pixY, int pixWidth, int pixHeight)
+: WeatherImageRequest(url, "")
+, m_source{source}
+, m_target{target}
+, m_pixX{pixX}
+, m_pixY{pixY}
+, m_pixWidth{pixWidth}
+, m_pixHeight{pixHeight}
+{
+    signal_receive().connect(
+        sigc::mem_fun(*webMapTileService, &WebMapTileService::inst_on_image_callback));
+}
+
+void
+WebMapTileRequest::mapping(Glib::RefPtr<Gdk::Pixbuf> pix, Glib::RefPtr<Gdk::Pixbuf>& weather_pix)
+{
+    auto reprojection = Reprojection::create(m_source, pix->get_width(), pix->get_height()
+                                , m_target, m_pixWidth, m_pixHeight);
+    reprojection->map(pix, weather_pix, m_pixX, m_pixY);
+    store_mapped(weather_pix, m_pixX, m_pixY, m_pixWidth, m_pixHeight);
+}
+
+WebMapTileProduct::WebMapTileProduct(WebMapTileService* webMapTileService)
+: WeatherProduct()
+, m_webMapTileService{webMapTileService}
+{
+    m_bounds = GeoBounds{-180.0, -90.0, 180.0, 90.0, CoordRefSystem::CRS_84};
+}
+
+Glib::RefPtr<Gdk::Pixbuf>
+WebMapTileProduct::get_legend()
+{
+    return m_legend;
+}
+
+void
+WebMapTileProduct::set_legend(Glib::RefPtr<Gdk::Pixbuf>& legend)
+{
+    m_legend = legend;
+    m_signal_legend.emit(m_legend);
+}
+
+void
+WebMapTileProduct::set_style(const Glib::ustring& style, const Glib::ustring& legendUrl)
+{
+    m_style = style;
+    m_legendUrl = legendUrl;
+}
+
+// prefer png as it is usually transparent
+void
+WebMapTileProduct::set_format(const Glib::ustring& format)
+{
+    if (m_format.empty()
+     || format == "image/png") {
+        m_format = format;
+    }
+}
+
+void
+WebMapTileProduct::set_template(const Glib::ustring& format, const Glib::ustring& tmpl)
+{
+    if (m_template.empty()
+     || format == "image/png") {
+        m_template = tmpl;
+        m_format = format;
+    }
+}
+
+void
+WebMapTileProduct::set_dimension(const Glib::ustring& dimension)
+{
+    m_dimension = dimension;
+    m_timeDimension.parse(dimension);
+}
+
+bool
+WebMapTileProduct::is_displayable()
+{
+    if (m_template.empty()
+     && m_format.empty()) {
+        return false;
+    }
+    for (auto& matrixSetId : m_matrixSets) {
+        auto matrixSet = m_webMapTileService->find_matrix_set(matrixSetId);
+        if (matrixSet
+         && matrixSet->crs
+         && !matrixSet->matrices.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+WebMapTileProduct::get_latest_time(gint64& time)
+{
+    if (m_timeDimension.empty()) {
+        return false;
+    }
+    time = m_timeDimension.get_end();
+    auto conf = m_webMapTileService->getServiceConf();
+    if (conf->isViewCurrentTime()) {
+        gint64 now = g_get_real_time() / G_USEC_PER_SEC - conf->getDelaySec();
+        if (!m_timeDimension.find_latest(now, time)) {
+            time = m_timeDimension.get_start();
+        }
+    }
+    return true;
+}
+
+bool
+WebMapTileProduct::is_latest()
+{
+    gint64 latest;
+    gint64 period = m_timeDimension.get_last_period();
+    if (!get_latest_time(latest)
+     || period <= 0) {
+        return true;    // cant tell
+    }
+    gint64 now = g_get_real_time() / G_USEC_PER_SEC - m_webMapTileService->getServiceConf()->getDelaySec();
+    if (now >= latest + period) {   // we passed the expected time
+        m_timeDimension.extend(latest + period);
+        return false;
+    }
+    return true;
+}
+
+bool
+WebMapTileProduct::latest(Glib::DateTime& dateTime)
+{
+    gint64 time;
+    if (get_latest_time(time)) {
+        dateTime = TimeDimension::to_date_time(time).to_local();
+        return true;
+    }
+    return false;
+}
+
+void
+WebMapTileProduct::write(CatalogWriter& writer)
+{
+    WeatherProduct::write(writer);
+    writer.put_string(m_abstract);
+    writer.put_string(m_style);
+    writer.put_string(m_legendUrl);
+    writer.put_string(m_format);
+    writer.put_string(m_template);
+    writer.put_string(m_dimension);
+    writer.put_strings(m_matrixSets);
+}
+
+bool
+WebMapTileProduct::read(CatalogReader& reader)
+{
+    WeatherProduct::read(reader);
+    m_abstract = reader.get_string();
+    m_style = reader.get_string();
+    m_legendUrl = reader.get_string();
+    m_format = reader.get_string();
+    m_template = reader.get_string();
+    set_dimension(reader.get_string());
+    m_matrixSets = reader.get_strings();
+    return reader.is_valid();
+}
+
+WebMapTileService::WebMapTileService(WeatherConsumer* consumer, const std::shared_ptr<WebMapServiceConf>& mapServiceConf)
+: Weather(consumer)
+, m_mapServiceConf{mapServiceConf}
+{
+}
+
+void
+WebMapTileService::capabilities()
+{
+    if (load_catalog()) {
+        return;
+    }
+    auto message = std::make_shared<SpoonMessageDirect>(getServiceConf()->getAddress(), "");
+    message->addQuery("service", "WMTS");
+    message->addQuery("version", "1.0.0");
+    message->addQuery("request", "GetCapabilities");
+    add_validators(*message);
+    message->signal_receive().connect(sigc::mem_fun(*this, &WebMapTileService::inst_on_capabilities_callback));
+    logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("tile capabilities url %s", message->get_url()));
+    getSpoonSession()->send(message);
+}
+
+void
+WebMapTileService::inst_on_capabilities_callback(const Glib::ustring& error, int status, SpoonMessageDirect* message)
+{
+    if (!error.empty()) {
+        logMsg(psc::log::Level::Warn, Glib::ustring::sprintf("tile capabilities %s", error));
+        return;
+    }
+    if (is_catalog_confirmed(status, message)) {
+        return;
+    }
+    if (status != SpoonMessage::OK) {
+        logMsg(psc::log::Level::Warn, Glib::ustring::sprintf("tile capabilities response %d %s", status, SpoonMessage::decodeStatus(status)));
+        return;
+    }
+    auto data = message->get_bytes();
+    if (!data) {
+        logMsg(psc::log::Level::Warn, "tile capabilities no data");
+        return;
+    }
+    m_matrixSets.clear();
+    m_getTileUrl.clear();
+    begin_products();
+    bool complete{true};
+    WebMapTileCapabilitiesParser parser(this);
+    Glib::Markup::ParseContext context(parser);
+    try {
+        auto text = reinterpret_cast<const char*>(data->get_data());
+        context.parse(text, text + data->size());
+        context.end_parse();
+    }
+    catch (const Glib::MarkupError& ex) {
+        logMsg(psc::log::Level::Error, Glib::ustring::sprintf("tile capabilities markup %s", ex.what()));
+        complete = false;
+    }
+    end_products(complete);
+    logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("tile capabilities products %zu matrix sets %zu", m_products.size(), m_matrixSets.size()));
+    if (complete) {
+        save_catalog();
+    }
+    m_signal_products_completed.emit();
+}
+
+void
+WebMapTileService::add_parsed_product(const std::shared_ptr<WebMapTileProduct>& product)
+{
+    if (!product->get_id().empty()) {
+        merge_product(product);
+    }
+}
+
+void
+WebMapTileService::add_matrix_set(const WebMapTileMatrixSet& matrixSet)
+{
+    m_matrixSets.push_back(matrixSet);
+}
+
+const WebMapTileMatrixSet*
+WebMapTileService::find_matrix_set(const Glib::ustring& id)
+{
+    for (auto& matrixSet : m_matrixSets) {
+        if (matrixSet.id == id) {
+            return &matrixSet;
+        }
+    }
+    return nullptr;
+}
+
+Glib::ustring
+WebMapTileService::tile_url(const std::shared_ptr<WebMapTileProduct>& product, const WebMapTileMatrixSet& matrixSet
+                        , const WebMapTileMatrix& matrix, int row, int col, const Glib::ustring& time)
+{
+    auto tmpl = product->get_template();
+    if (!tmpl.empty()) {
+        auto url = StringUtils::replaceAll(tmpl, "{TileMatrixSet}", matrixSet.id);
+        url = StringUtils::replaceAll(url, "{TileMatrix}", matrix.id);
+        url = StringUtils::replaceAll(url, "{TileRow}", std::to_string(row));
+        url = StringUtils::replaceAll(url, "{TileCol}", std::to_string(col));
+        url = StringUtils::replaceAll(url, "{Style}", product->get_style());
+        url = StringUtils::replaceAll(url, "{Time}", time);
+        url = StringUtils::replaceAll(url, "{time}", time);
+        return url;
+    }
+    // KVP with fixed order, so urls are the same for each request
+    Glib::ustring url = m_getTileUrl.empty() ? getServiceConf()->getAddress() : m_getTileUrl;
+    url += url.find('?') == url.npos ? "?" : "&";
+    url += "SERVICE=WMTS&REQUEST=GetTile&VERSION=1.0.0";
+    url += "&LAYER=" + Glib::uri_escape_string(product->get_id());
+    url += "&STYLE=" + Glib::uri_escape_string(product->get_style());
+    url += "&FORMAT=" + Glib::uri_escape_string(product->get_format());
+    url += "&TILEMATRIXSET=" + Glib::uri_escape_string(matrixSet.id);
+    url += "&TILEMATRIX=" + Glib::uri_escape_string(matrix.id);
+    url += Glib::ustring::sprintf("&TILEROW=%d&TILECOL=%d", row, col);
+    if (!time.empty()) {
+        url += "&TIME=" + Glib::uri_escape_string(time);
+    }
+    return url;
+}
+
+void
+WebMapTileService::request(const Glib::ustring& productId)
+{
+    auto product = std::dynamic_pointer_cast<WebMapTileProduct>(find_product(productId));
+    if (!product) {
+        logMsg(psc::log::Level::Warn, Glib::ustring::sprintf("tile request product %s not found", productId));
+        return;
+    }
+    const WebMapTileMatrixSet* matrixSet{nullptr};
+    for (auto& matrixSetId : product->get_matrix_sets()) {
+        matrixSet = find_matrix_set(matrixSetId);
+        if (matrixSet && matrixSet->crs) {
+            break;
+        }
+        matrixSet = nullptr;
+    }
+    if (!matrixSet) {
+        logMsg(psc::log::Level::Warn, Glib::ustring::sprintf("tile request product %s no usable matrix set", productId));
+        return;
+    }
+    serve_last(productId);  // show what we know while fetching
+    int image_size = m_consumer->get_weather_image_size();
+    auto matrix = matrixSet->find_matrix(2.0 / image_size);
+    if (!matrix) {
+        return;
+    }
+    Glib::ustring time;
+    gint64 latest;
+    if (product->get_latest_time(latest)) {
+        time = TimeDimension::to_date_time(latest).format_iso8601();
+    }
+    auto crs = matrixSet->crs;
+    CoordRefSystem crs84(CoordRefSystem::CRS_84);
+    double maxLat = crs == CoordRefSystem::EPSG_3857 ? WeatherProduct::MAX_MERCATOR_LAT : 90.0;
+    // the product bounds in crs of the matrix
+    auto westSouth = product->getWestSouth().convert(crs84);
+    auto eastNorth = product->getEastNorth().convert(crs84);
+    GeoBounds area{westSouth.getLongitude(), std::max(westSouth.getLatitude(), -maxLat)
+                 , eastNorth.getLongitude(), std::min(eastNorth.getLatitude(), maxLat), crs84};
+    area = area.convert(crs);
+    double spanX = matrixSet->get_tile_span_x(*matrix);
+    double spanY = matrixSet->get_tile_span_y(*matrix);
+    if (spanX <= 0.0 || spanY <= 0.0) {
+        return;
+    }
+    int col0 = std::clamp(static_cast<int>(std::floor((area.getWestSouth().getLongitude() - matrix->topLeftX) / spanX)), 0, matrix->matrixWidth);
+    int col1 = std::clamp(static_cast<int>(std::ceil((area.getEastNorth().getLongitude() - matrix->topLeftX) / spanX)), 0, matrix->matrixWidth);
+    int row0 = std::clamp(static_cast<int>(std::floor((matrix->topLeftY - area.getEastNorth().getLatitude()) / spanY)), 0, matrix->matrixHeight);
+    int row1 = std::clamp(static_cast<int>(std::ceil((matrix->topLeftY - area.getWestSouth().getLatitude()) / spanY)), 0, matrix->matrixHeight);
+    if ((col1 - col0) * (row1 - row0) > MAX_TILES) {
+        logMsg(psc::log::Level::Warn, Glib::ustring::sprintf("tile request product %s matrix %s tiles %d exceed limit"
+                , productId, matrix->id, (col1 - col0) * (row1 - row0)));
+        return;
+    }
+    auto toPixX = [&] (double x) {
+        return std::clamp(static_cast<int>(std::round((crs.toLinearLon(x) + 1.0) / 2.0 * image_size)), 0, image_size);
+    };
+    auto toPixY = [&] (double y) {
+        double linLat = std::clamp(crs.toLinearLat(y), -1.0, 1.0);
+        return std::clamp(static_cast<int>(std::round((1.0 - linLat) / 2.0 * image_size)), 0, image_size);
+    };
+    auto toLinLon = [&] (int pixX) {
+        return static_cast<double>(pixX) / image_size * 2.0 - 1.0;
+    };
+    auto toLinLat = [&] (int pixY) {
+        return 1.0 - static_cast<double>(pixY) / image_size * 2.0;
+    };
+    int count{0};
+    // as the session allows some connections per host send them all at once
+    for (int row = row0; row < row1; ++row) {
+        double north = matrix->topLeftY - row * spanY;
+        double south = north - spanY;
+        for (int col = col0; col < col1; ++col) {
+            double west = matrix->topLeftX + col * spanX;
+            double east = west + spanX;
+            int pixX0 = toPixX(west);
+            int pixX1 = toPixX(east);
+            int pixY0 = toPixY(north);
+            int pixY1 = toPixY(south);
+            if (pixX1 <= pixX0 || pixY1 <= pixY0) {
+                continue;
+            }
+            GeoBounds source{west, south, east, north, crs};
+            GeoBounds target{crs84.fromLinearLon(toLinLon(pixX0)), crs84.fromLinearLat(toLinLat(pixY1))
+                           , crs84.fromLinearLon(toLinLon(pixX1)), crs84.fromLinearLat(toLinLat(pixY0))
+                           , crs84};
+            auto request = std::make_shared<WebMapTileRequest>(this, tile_url(product, *matrixSet, *matrix, row, col, time)
+                                    , source, matrix->tileWidth, matrix->tileHeight
+                                    , target, pixX0, pixY0, pixX1 - pixX0, pixY1 - pixY0);
+            request->set_tile_key(TileKey{get_service_id(), productId, time, target, pixX1 - pixX0, pixY1 - pixY0});
+            send_image(request);
+            ++count;
+        }
+    }
+    logMsg(psc::log::Level::Debug, Glib::ustring::sprintf("tile request %s matrix %s tiles %d", productId, matrix->id, count));
+}
+
+void
+WebMapTileService::check_product(const Glib::ustring& weatherProductId)
+{
+    auto product = std::dynamic_pointer_cast<WebMapTileProduct>(find_product(weatherProductId));
+    if (product && !product->is_latest()) {
+        refresh(weatherProductId);
+    }
+}
+
+Glib::RefPtr<Gdk::Pixbuf>
+WebMapTileService::get_legend(std::shared_ptr<WeatherProduct>& product)
+{
+    Glib::RefPtr<Gdk::Pixbuf> legend = product->get_legend();
+    if (!legend) {
+        auto tileProduct = std::dynamic_pointer_cast<WebMapTileProduct>(product);
+        if (!tileProduct
+         || tileProduct->get_legend_url().empty()) {
+            return legend;
+        }
+        auto legendReq = std::make_shared<SpoonMessageDirect>(tileProduct->get_legend_url(), "");
+        send_legend(legendReq, product);
+        legend = product->get_legend();     // if it was cached
+    }
+    return legend;
+}
+
+std::shared_ptr<WeatherProduct>
+WebMapTileService::create_product()
+{
+    return std::make_shared<WebMapTileProduct>(this);
+}
+
+void
+WebMapTileService::write_catalog_extra(CatalogWriter& writer)
+{
+    writer.put_string(m_getTileUrl);
+    writer.put_u32(static_cast<guint32>(m_matrixSets.size()));
+    for (auto& matrixSet : m_matrixSets) {
+        writer.put_string(matrixSet.id);
+        writer.put_string(matrixSet.crs.identifier());
+        writer.put_u32(static_cast<guint32>(matrixSet.matrices.size()));
+        for (auto& matrix : matrixSet.matrices) {
+            writer.put_string(matrix.id);
+            writer.put_double(matrix.scaleDenominator);
+            writer.put_double(matrix.topLeftX);
+            writer.put_double(matrix.topLeftY);
+            writer.put_u32(static_cast<guint32>(matrix.tileWidth));
+            writer.put_u32(static_cast<guint32>(matrix.tileHeight));
+            writer.put_u32(static_cast<guint32>(matrix.matrixWidth));
+            writer.put_u32(static_cast<guint32>(matrix.matrixHeight));
+        }
+    }
+}
+
+void
+WebMapTileService::read_catalog_extra(CatalogReader& reader)
+{
+    m_getTileUrl = reader.get_string();
+    m_matrixSets.clear();
+    guint32 sets = reader.get_u32();
+    for (guint32 i = 0; i < sets && reader.is_valid(); ++i) {
+        WebMapTileMatrixSet matrixSet;
+        matrixSet.id = reader.get_string();
+        matrixSet.crs = CoordRefSystem::parse(reader.get_string());
+        guint32 matrices = reader.get_u32();
+        for (guint32 j = 0; j < matrices && reader.is_valid(); ++j) {
+            WebMapTileMatrix matrix;
+            matrix.id = reader.get_string();
+            matrix.scaleDenominator = reader.get_double();
+            matrix.topLeftX = reader.get_double();
+            matrix.topLeftY = reader.get_double();
+            matrix.tileWidth = static_cast<int>(reader.get_u32());
+            matrix.tileHeight = static_cast<int>(reader.get_u32());
+            matrix.matrixWidth = static_cast<int>(reader.get_u32());
+            matrix.matrixHeight = static_cast<int>(reader.get_u32());
+            matrixSet.matrices.push_back(matrix);
+        }
+        m_matrixSets.push_back(matrixSet);
+    }
+}
+
+WebMapTileCapabilitiesParser::WebMapTileCapabilitiesParser(WebMapTileService* webMapTileService)
+: m_webMapTileService{webMapTileService}
+{
+}
+
+Glib::ustring
+WebMapTileCapabilitiesParser::local_name(const Glib::ustring& element_name)
+{
+    auto pos = element_name.find(':');
+    return pos != element_name.npos ? element_name.substr(pos + 1) : element_name;
+}
+
+Glib::ustring
+WebMapTileCapabilitiesParser::attribute(const Glib::Markup::Parser::AttributeMap& attributes, const char* name)
+{
+    auto entry = attributes.find(name);
+    return entry != attributes.end() ? entry->second : Glib::ustring{};
+}
+
+Glib::ustring
+WebMapTileCapabilitiesParser::parent()
+{
+    return m_path.size() >= 2 ? m_path[m_path.size() - 2] : Glib::ustring{};
+}
+
+bool
+WebMapTileCapabilitiesParser::parse_pair(const Glib::ustring& text, double& first, double& second)
+{
+    std::vector<Glib::ustring> parts;
+    StringUtils::split(text, ' ', parts);
+    std::erase_if(parts, [] (const Glib::ustring& part) {
+        return part.empty();
+    });
+    if (parts.size() < 2) {
+        return false;
+    }
+    first = GeoCoordinate::parseDouble(parts[0]);
+    second = GeoCoordinate::parseDouble(parts[1]);
+    return true;
+}
+
+void
+WebMapTileCapabilitiesParser::on_start_element(Glib::Markup::ParseContext& context,
+		const Glib::ustring& element_name,
+		const Glib::Markup::Parser::AttributeMap& attributes)
+{
+    m_path.push_back(local_name(element_name));
+    m_text.clear();
+    auto& name = m_path.back();
+    auto within = parent();
+    if (name == "Layer" && within == "Contents") {
+        m_product = std::make_shared<WebMapTileProduct>(m_webMapTileService);
+        m_lowerX = -180.0;
+        m_lowerY = -90.0;
+        m_upperX = 180.0;
+        m_upperY = 90.0;
+    }
+    else if (name == "TileMatrixSet" && within == "Contents") {
+        m_matrixSet = WebMapTileMatrixSet{};
+    }
+    else if (name == "TileMatrix" && within == "TileMatrixSet") {
+        m_matrix = WebMapTileMatrix{};
+    }
+    else if (name == "Operation") {
+        m_operation = attribute(attributes, "name");
+    }
+    else if (name == "Get" && m_operation == "GetTile") {
+        auto href = attribute(attributes, "xlink:href");
+        if (!href.empty()) {
+            m_webMapTileService->set_get_tile_url(href);
+        }
+    }
+    else if (m_product) {
+        if (name == "Style") {
+            m_defaultStyle = attribute(attributes, "isDefault") == "true";
+            m_styleId.clear();
+            m_styleLegend.clear();
+        }
+        else if (name == "LegendURL" && m_styleLegend.empty()) {
+            m_styleLegend = attribute(attributes, "xlink:href");
+        }
+        else if (name == "Dimension") {
+            m_dimensionId.clear();
+            m_dimensionValues.clear();
+        }
+        else if (name == "ResourceURL"
+              && attribute(attributes, "resourceType") == "tile") {
+            m_product->set_template(attribute(attributes, "format"), attribute(attributes, "template"));
+        }
+    }
+}
+
+void
+WebMapTileCapabilitiesParser::on_end_element(Glib::Markup::ParseContext& context,
+		const Glib::ustring& element_name)
+{
+    if (m_path.empty()) {
+        return;
+    }
+    auto name = m_path.back();
+    auto within = parent();
+    m_path.pop_back();
+    auto start = m_text.find_first_not_of(" \t\r\n");
+    auto end = m_text.find_last_not_of(" \t\r\n");
+    Glib::ustring text = start != m_text.npos ? m_text.substr(start, end - start + 1) : Glib::ustring{};
+    m_text.clear();
+    if (m_product) {
+        if (name == "Layer" && within == "Contents") {
+            m_product->set_bounds(GeoBounds{m_lowerX, m_lowerY, m_upperX, m_upperY, CoordRefSystem::CRS_84});
+            m_webMapTileService->add_parsed_product(m_product);
+            m_product.reset();
+        }
+        else if (within == "Layer") {
+            if (name == "Identifier") {
+                m_product->set_id(text);
+            }
+            else if (name == "Title") {
+                m_product->set_name(text);
+            }
+            else if (name == "Abstract") {
+                m_product->set_abstract(text);
+            }
+            else if (name == "Format") {
+                m_product->set_format(text);
+            }
+            else if (name == "Style"
+                  && (m_defaultStyle || m_product->get_style().empty())) {
+                m_product->set_style(m_styleId, m_styleLegend);
+            }
+            else if (name == "Dimension"
+                  && m_dimensionId.lowercase() == "time") {
+                Glib::ustring dimension;
+                for (auto& value : m_dimensionValues) {
+                    if (!dimension.empty()) {
+                        dimension += ",";
+                    }
+                    dimension += value;
+                }
+                m_product->set_dimension(dimension);
+            }
+        }
+        else if (within == "WGS84BoundingBox") {
+            if (name == "LowerCorner") {
+                parse_pair(text, m_lowerX, m_lowerY);
+            }
+            else if (name == "UpperCorner") {
+                parse_pair(text, m_upperX, m_upperY);
+            }
+        }
+        else if (within == "Style" && name == "Identifier") {
+            m_styleId = text;
+        }
+        else if (within == "Dimension") {
+            if (name == "Identifier") {
+                m_dimensionId = text;
+            }
+            else if (name == "Value") {
+                m_dimensionValues.push_back(text);
+            }
+        }
+        else if (within == "TileMatrixSetLink" && name == "TileMatrixSet") {
+            m_product->add_matrix_set(text);
+        }
+    }
+    else if (name == "TileMatrixSet" && within == "Contents") {
+        m_webMapTileService->add_matrix_set(m_matrixSet);
+    }
+    else if (within == "TileMatrixSet") {
+        if (name == "Identifier") {
+            m_matrixSet.id = text;
+        }
+        else if (name == "SupportedCRS") {
+            m_matrixSet.crs = WebMapTileMatrixSet::parse_crs(text);
+        }
+        else if (name == "TileMatrix") {
+            m_matrixSet.matrices.push_back(m_matrix);
+        }
+    }
+    else if (within == "TileMatrix") {
+        if (name == "Identifier") {
+            m_matrix.id = text;
+        }
+        else if (name == "ScaleDenominator") {
+            m_matrix.scaleDenominator = GeoCoordinate::parseDouble(text);
+        }
+        else if (name == "TopLeftCorner") {
+            parse_pair(text, m_matrix.topLeftX, m_matrix.topLeftY);
+            if (m_matrixSet.crs.is_latitude_first()) {
+                std::swap(m_matrix.topLeftX, m_matrix.topLeftY);
+            }
+        }
+        else if (name == "TileWidth") {
+            m_matrix.tileWidth = std::atoi(text.c_str());
+        }
+        else if (name == "TileHeight") {
+            m_matrix.tileHeight = std::atoi(text.c_str());
+        }
+        else if (name == "MatrixWidth") {
+            m_matrix.matrixWidth = std::atoi(text.c_str());
+        }
+        else if (name == "MatrixHeight") {
+            m_matrix.matrixHeight = std::atoi(text.c_str());
+        }
+    }
+}
+
+void
+WebMapTileCapabilitiesParser::on_text(Glib::Markup::ParseContext& context,
+		const Glib::ustring& text)
+{
+    m_text += text;
+}
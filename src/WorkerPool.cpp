@@ -0,0 +1,107 @@
+/* -*- Mode: c++; c-basic-offset: 4; tab-width: 4; coding: utf-8; -*-  */
+/*
+ * Copyright (C) 2023 RPf
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "WorkerPool.hpp"
+
+WorkerPool::WorkerPool(unsigned threads)
+{
+    threads = std::max(threads, 1u);
+    m_threads.reserve(threads);
+    for (unsigned i = 0; i < threads; ++i) {
+        m_threads.emplace_back(&WorkerPool::work, this);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+WorkerPool&
+WorkerPool::get_default()
+{
+    static WorkerPool pool(std::min(std::thread::hardware_concurrency(), 8u));
+    return pool;
+}
+
+void
+WorkerPool::work()
+{
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this] {
+                return m_stop || !m_tasks.empty();
+            });
+            if (m_stop && m_tasks.empty()) {
+                return;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void
+WorkerPool::submit(const std::function<void()>& fn)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(fn);
+    }
+    m_condition.notify_one();
+}
+
+void
+WorkerPool::run_parallel(unsigned count, const std::function<void(unsigned)>& fn)
+{
+    if (count == 0) {
+        return;
+    }
+    if (count == 1) {   // no need to switch
+        fn(0);
+        return;
+    }
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    unsigned pending = count;
+    for (unsigned i = 0; i < count; ++i) {
+        submit([&, i] {
+            fn(i);
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (--pending == 0) {
+                doneCondition.notify_one();
+            }
+        });
+    }
+    std::unique_lock<std::mutex> lock(doneMutex);
+    doneCondition.wait(lock, [&] {
+        return pending == 0;
+    });
+}
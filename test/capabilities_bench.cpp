@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2024 RPf <gpl3@pfeifer-syscon.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <iostream>
+#include <memory>
+#include <glibmm.h>
+
+#include "WebMapService.hpp"
+
+// a layer as announced by EumetSat, used if no recorded document is given
+static const char* LAYER =
+"<Layer queryable=\"1\" opaque=\"0\">\n"
+"<Name>copernicus:sentinel3a_olci_l2_chl_fullres_%d</Name>\n"
+"<Title>OLCI Level 2 CHL Concentration - Sentinel-3A</Title>\n"
+"<Abstract>This Ocean Colour product represents the algal pigment (Chlorophyll a) concentration in clear open waters,&#13;&#10;"
+"and it is defined by the \"OC4Me\" Maximum Band Ratio (MBR) semi-analytical algorithm.</Abstract>\n"
+"<KeywordList>\n<Keyword>copernicus_sentinel3a_olci_l2_chl_fullres</Keyword>\n<Keyword>WCS</Keyword>\n<Keyword>ImageMosaic</Keyword>\n</KeywordList>\n"
+"<CRS>EPSG:4326</CRS>\n<CRS>CRS:84</CRS>\n<CRS>EPSG:3857</CRS>\n"
+"<EX_GeographicBoundingBox>\n"
+"<westBoundLongitude>-180.0</westBoundLongitude>\n<eastBoundLongitude>180.010009765625</eastBoundLongitude>\n"
+"<southBoundLatitude>-84.317268371582</southBoundLatitude>\n<northBoundLatitude>69.792121887207</northBoundLatitude>\n"
+"</EX_GeographicBoundingBox>\n"
+"<BoundingBox CRS=\"CRS:84\" minx=\"-180.0\" miny=\"-84.317268371582\" maxx=\"180.010009765625\" maxy=\"69.792121887207\"/>\n"
+"<BoundingBox CRS=\"EPSG:4326\" minx=\"-84.317268371582\" miny=\"-180.0\" maxx=\"69.792121887207\" maxy=\"180.010009765625\"/>\n"
+"<Dimension name=\"time\" default=\"2023-05-10T08:55:00Z\" units=\"ISO8601\" nearestValue=\"1\">2020-02-17T03:01:00.000Z/2023-05-10T08:55:00.000Z/PT1H41M</Dimension>\n"
+"<Style>\n<Name>olci_l2_details_gradient</Name>\n<Title>SLD OLCI L2 CC CHL DETAILS GRADIENT</Title>\n"
+"<LegendURL width=\"640\" height=\"80\">\n<Format>image/png</Format>\n"
+"<OnlineResource xmlns:xlink=\"http://www.w3.org/1999/xlink\" xlink:type=\"simple\" xlink:href=\"https://view.eumetsat.int/geoserver/ows?service=WMS&amp;request=GetLegendGraphic&amp;format=image%%2Fpng&amp;width=20&amp;height=20&amp;layer=copernicus%%3Asentinel3a_olci_l2_chl_fullres\"/>\n"
+"</LegendURL>\n</Style>\n"
+"</Layer>\n";
+
+static std::string
+synthesize(int layers)
+{
+    std::string doc;
+    doc += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<WMS_Capabilities version=\"1.3.0\">\n"
+           "<Service>\n<Name>WMS</Name>\n<Title>EUMETSAT</Title>\n<MaxWidth>4096</MaxWidth>\n<MaxHeight>4096</MaxHeight>\n</Service>\n"
+           "<Capability>\n<Layer>\n<Title>EUMETSAT</Title>\n";
+    for (int i = 0; i < layers; ++i) {
+        doc += Glib::ustring::sprintf(LAYER, i);
+    }
+    doc += "</Layer>\n</Capability>\n</WMS_Capabilities>\n";
+    return doc;
+}
+
+// parse a GetCapabilities document the way the loader does (chunked)
+//   usage: capabilities_bench [recorded document] [runs]
+int
+main(int argc, char** argv)
+{
+    std::string doc;
+    if (argc > 1) {
+        doc = Glib::file_get_contents(argv[1]);
+    }
+    else {
+        doc = synthesize(2000);
+    }
+    int runs = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 10;
+    auto conf = std::make_shared<WebMapServiceConf>("bench", "https://view.eumetsat.int/geoserver/ows", 1800, "WMS", false);
+    WebMapService service(nullptr, conf, 300);
+    gint64 best{G_MAXINT64};
+    int products{0};
+    for (int run = 0; run < runs; ++run) {
+        products = 0;
+        auto document = std::make_shared<CapabilitiesDocument>();
+        NXMLParser parser(&service
+                , [&] (const std::shared_ptr<WebMapProduct>& product) {
+                    ++products;
+                }
+                , [] (int maxWidth, int maxHeight) {
+                }
+                , document);
+        Glib::Markup::ParseContext context(parser);
+        gint64 start = g_get_monotonic_time();
+        for (gsize offset = 0; offset < doc.size(); offset += WebMapCapabilitiesLoader::CHUNK_SIZE) {
+            auto len = std::min(static_cast<gsize>(WebMapCapabilitiesLoader::CHUNK_SIZE), doc.size() - offset);
+            document->append(doc.data() + offset, len);
+            context.parse(doc.data() + offset, doc.data() + offset + len);
+        }
+        context.end_parse();
+        best = std::min(best, g_get_monotonic_time() - start);
+    }
+    std::cout << "capabilities " << doc.size() << " bytes"
+              << " products " << products
+              << " best of " << runs << " " << best << "us"
+              << std::endl;
+    return products > 0 ? 0 : 1;
+}
@@ -19,9 +19,22 @@
 #include <iostream>
 #include <cstdlib>
 #include <cmath>
+#include <cstring>
 #include <iterator>
+#include <algorithm>
+#include <glib/gstdio.h>
 
 #include "GeoCoordinate.hpp"
+#include "Reprojection.hpp"
+#include "ProductCatalog.hpp"
+#include "TimeDimension.hpp"
+#include "RealEarth.hpp"
+#include "WebMapService.hpp"
+#include "ProductIndex.hpp"
+#include "TileStore.hpp"
+#include "LegendCache.hpp"
+#include "WebMapTileService.hpp"
+#include "RefreshScheduler.hpp"
 
 
 // test conversion functions for C-locale
@@ -45,6 +58,737 @@ convertTest()
     return true;
 }
 
+// test the index tables for linear and mercator source
+static bool
+reprojectionTest()
+{
+    std::cout << "reprojectionTest --------------" << std::endl;
+    GeoBounds target{-180.0, 0.0, 0.0, 90.0, CoordRefSystem::CRS_84};
+    Reprojection linear(target, 256, 256, target, 256, 256);
+    auto& linRows = linear.get_rows();
+    for (int y = 0; y < 256; ++y) {
+        if (linRows[y] != y) {
+            std::cout << "linear row " << y << " mapped to " << linRows[y] << std::endl;
+            return false;
+        }
+    }
+    GeoBounds source{-180.0, 0.0, 0.0, 85.0, CoordRefSystem::CRS_84};
+    Reprojection mercator(source.convert(CoordRefSystem::EPSG_3857), 256, 256, target, 256, 256);
+    auto& mercRows = mercator.get_rows();
+    if (mercRows[0] != -1) {    // beyond 85 no data
+        std::cout << "mercator first row " << mercRows[0] << std::endl;
+        return false;
+    }
+    if (mercRows[255] != 255) { // equator stays
+        std::cout << "mercator last row " << mercRows[255] << std::endl;
+        return false;
+    }
+    int last = -1;
+    for (int y = 0; y < 256; ++y) {
+        if (mercRows[y] >= 0) {
+            if (mercRows[y] < last) {
+                std::cout << "mercator row " << y << " not ascending " << mercRows[y] << std::endl;
+                return false;
+            }
+            last = mercRows[y];
+        }
+    }
+    std::cout << "reprojectionTest --------------" << std::endl;
+    return true;
+}
+
+// values read back in order, a truncated catalog is detected
+static bool
+catalogTest()
+{
+    std::cout << "catalogTest --------------" << std::endl;
+    CatalogWriter writer;
+    writer.put_u32(42u);
+    writer.put_string("Ä product");
+    writer.put_double(-85.5);
+    writer.put_strings({"2024-01-01", "2024-01-02"});
+    std::string data = writer.get_data();
+    CatalogReader reader(std::string(data));
+    if (reader.get_u32() != 42u
+     || reader.get_string() != "Ä product"
+     || reader.get_double() != -85.5
+     || reader.get_strings().size() != 2
+     || !reader.is_valid()) {
+        std::cout << "catalog values not matching" << std::endl;
+        return false;
+    }
+    CatalogReader truncated(data.substr(0, data.size() - 3));
+    truncated.get_u32();
+    truncated.get_string();
+    truncated.get_double();
+    truncated.get_strings();
+    if (truncated.is_valid()) {
+        std::cout << "catalog truncation not detected" << std::endl;
+        return false;
+    }
+    std::cout << "catalogTest --------------" << std::endl;
+    return true;
+}
+
+static bool
+timeDimensionTest()
+{
+    std::cout << "timeDimensionTest --------------" << std::endl;
+    TimeDimension interval;
+    gint64 start;
+    TimeDimension::parse_time("2024-01-01T00:00:00Z", start);
+    interval.parse("2024-01-01T00:00:00Z/2024-01-02T00:00:00Z/PT1H");
+    gint64 value{0};
+    if (interval.get_count() != 25
+     || !interval.find_latest(start + 90 * 60, value)
+     || value != start + 3600
+     || !interval.find_nearest(start + 100 * 60, value)
+     || value != start + 2 * 3600
+     || interval.find_latest(start - 1, value)) {
+        std::cout << "interval count " << interval.get_count() << " value " << value - start << std::endl;
+        return false;
+    }
+    TimeDimension list;    // evenly spaced values are joined
+    list.parse("2024-01-01T06:00:00Z, 2024-01-01T00:00:00Z,2024-01-01T03:00:00Z,2024-01-02");
+    auto values = list.get_values(start, start + TimeDimension::SECS_PER_DAY);
+    if (list.get_count() != 4
+     || values.size() != 4
+     || values[1] != start + 3 * 3600
+     || !list.find_latest(start + 12 * 3600, value)
+     || value != start + 6 * 3600) {
+        std::cout << "list count " << list.get_count() << " values " << values.size() << std::endl;
+        return false;
+    }
+    std::cout << "timeDimensionTest --------------" << std::endl;
+    return true;
+}
+
+static bool
+tileGridTest()
+{
+    std::cout << "tileGridTest --------------" << std::endl;
+    if (RealEarth::tile_zoom(256) != 0
+     || RealEarth::tile_zoom(1024) != 2
+     || RealEarth::tile_zoom(1000) != 2) {
+        std::cout << "zoom " << RealEarth::tile_zoom(1024) << std::endl;
+        return false;
+    }
+    // z1 north east tile is the quadrant above the equator
+    auto tile = RealEarthTileRequest::tile_bounds(1, 1, 0).convert(CoordRefSystem::CRS_84);
+    if (std::abs(tile.getWestSouth().getLongitude()) > 1.0e-6
+     || std::abs(tile.getWestSouth().getLatitude()) > 1.0e-6
+     || std::abs(tile.getEastNorth().getLongitude() - 180.0) > 1.0e-6
+     || std::abs(tile.getEastNorth().getLatitude() - 85.0511) > 1.0e-3) {
+        std::cout << "tile " << tile.printValue(',') << std::endl;
+        return false;
+    }
+    // z2 rows split at the latitude of half the mercator height
+    auto row = RealEarthTileRequest::tile_bounds(2, 0, 1).convert(CoordRefSystem::CRS_84);
+    if (std::abs(row.getEastNorth().getLatitude() - 66.5133) > 1.0e-3
+     || std::abs(row.getWestSouth().getLatitude()) > 1.0e-6) {
+        std::cout << "row " << row.printValue(',') << std::endl;
+        return false;
+    }
+    std::cout << "tileGridTest --------------" << std::endl;
+    return true;
+}
+
+class TestConsumer
+: public WeatherConsumer
+{
+public:
+    void weather_image_notify(WeatherImageRequest& request) override {
+        ++m_notified;
+    }
+    int get_weather_image_size() override {
+        return m_size;
+    }
+    int m_notified{0};
+    int m_size{1024};
+};
+
+static bool
+extentWaitTest()
+{
+    std::cout << "extentWaitTest --------------" << std::endl;
+    const char json[] = R"({"id":"globalir","dataid":"globalir","name":"IR","description":"","type":"raster","outputtype":"png24","times":["20240101.000000"]})";
+    JsonPullParser parser(json, sizeof(json) - 1);
+    if (parser.next() != JsonPullParser::Token::BeginObject) {
+        return false;
+    }
+    auto product = std::make_shared<RealEarthProduct>(parser);
+    TestConsumer consumer;
+    RealEarth realEarth(&consumer, "http://localhost:1/");
+    realEarth.add_product(product);
+    // without extent the request waits, no image is sent with guessed bounds
+    realEarth.request("globalir");
+    if (product->has_extent()
+     || realEarth.get_pending_images() != 0
+     || realEarth.get_pipeline_depth() != 1) {
+        std::cout << "pending images " << realEarth.get_pending_images()
+                  << " depth " << realEarth.get_pipeline_depth() << std::endl;
+        return false;
+    }
+    std::cout << "extentWaitTest --------------" << std::endl;
+    return true;
+}
+
+static bool
+nestedLayerTest()
+{
+    std::cout << "nestedLayerTest --------------" << std::endl;
+    const char xml[] =
+        "<WMS_Capabilities><Capability><Layer><Title>root</Title>"
+        "<Layer queryable=\"1\"><Name>parent</Name><Title>Parent</Title><Abstract>parent abstract</Abstract><CRS>CRS:84</CRS>"
+        "<!-- <Layer queryable=\"1\"> --><LayerLimit>2</LayerLimit>"
+        "<Layer queryable=\"1\"><Name>child</Name><Title>Child</Title><Abstract>child abstract</Abstract><CRS>CRS:84</CRS>"
+        "<KeywordList><Keyword>snow</Keyword></KeywordList><Dimension name=\"time\">2024-01-01T00:00:00Z</Dimension></Layer>"
+        "</Layer>"
+        "<Layer queryable=\"1\"><Name>other</Name><Title>Other</Title><Abstract><![CDATA[a </Layer> b]]></Abstract><CRS>CRS:84</CRS></Layer>"
+        "</Layer></Capability></WMS_Capabilities>";
+    TestConsumer consumer;
+    auto conf = std::make_shared<WebMapServiceConf>("test", "http://localhost:1/", 0, "", false);
+    WebMapService service(&consumer, conf, 300);
+    std::vector<std::shared_ptr<WebMapProduct>> products;
+    auto document = std::make_shared<CapabilitiesDocument>();
+    NXMLParser parser(&service
+                    , [&] (const std::shared_ptr<WebMapProduct>& product) {
+                        products.push_back(product);
+                    }
+                    , [] (int maxWidth, int maxHeight) {
+                    }
+                    , document);
+    Glib::Markup::ParseContext context(parser);
+    document->append(xml, sizeof(xml) - 1);
+    context.parse(xml, xml + sizeof(xml) - 1);
+    context.end_parse();
+    // inner layers are completed first, the details come from each own range
+    if (products.size() != 3
+     || products[0]->get_id() != "child"
+     || products[0]->get_description() != "child abstract"
+     || products[1]->get_id() != "parent"
+     || products[1]->get_description() != "parent abstract"
+     || products[2]->get_id() != "other"
+     || products[2]->get_description() != "a </Layer> b") {
+        for (auto& product : products) {
+            std::cout << "product " << product->get_id() << " " << product->get_description() << std::endl;
+        }
+        return false;
+    }
+    // searching uses the values from the index parse, the details stay unparsed
+    for (auto& product : products) {
+        service.add_product(product);
+    }
+    ProductIndex index;
+    index.update(service);
+    ProductQuery query;
+    query.text = "snow";
+    auto keyword = index.search(query);
+    query.text = "";
+    query.timeEnabled = true;
+    auto timed = index.search(query);
+    if (keyword.size() != 1
+     || keyword[0].product->get_id() != "child"
+     || timed.size() != 1
+     || timed[0].product->get_id() != "child"
+     || !std::all_of(products.begin(), products.end(), [] (const std::shared_ptr<WebMapProduct>& product) {
+            return !product->is_materialized();
+        })) {
+        std::cout << "keyword " << keyword.size() << " timed " << timed.size() << std::endl;
+        return false;
+    }
+    std::cout << "nestedLayerTest --------------" << std::endl;
+    return true;
+}
+
+static bool
+jsonPullTest()
+{
+    std::cout << "jsonPullTest --------------" << std::endl;
+    const char json[] = R"([{"id":"globalir","dataid":"globalir","name":"Global IR","description":"Infrared \u00e9 \"quoted\"",)"
+        R"("type":"raster","outputtype":"png24","seedlatbound":70.5,"times":["20240101.010000","20240101.000000"],)"
+        R"("unused":{"a":[1,{"b":null}],"c":true}},)"
+        R"({"id":"snow","dataid":"snow","name":"Snow depth","description":"","type":"raster","outputtype":"png24","times":[]}])";
+    JsonPullParser parser(json, sizeof(json) - 1);
+    std::vector<std::shared_ptr<RealEarthProduct>> products;
+    if (parser.next() != JsonPullParser::Token::BeginArray) {
+        return false;
+    }
+    auto token = parser.next();
+    while (token == JsonPullParser::Token::BeginObject) {
+        auto product = std::make_shared<RealEarthProduct>(parser);
+        if (!product->is_valid()) {
+            std::cout << "product not valid " << parser.get_error() << std::endl;
+            return false;
+        }
+        products.push_back(product);
+        token = parser.next();
+    }
+    gint64 latest{0};
+    gint64 expected{0};
+    RealEarthProduct::parse_time("20240101.010000", expected);
+    if (token != JsonPullParser::Token::EndArray
+     || parser.next() != JsonPullParser::Token::End
+     || products.size() != 2
+     || products[0]->get_id() != "globalir"
+     || products[0]->get_description() != "Infrared \u00e9 \"quoted\""
+     || products[0]->get_seedlatbound() != 70.5
+     || products[0]->get_times().size() != 2
+     || !products[0]->get_latest_time(latest)
+     || latest != expected
+     || products[1]->get_id() != "snow"
+     || products[1]->is_displayable()) {
+        std::cout << "products " << products.size() << " latest " << latest << std::endl;
+        return false;
+    }
+    std::cout << "jsonPullTest --------------" << std::endl;
+    return true;
+}
+
+static std::shared_ptr<RealEarthProduct>
+realEarthProduct(const char* json)
+{
+    JsonPullParser parser(json, std::strlen(json));
+    parser.next();  // BeginObject
+    return std::make_shared<RealEarthProduct>(parser);
+}
+
+static bool
+productIndexTest()
+{
+    std::cout << "productIndexTest --------------" << std::endl;
+    TestConsumer consumer;
+    RealEarth realEarth(&consumer, "http://localhost:1/");
+    realEarth.add_product(realEarthProduct(R"({"id":"globalir","name":"Global IR","description":"Infrared satellite","outputtype":"png24","times":["20240101.000000"]})"));
+    realEarth.add_product(realEarthProduct(R"({"id":"snowdepth","name":"Snow depth","description":"snow cover","outputtype":"png24"})"));
+    ProductIndex index;
+    index.update(realEarth);
+    ProductQuery query;
+    query.text = "infra";     // incomplete as typed
+    auto infra = index.search(query);
+    query.text = "Snow dep";
+    auto snow = index.search(query);
+    query.text = "global snow";
+    auto none = index.search(query);
+    query.text = "";
+    query.timeEnabled = true;
+    auto timed = index.search(query);
+    if (index.get_size() != 2
+     || infra.size() != 1
+     || infra[0].product->get_id() != "globalir"
+     || snow.size() != 1
+     || snow[0].product->get_id() != "snowdepth"
+     || !none.empty()
+     || timed.size() != 1
+     || timed[0].product->get_id() != "globalir") {
+        std::cout << "infra " << infra.size() << " snow " << snow.size()
+                  << " none " << none.size() << " timed " << timed.size() << std::endl;
+        return false;
+    }
+    index.remove(realEarth.get_service_id());
+    if (index.get_size() != 0) {
+        return false;
+    }
+    // products are listed by id, regardless of the order added
+    realEarth.add_product(realEarthProduct(R"({"id":"aurora","name":"Aurora","description":"","outputtype":"png24"})"));
+    auto& products = realEarth.get_products();
+    if (products.size() != 3
+     || products[0]->get_id() != "aurora"
+     || products[1]->get_id() != "globalir"
+     || products[2]->get_id() != "snowdepth") {
+        std::cout << "products not sorted " << products[0]->get_id() << std::endl;
+        return false;
+    }
+    std::cout << "productIndexTest --------------" << std::endl;
+    return true;
+}
+
+static int
+countFiles(const std::string& dir)
+{
+    Glib::Dir files(dir);
+    return static_cast<int>(std::distance(files.begin(), files.end()));
+}
+
+static void
+removeTree(const std::string& dir)
+{
+    Glib::Dir files(dir);
+    for (auto name : files) {
+        auto path = Glib::build_filename(dir, name);
+        if (Glib::file_test(path, Glib::FileTest::IS_DIR)) {
+            removeTree(path);
+        }
+        else {
+            g_unlink(path.c_str());
+        }
+    }
+    g_rmdir(dir.c_str());
+}
+
+static bool
+tileStoreTest()
+{
+    std::cout << "tileStoreTest --------------" << std::endl;
+    GError* error = nullptr;
+    gchar* tmp = g_dir_make_tmp("tileStoreXXXXXX", &error);
+    if (error) {
+        std::cout << "no temp dir " << error->message << std::endl;
+        g_error_free(error);
+        return false;
+    }
+    std::string dir{tmp};
+    g_free(tmp);
+    bool ret = false;
+    {
+        TileStore store(dir);
+        auto pix = Gdk::Pixbuf::create(Gdk::Colorspace::RGB, true, 8, 4, 4);
+        pix->fill(0x00000000u);
+        // same pixel bytes, but a different geometry
+        TileKey wide{"test", "prod", "20240101.000000", GeoBounds{0.0, 0.0, 10.0, 5.0, CoordRefSystem::CRS_84}, 4, 2};
+        TileKey high{"test", "prod", "20240101.000000", GeoBounds{0.0, 5.0, 5.0, 15.0, CoordRefSystem::CRS_84}, 2, 4};
+        TileKey same{"test", "prod", "20240101.000000", GeoBounds{0.0, 20.0, 10.0, 25.0, CoordRefSystem::CRS_84}, 4, 2};
+        TileKey untimed{"test", "prod", "", GeoBounds{0.0, 0.0, 10.0, 5.0, CoordRefSystem::CRS_84}, 4, 2};
+        store.store(wide, 4, pix, 0, 0, 4, 2);
+        store.store(high, 4, pix, 0, 0, 2, 4);
+        store.store(same, 4, pix, 0, 2, 4, 2);
+        auto wideTile = store.lookup(wide);
+        auto highTile = store.lookup(high);
+        auto sameTile = store.lookup(same);
+        auto objects = countFiles(Glib::build_filename(dir, "objects"));
+        if (!wideTile || wideTile->get_width() != 4 || wideTile->get_height() != 2
+         || !highTile || highTile->get_width() != 2 || highTile->get_height() != 4
+         || !sameTile || sameTile->get_width() != 4 || sameTile->get_height() != 2
+         || store.lookup(untimed)
+         || objects != 2) {
+            std::cout << "lookup wide " << (wideTile ? wideTile->get_width() : 0)
+                      << " high " << (highTile ? highTile->get_width() : 0)
+                      << " objects " << objects << std::endl;
+        }
+        else {
+            store.prune_size(100);  // room for one object only
+            objects = countFiles(Glib::build_filename(dir, "objects"));
+            if (objects != 1) {
+                std::cout << "prune size objects " << objects << std::endl;
+                removeTree(dir);
+                return false;
+            }
+            store.prune(-10);   // everything is older
+            auto keys = countFiles(Glib::build_filename(dir, "keys"));
+            objects = countFiles(Glib::build_filename(dir, "objects"));
+            if (keys != 0 || objects != 0 || store.lookup(wide)) {
+                std::cout << "prune keys " << keys << " objects " << objects << std::endl;
+            }
+            else {
+                ret = true;
+            }
+        }
+    }
+    removeTree(dir);
+    if (ret) {
+        std::cout << "tileStoreTest --------------" << std::endl;
+    }
+    return ret;
+}
+
+static bool
+legendCacheTest()
+{
+    std::cout << "legendCacheTest --------------" << std::endl;
+    GError* error = nullptr;
+    gchar* tmp = g_dir_make_tmp("legendCacheXXXXXX", &error);
+    if (error) {
+        std::cout << "no temp dir " << error->message << std::endl;
+        g_error_free(error);
+        return false;
+    }
+    std::string dir{tmp};
+    g_free(tmp);
+    bool ret = false;
+    {
+        auto pix = Gdk::Pixbuf::create(Gdk::Colorspace::RGB, true, 8, 6, 3);
+        pix->fill(0xff0000ffu);
+        gchar* png = nullptr;
+        gsize pngSize = 0;
+        pix->save_to_buffer(png, pngSize, "png");
+        const guint8 garbage[] = {'n', 'o', ' ', 'i', 'm', 'a', 'g', 'e'};
+        LegendCache cache(dir);
+        auto first = cache.store("http://localhost:1/legend?layer=a", reinterpret_cast<const guint8*>(png), pngSize);
+        auto second = cache.store("http://localhost:1/legend?layer=b", reinterpret_cast<const guint8*>(png), pngSize);
+        auto invalid = cache.store("http://localhost:1/legend?layer=c", garbage, sizeof(garbage));
+        auto found = cache.lookup("http://localhost:1/legend?layer=b");
+        LegendCache reopened(dir);      // read back from disk
+        auto loaded = reopened.lookup("http://localhost:1/legend?layer=a");
+        g_free(png);
+        if (!first || first->get_width() != 6 || first->get_height() != 3
+         || second != first             // same content is decoded once
+         || invalid
+         || cache.get_size() != 1
+         || found != first
+         || cache.lookup("http://localhost:1/legend?layer=c")
+         || !loaded || loaded->get_width() != 6 || loaded->get_height() != 3) {
+            std::cout << "legends " << cache.get_size()
+                      << " loaded " << (loaded ? loaded->get_width() : 0) << std::endl;
+        }
+        else {
+            // a different legend exceeds the limit, so the older one is dropped from memory
+            auto other = Gdk::Pixbuf::create(Gdk::Colorspace::RGB, true, 8, 6, 3);
+            other->fill(0x00ff00ffu);
+            other->save_to_buffer(png, pngSize, "png");
+            cache.set_max_bytes(first->get_byte_length());
+            auto green = cache.store("http://localhost:1/legend?layer=d", reinterpret_cast<const guint8*>(png), pngSize);
+            g_free(png);
+            auto size = cache.get_size();
+            auto bytes = cache.get_bytes();
+            auto reloaded = cache.lookup("http://localhost:1/legend?layer=a");
+            if (!green
+             || size != 1
+             || bytes != first->get_byte_length()
+             || !reloaded || reloaded->get_width() != 6) {
+                std::cout << "limited legends " << size << " bytes " << bytes << std::endl;
+            }
+            else {
+                ret = true;
+            }
+        }
+    }
+    removeTree(dir);
+    if (ret) {
+        std::cout << "legendCacheTest --------------" << std::endl;
+    }
+    return ret;
+}
+
+static bool
+webMapTileTest()
+{
+    std::cout << "webMapTileTest --------------" << std::endl;
+    const char xml[] = R"(<?xml version="1.0" encoding="UTF-8"?>
+<Capabilities xmlns="http://www.opengis.net/wmts/1.0" xmlns:ows="http://www.opengis.net/ows/1.1" xmlns:xlink="http://www.w3.org/1999/xlink" version="1.0.0">
+ <Contents>
+  <Layer>
+   <ows:Title>Clouds</ows:Title>
+   <ows:WGS84BoundingBox>
+    <ows:LowerCorner>-20.0 30.0</ows:LowerCorner>
+    <ows:UpperCorner>40.0 70.0</ows:UpperCorner>
+   </ows:WGS84BoundingBox>
+   <ows:Identifier>clouds</ows:Identifier>
+   <Style><ows:Identifier>plain</ows:Identifier></Style>
+   <Style isDefault="true"><ows:Identifier>default</ows:Identifier></Style>
+   <Format>image/png</Format>
+   <Dimension><ows:Identifier>time</ows:Identifier><Value>2024-01-01T00:00:00Z</Value></Dimension>
+   <TileMatrixSetLink><TileMatrixSet>GoogleMaps</TileMatrixSet></TileMatrixSetLink>
+   <ResourceURL format="image/png" resourceType="tile" template="http://localhost:1/{Style}/{TileMatrixSet}/{TileMatrix}/{TileRow}/{TileCol}.png"/>
+  </Layer>
+  <TileMatrixSet>
+   <ows:Identifier>GoogleMaps</ows:Identifier>
+   <ows:SupportedCRS>urn:ogc:def:crs:EPSG::3857</ows:SupportedCRS>
+   <TileMatrix>
+    <ows:Identifier>0</ows:Identifier>
+    <ScaleDenominator>559082264.0287178</ScaleDenominator>
+    <TopLeftCorner>-20037508.3427892 20037508.3427892</TopLeftCorner>
+    <TileWidth>256</TileWidth><TileHeight>256</TileHeight>
+    <MatrixWidth>1</MatrixWidth><MatrixHeight>1</MatrixHeight>
+   </TileMatrix>
+   <TileMatrix>
+    <ows:Identifier>1</ows:Identifier>
+    <ScaleDenominator>279541132.0143589</ScaleDenominator>
+    <TopLeftCorner>-20037508.3427892 20037508.3427892</TopLeftCorner>
+    <TileWidth>256</TileWidth><TileHeight>256</TileHeight>
+    <MatrixWidth>2</MatrixWidth><MatrixHeight>2</MatrixHeight>
+   </TileMatrix>
+  </TileMatrixSet>
+ </Contents>
+</Capabilities>)";
+    TestConsumer consumer;
+    auto conf = std::make_shared<WebMapServiceConf>("test", "http://localhost:1/wmts", 0, "WMTS", false);
+    WebMapTileService service(&consumer, conf);
+    WebMapTileCapabilitiesParser parser(&service);
+    Glib::Markup::ParseContext context(parser);
+    try {
+        context.parse(xml, xml + sizeof(xml) - 1);
+        context.end_parse();
+    }
+    catch (const Glib::MarkupError& ex) {
+        std::cout << "markup " << ex.what() << std::endl;
+        return false;
+    }
+    auto product = std::dynamic_pointer_cast<WebMapTileProduct>(service.find_product("clouds"));
+    auto matrixSet = service.find_matrix_set("GoogleMaps");
+    if (!product
+     || product->get_name() != "Clouds"
+     || product->get_style() != "default"
+     || product->get_matrix_sets().size() != 1
+     || !product->is_displayable()
+     || !matrixSet
+     || matrixSet->crs != CoordRefSystem::EPSG_3857
+     || matrixSet->matrices.size() != 2) {
+        std::cout << "product " << (product ? product->get_style() : "none")
+                  << " matrices " << (matrixSet ? matrixSet->matrices.size() : 0) << std::endl;
+        return false;
+    }
+    auto bounds = product->getBounds();
+    auto coarse = matrixSet->find_matrix(2.0 / 200.0);
+    auto fine = matrixSet->find_matrix(2.0 / 300.0);
+    auto finest = matrixSet->find_matrix(2.0 / 2048.0);   // beyond the finest, use that
+    if (std::abs(bounds.getWestSouth().getLongitude() - -20.0) > 1e-9
+     || std::abs(bounds.getEastNorth().getLatitude() - 70.0) > 1e-9
+     || std::abs(matrixSet->get_tile_span_x(matrixSet->matrices[0]) - 2.0 * CoordRefSystem::EPSG3857_MAX) > 1.0
+     || !coarse || coarse->id != "0"
+     || !fine || fine->id != "1"
+     || !finest || finest->id != "1") {
+        std::cout << "span " << matrixSet->get_tile_span_x(matrixSet->matrices[0])
+                  << " coarse " << (coarse ? coarse->id : "none")
+                  << " fine " << (fine ? fine->id : "none") << std::endl;
+        return false;
+    }
+    auto url = service.tile_url(product, *matrixSet, *fine, 1, 0, "");
+    if (url != "http://localhost:1/default/GoogleMaps/1/1/0.png") {
+        std::cout << "url " << url << std::endl;
+        return false;
+    }
+    // the same tile at two image sizes, both use matrix 0 with a single tile
+    GError* error = nullptr;
+    gchar* tmp = g_dir_make_tmp("webMapTileXXXXXX", &error);
+    if (error) {
+        std::cout << "no temp dir " << error->message << std::endl;
+        g_error_free(error);
+        return false;
+    }
+    std::string dir{tmp};
+    g_free(tmp);
+    bool ret = false;
+    {
+        auto store = std::make_shared<TileStore>(dir);
+        service.setTileStore(store);
+        gint64 latest;
+        product->get_latest_time(latest);
+        auto time = TimeDimension::to_date_time(latest).format_iso8601();
+        // place the tile as the request does for an image of 200
+        auto& matrix = matrixSet->matrices[0];
+        auto crs = matrixSet->crs;
+        CoordRefSystem crs84(CoordRefSystem::CRS_84);
+        auto toPixY = [&] (double y) {
+            double linLat = std::clamp(crs.toLinearLat(y), -1.0, 1.0);
+            return static_cast<int>(std::round((1.0 - linLat) / 2.0 * 200));
+        };
+        int pixY0 = toPixY(matrix.topLeftY);
+        int pixY1 = toPixY(matrix.topLeftY - matrixSet->get_tile_span_y(matrix));
+        GeoBounds target{-180.0, crs84.fromLinearLat(1.0 - pixY1 / 200.0 * 2.0)
+                       , 180.0, crs84.fromLinearLat(1.0 - pixY0 / 200.0 * 2.0), crs84};
+        auto pix = Gdk::Pixbuf::create(Gdk::Colorspace::RGB, true, 8, 200, 200);
+        pix->fill(0x00000000u);
+        TileKey key{service.get_service_id(), "clouds", time, target, 200, pixY1 - pixY0};
+        store->store(key, 200, pix, 0, pixY0, 200, pixY1 - pixY0);
+        consumer.m_size = 200;
+        service.request("clouds");
+        int notified200 = consumer.m_notified;   // last composite and stored tile
+        consumer.m_size = 220;
+        service.request("clouds");              // the tile of size 200 must not be used
+        if (notified200 != 2
+         || consumer.m_notified != 2) {
+            std::cout << "notified " << notified200 << " " << consumer.m_notified << std::endl;
+        }
+        else {
+            ret = true;
+        }
+    }
+    removeTree(dir);
+    if (ret) {
+        std::cout << "webMapTileTest --------------" << std::endl;
+    }
+    return ret;
+}
+
+// ticks on demand
+class TestScheduler
+: public RefreshScheduler
+{
+public:
+    TestScheduler()
+    : RefreshScheduler(10u)
+    {
+    }
+    void tick() {
+        on_tick();
+    }
+};
+
+// counts checks, unwatches a product while it is checked
+class TestCheckService
+: public Weather
+{
+public:
+    TestCheckService(WeatherConsumer* consumer, TestScheduler& scheduler)
+    : Weather(consumer)
+    , m_scheduler{scheduler}
+    {
+    }
+    void check_product(const Glib::ustring& weatherProductId) override {
+        ++m_checks[weatherProductId];
+        if (weatherProductId == "once") {
+            m_scheduler.unwatch(this, weatherProductId);
+        }
+    }
+    gint64 get_next_check_sec(const Glib::ustring& weatherProductId) override {
+        return 20;
+    }
+    void unwatch_product(const Glib::ustring& weatherProductId) override {
+        m_unwatched.insert(weatherProductId);
+    }
+    void capabilities() override {
+    }
+    void request(const Glib::ustring& productId) override {
+    }
+    Glib::RefPtr<Gdk::Pixbuf> get_legend(std::shared_ptr<WeatherProduct>& product) override {
+        return Glib::RefPtr<Gdk::Pixbuf>();
+    }
+    Glib::ustring get_service_id() override {
+        return "test";
+    }
+    std::map<Glib::ustring, int> m_checks;
+    std::set<Glib::ustring> m_unwatched;
+protected:
+    std::shared_ptr<WeatherProduct> create_product() override {
+        return std::shared_ptr<WeatherProduct>();
+    }
+private:
+    TestScheduler& m_scheduler;
+};
+
+static bool
+refreshSchedulerTest()
+{
+    std::cout << "refreshSchedulerTest --------------" << std::endl;
+    TestConsumer consumer;
+    TestScheduler scheduler;
+    TestCheckService service(&consumer, scheduler);
+    scheduler.watch(&service, "shown", true);       // every 2 ticks
+    scheduler.watch(&service, "hidden", false);     // 2 ticks, then backs off to 4
+    scheduler.watch(&service, "once", true);        // unwatched by its check
+    scheduler.tick();
+    if (!service.m_checks.empty()) {
+        std::cout << "checked before due " << service.m_checks.size() << std::endl;
+        return false;
+    }
+    for (int i = 1; i < 6; ++i) {
+        scheduler.tick();
+    }
+    if (service.m_checks["shown"] != 3
+     || service.m_checks["hidden"] != 2
+     || service.m_checks["once"] != 1
+     || !service.m_unwatched.contains("once")
+     || scheduler.get_size() != 2
+     || scheduler.get_checks() != 6) {
+        std::cout << "shown " << service.m_checks["shown"]
+                  << " hidden " << service.m_checks["hidden"]
+                  << " once " << service.m_checks["once"]
+                  << " watched " << scheduler.get_size() << std::endl;
+        return false;
+    }
+    std::cout << "refreshSchedulerTest --------------" << std::endl;
+    return true;
+}
 
 int
 main(int argc, char** argv) {
@@ -52,6 +796,42 @@ main(int argc, char** argv) {
     if (!convertTest()) {
         return 1;
     }
+    if (!reprojectionTest()) {
+        return 1;
+    }
+    if (!catalogTest()) {
+        return 1;
+    }
+    if (!timeDimensionTest()) {
+        return 1;
+    }
+    if (!tileGridTest()) {
+        return 1;
+    }
+    if (!extentWaitTest()) {
+        return 1;
+    }
+    if (!nestedLayerTest()) {
+        return 1;
+    }
+    if (!jsonPullTest()) {
+        return 1;
+    }
+    if (!productIndexTest()) {
+        return 1;
+    }
+    if (!tileStoreTest()) {
+        return 1;
+    }
+    if (!legendCacheTest()) {
+        return 1;
+    }
+    if (!webMapTileTest()) {
+        return 1;
+    }
+    if (!refreshSchedulerTest()) {
+        return 1;
+    }
 
     return 0;
 }
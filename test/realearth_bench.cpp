@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2024 RPf <gpl3@pfeifer-syscon.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <sys/resource.h>
+#include <glibmm.h>
+#include <JsonHelper.hpp>
+
+#include "RealEarth.hpp"
+
+// a product as listed by api/products, used if no recorded list is given
+static const char* PRODUCT =
+"{\"id\":\"globalir_%d\",\"dataid\":\"globalir\",\"name\":\"Infrared\",\"description\":\"Global infrared\\u00b0 composite\""
+",\"type\":\"raster\",\"outputtype\":\"png24\",\"seedlatbound\":85.05,\"cached\":true,\"colorbar\":\"C\""
+",\"times\":[\"20240101.000000\",\"20240101.010000\",\"20240101.020000\",\"20240101.030000\",\"20240101.040000\",\"20240101.050000\"]"
+",\"nighttime\":{\"enabled\":false}}";
+
+static std::string
+synthesize(int products)
+{
+    std::string doc{"["};
+    for (int i = 0; i < products; ++i) {
+        if (i > 0) {
+            doc += ",";
+        }
+        doc += Glib::ustring::sprintf(PRODUCT, i);
+    }
+    doc += "]";
+    return doc;
+}
+
+// max resident in kB, as it only grows run the leaner variant first
+static long
+max_resident()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// compare the streaming with the document based reading of the product list
+//   usage: realearth_bench [recorded api/products response]
+int
+main(int argc, char** argv)
+{
+    std::string doc;
+    if (argc > 1) {
+        doc = Glib::file_get_contents(argv[1]);
+    }
+    else {
+        doc = synthesize(5000);
+    }
+    long rss = max_resident();
+    gint64 start = g_get_monotonic_time();
+    std::vector<std::shared_ptr<RealEarthProduct>> streamed;
+    JsonPullParser parser(doc.data(), doc.size());
+    auto token = parser.next();
+    if (token == JsonPullParser::Token::BeginArray) {
+        while (parser.next() == JsonPullParser::Token::BeginObject) {
+            streamed.push_back(std::make_shared<RealEarthProduct>(parser));
+        }
+    }
+    gint64 streamUs = g_get_monotonic_time() - start;
+    long streamRss = max_resident() - rss;
+    std::cout << "stream " << streamed.size() << " products " << streamUs << "us peak +" << streamRss << "kB" << std::endl;
+
+    rss = max_resident();
+    start = g_get_monotonic_time();
+    std::vector<std::shared_ptr<RealEarthProduct>> parsed;
+    try {
+        auto bytes = Glib::ByteArray::create();
+        bytes->append(reinterpret_cast<const guint8*>(doc.data()), doc.size());
+        JsonHelper helper;
+        helper.load_data(bytes);
+        JsonArray* array = helper.get_root_array();
+        guint len = json_array_get_length(array);
+        for (guint i = 0; i < len; ++i) {
+            parsed.push_back(std::make_shared<RealEarthProduct>(helper.get_array_object(array, i)));
+        }
+    }
+    catch (const JsonException& ex) {
+        std::cout << "dom " << ex.what() << std::endl;
+    }
+    gint64 domUs = g_get_monotonic_time() - start;
+    long domRss = max_resident() - rss;
+    std::cout << "dom " << parsed.size() << " products " << domUs << "us peak +" << domRss << "kB" << std::endl;
+    return streamed.size() == parsed.size() && !streamed.empty() ? 0 : 1;
+}